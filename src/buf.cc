@@ -6,6 +6,10 @@ bool buf_equal(Buf lhs, Buf rhs) {
     if (lhs.size != rhs.size) {
         return false;
     }
+    // The data of empty bufs may be null, which memcmp doesn't accept.
+    if (lhs.size == 0) {
+        return true;
+    }
 
     return memcmp(lhs.data, rhs.data, lhs.size) == 0;
 }
@@ -23,3 +27,34 @@ bool buf_starts_with(Buf buf, Buf prefix) {
     }
     return memcmp(buf.data, prefix.data, prefix.size) == 0;
 }
+
+static inline u64 hash_mix(u64 x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// Word-at-a-time hash, good enough for hash tables but not for anything
+// security related.
+u64 buf_hash(Buf buf) {
+    u64 hash = 0x9e3779b97f4a7c15ULL ^ buf.size;
+    u8 *p = buf.data;
+    usize size = buf.size;
+    while (size >= 8) {
+        u64 word;
+        memcpy(&word, p, 8);
+        hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 32;
+        p += 8;
+        size -= 8;
+    }
+    if (size) {
+        u64 word = 0;
+        memcpy(&word, p, size);
+        hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+    }
+    return hash_mix(hash);
+}
@@ -13,3 +13,5 @@ bool buf_starts_with(Buf buf, Buf prefix);
 
 #define STR_LITERAL(s) \
   Buf { .data = (u8 *)s, .size = sizeof(s) - 1 }
+
+u64 buf_hash(Buf buf);
@@ -1 +1,327 @@
-int main(int argc, char *argv[]) { return 0; }
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "src/json_trace.h"
+#include "src/mapped_file.h"
+#include "src/memory.h"
+#include "src/parallel.h"
+#include "src/trace.h"
+
+// Native front end that loads a trace headlessly and prints where the time and
+// memory went, so that the loading pipeline can be profiled with native tools.
+
+const char *USAGE = R"(fast_tracing
+
+Load a trace file and print a summary of it.
+
+USAGE:
+    fast_tracing [OPTIONS] <FILE>
+
+OPTIONS:
+    -h, --help                  Print help information.
+    --threads=<INT>             Parse with <INT> threads. Default: 0, for all
+                                cores.
+    --top=<INT>                 Print the <INT> names with the largest total
+                                duration. Default: 10
+    --name=<STR>                Print statistics of events named <STR>.
+    --search=<STR>              Print the number of slices whose name contains
+                                <STR>, ignoring case.
+)";
+
+static void print_usage() { fprintf(stderr, "%s", USAGE); }
+
+struct Args {
+    bool valid;
+    bool help;
+    const char *file;
+    usize num_threads;
+    usize top;
+    const char *name;
+    const char *search;
+};
+
+static bool parse_usize(const char *value, usize *out) {
+    u64 result;
+    if (!value || sscanf(value, "%" SCNu64, &result) != 1) {
+        return false;
+    }
+    *out = result;
+    return true;
+}
+
+static Args parse_args(int argc, char *argv[]) {
+    Args args = {.valid = true, .top = 10};
+    for (int i = 1; i < argc; ++i) {
+        char *arg = argv[i];
+        char *value = strchr(arg, '=');
+        if (value) {
+            *value++ = 0;
+        }
+
+        if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+            args.help = true;
+        } else if (strcmp(arg, "--threads") == 0) {
+            args.valid &= parse_usize(value, &args.num_threads);
+        } else if (strcmp(arg, "--top") == 0) {
+            args.valid &= parse_usize(value, &args.top);
+        } else if (strcmp(arg, "--name") == 0 && value) {
+            args.name = value;
+        } else if (strcmp(arg, "--search") == 0 && value) {
+            args.search = value;
+        } else if (!value && arg[0] != '-' && !args.file) {
+            args.file = arg;
+        } else {
+            args.valid = false;
+        }
+    }
+    if (!args.file) {
+        args.valid = false;
+    }
+    return args;
+}
+
+typedef std::chrono::steady_clock Clock;
+
+struct Phase {
+    const char *name;
+    Clock::time_point start;
+};
+
+static Phase begin_phase(const char *name) {
+    return Phase{.name = name, .start = Clock::now()};
+}
+
+static void end_phase(Phase *phase) {
+    f64 ms = std::chrono::duration<f64, std::milli>(Clock::now() - phase->start)
+                 .count();
+    fprintf(stdout, "  %-8s %10.2f ms\n", phase->name, ms);
+}
+
+static usize get_arena_size(MemoryArena *arena) {
+    usize size = 0;
+    for (MemoryBlock *block = arena->head; block; block = block->next) {
+        size += block->size;
+    }
+    return size;
+}
+
+static usize get_peak_rss() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return usage.ru_maxrss;
+#else
+    return usage.ru_maxrss * 1024;
+#endif
+}
+
+static f64 to_mb(usize size) { return (f64)size / (1024.0 * 1024.0); }
+
+struct Summary {
+    // Name ids, ranked by total duration when printed.
+    u32 *names;
+    usize num_names;
+    u64 min_ts;
+    u64 max_end;
+};
+
+// Durations come from trace->name_stats and the time range from the timeline
+// index, so both describe slices rather than raw 'B' and 'E' events.
+static void build_summary(Trace *trace, Summary *summary) {
+    summary->num_names = trace->num_name_stats;
+    summary->names = (u32 *)memory_alloc(
+        max(summary->num_names, (usize)1) * sizeof(u32));
+    ASSERT(summary->names);
+    for (usize i = 0; i < summary->num_names; ++i) {
+        summary->names[i] = (u32)i;
+    }
+    summary->min_ts = UINT64_MAX;
+    summary->max_end = 0;
+
+    // Slices at one depth are sorted by start time and don't overlap, so the
+    // first and last ones bound the depth.
+    for (usize i = 0; i < trace->num_tracks; ++i) {
+        TraceTrack *track = &trace->tracks[i];
+        for (u32 depth = 0; depth < track->num_depths; ++depth) {
+            u32 first = track->depth_offsets[depth];
+            u32 last = track->depth_offsets[depth + 1] - 1;
+            summary->min_ts = min(summary->min_ts, track->starts[first]);
+            summary->max_end = max(summary->max_end, track->ends[last]);
+        }
+    }
+}
+
+static void print_summary(Args *args, Trace *trace, Summary *summary) {
+    fprintf(stdout, "Events: %zu\n", trace_get_event_count(trace));
+    fprintf(stdout, "Strings: %zu\n", trace->strings.count);
+    fprintf(stdout, "Slices: %zu on %zu tracks\n", trace_get_slice_count(trace),
+            trace->num_tracks);
+    fprintf(stdout, "Track infos: %zu\n", trace->num_track_infos);
+    usize num_samples = 0;
+    for (usize i = 0; i < trace->num_counters; ++i) {
+        num_samples += trace->counters[i].num_samples;
+    }
+    fprintf(stdout, "Counters: %zu series, %zu samples\n", trace->num_counters,
+            num_samples);
+    fprintf(stdout, "Flows: %zu\n", trace->num_flows);
+    fprintf(stdout, "Async slices: %zu in %zu groups\n",
+            trace->num_async_slices, trace->num_async_groups);
+    if (trace_get_slice_count(trace)) {
+        fprintf(stdout, "Time range: [%" PRIu64 ", %" PRIu64 "] ns\n",
+                summary->min_ts, summary->max_end);
+    }
+
+    if (args->name) {
+        Buf name = {.data = (u8 *)args->name, .size = strlen(args->name)};
+        u32 id;
+        if (intern_table_find(&trace->strings, name, &id)) {
+            TraceNameStats *s = &trace->name_stats[id];
+            fprintf(stdout, "Name %s: count %u, total dur %" PRIu64 "\n",
+                    args->name, s->count, s->total_dur);
+            Sketch *sketch = trace_get_duration_sketch(trace, id);
+            if (sketch) {
+                fprintf(stdout,
+                        "  dur p50 %" PRIu64 ", p90 %" PRIu64 ", p99 %" PRIu64
+                        "\n",
+                        sketch_get_quantile(sketch, 0.5),
+                        sketch_get_quantile(sketch, 0.9),
+                        sketch_get_quantile(sketch, 0.99));
+            }
+        } else {
+            fprintf(stdout, "Name %s: not found\n", args->name);
+        }
+    }
+
+    if (args->search) {
+        Clock::time_point start = Clock::now();
+        TraceSearch search;
+        Buf query = {.data = (u8 *)args->search, .size = strlen(args->search)};
+        trace_search_begin(trace, query, true, &search);
+        u32 page[256];
+        usize count = trace_search_next(trace, &search, page, 256);
+        f64 first_ms =
+            std::chrono::duration<f64, std::milli>(Clock::now() - start)
+                .count();
+        while (u32 n = trace_search_next(trace, &search, page, 256)) {
+            count += n;
+        }
+        trace_search_end(&search);
+        f64 ms = std::chrono::duration<f64, std::milli>(Clock::now() - start)
+                     .count();
+        fprintf(stdout,
+                "Search %s: %zu slices, first page in %.2f ms, all in %.2f "
+                "ms\n",
+                args->search, count, first_ms, ms);
+    }
+
+    usize top = min(args->top, summary->num_names);
+    if (top) {
+        u32 *names = summary->names;
+        TraceNameStats *stats = trace->name_stats;
+        std::partial_sort(names, names + top, names + summary->num_names,
+                          [stats](u32 a, u32 b) {
+                              return stats[a].total_dur > stats[b].total_dur;
+                          });
+        fprintf(stdout,
+                "Top %zu names by total duration (total, self, count):\n",
+                top);
+        for (usize i = 0; i < top; ++i) {
+            Buf name = trace_get_string(trace, names[i]);
+            TraceNameStats *s = &stats[names[i]];
+            fprintf(stdout, "  %12" PRIu64 " %12" PRIu64 " %8u  %.*s\n",
+                    s->total_dur, s->self_dur, s->count, (int)name.size,
+                    name.data);
+        }
+    }
+}
+
+static int run(Args args) {
+    usize num_threads =
+        args.num_threads ? args.num_threads : parallel_get_num_threads();
+
+    MemoryArena arena;
+    memory_arena_init(&arena);
+    JsonTraceParser parser;
+    json_trace_parser_init(&parser, &arena);
+    Trace trace;
+    trace_init(&trace);
+
+    fprintf(stdout, "Phases:\n");
+
+    // Fault in the whole mapping up front so that I/O isn't counted as
+    // parsing.
+    Phase phase = begin_phase("read");
+    MappedFile file;
+    if (!mapped_file_open(&file, args.file)) {
+        fprintf(stderr, "Failed to open file %s: %s\n", args.file,
+                strerror(errno));
+        return 1;
+    }
+    u8 checksum = 0;
+    for (usize i = 0; i < file.data.size; i += 4096) {
+        checksum ^= ((volatile u8 *)file.data.data)[i];
+    }
+    (void)checksum;
+    trace_set_file(&trace, file);
+    end_phase(&phase);
+
+    // Interning is fused into parsing.
+    phase = begin_phase("parse");
+    JsonTraceResult result = json_trace_parser_parse_parallel(
+        &parser, &trace, trace.file.data, num_threads);
+    if (result == JsonTraceResult_Error) {
+        fprintf(stderr, "Error: %s\n", json_trace_parser_get_error(&parser));
+        return 1;
+    }
+    // The whole file was given, so the parser can't need more input unless
+    // the file is truncated.
+    if (result != JsonTraceResult_Done) {
+        fprintf(stderr, "Error: unexpected end of input\n");
+        return 1;
+    }
+    end_phase(&phase);
+
+    phase = begin_phase("index");
+    trace_build_index(&trace);
+    trace_build_lod(&trace, num_threads);
+    trace_build_name_stats(&trace, num_threads);
+    Summary summary;
+    build_summary(&trace, &summary);
+    end_phase(&phase);
+
+    fprintf(stdout, "Memory:\n");
+    fprintf(stdout, "  file     %10.2f MB\n", to_mb(trace.file.data.size));
+    fprintf(stdout, "  trace    %10.2f MB\n",
+            to_mb(get_arena_size(&trace.arena) + trace.chunk_table.size +
+                  trace.slice_chunk_table.size));
+    fprintf(stdout, "  peak rss %10.2f MB\n", to_mb(get_peak_rss()));
+
+    print_summary(&args, &trace, &summary);
+
+    memory_free(summary.names);
+    trace_deinit(&trace);
+    json_trace_parser_deinit(&parser);
+    memory_arena_deinit(&arena);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int result = 0;
+    Args args = parse_args(argc, argv);
+    if (args.valid && !args.help) {
+        result = run(args);
+    } else {
+        print_usage();
+        result = 1;
+    }
+    return result;
+}
@@ -5,6 +5,7 @@
 #include "json_trace.h"
 #include "src/json.h"
 #include "src/memory.h"
+#include "src/parallel.h"
 
 struct App {
     MemoryArena arena;
@@ -21,6 +22,9 @@ static void app_init(App *app) {
     *app = {};
     memory_arena_init(&app->arena);
     json_trace_parser_init(&app->parser, &app->arena);
+    trace_init(&app->trace);
+    // Input chunks are gone after parsing, args are kept compressed.
+    app->trace.raw.compress = true;
 
     app->input.size = INIT_INPUT_SIZE;
     app->input.data = (u8 *)memory_alloc(INIT_INPUT_SIZE);
@@ -61,8 +65,15 @@ static void app_submit_input(App *app) {
         } break;
         case JsonTraceResult_Done: {
             app->is_loading = false;
+            trace_build_index(&app->trace);
+            trace_build_lod(&app->trace, parallel_get_num_threads());
+            trace_build_name_stats(&app->trace, parallel_get_num_threads());
+            trace_publish_snapshot(&app->trace);
         } break;
         case JsonTraceResult_NeedMoreInput: {
+            // Let the UI show what has been loaded so far.
+            trace_index_names(&app->trace);
+            trace_publish_snapshot(&app->trace);
         } break;
         default:
             UNREACHABLE;
@@ -112,4 +123,16 @@ void app_end_load(void *app_) {
     App *app = (App *)app_;
     app_end_load(app);
 }
+
+EMSCRIPTEN_KEEPALIVE
+usize app_get_loaded_event_count(void *app_) {
+    App *app = (App *)app_;
+    return app->trace.snapshot.num_events;
+}
+
+EMSCRIPTEN_KEEPALIVE
+f64 app_get_loaded_end_ts(void *app_) {
+    App *app = (App *)app_;
+    return (f64)app->trace.snapshot.end_ts;
+}
 }
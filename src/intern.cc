@@ -0,0 +1,125 @@
+#include "src/intern.h"
+
+#include <memory.h>
+
+static const usize INITIAL_CAPACITY = 1024;
+static const usize POOL_BLOCK_SIZE = 64 * 1024;
+
+static inline u32 slot_hash(u64 slot) { return (u32)(slot >> 32); }
+static inline u32 slot_id(u64 slot) { return (u32)slot - 1; }
+static inline u64 make_slot(u32 hash, u32 id) {
+    return ((u64)hash << 32) | (u64)(id + 1);
+}
+
+static void insert_slot(u64 *slots, usize slot_mask, u64 hash, u64 slot) {
+    usize index = hash & slot_mask;
+    while (slots[index]) {
+        index = (index + 1) & slot_mask;
+    }
+    slots[index] = slot;
+}
+
+static void grow(InternTable *table) {
+    // Old arrays are left in the arena instead of being freed so that pointers
+    // to interned strings held by readers stay valid.
+    usize new_capacity = max(table->capacity << 1, INITIAL_CAPACITY);
+    Buf *strings = (Buf *)memory_arena_alloc(table->arena,
+                                             new_capacity * sizeof(Buf));
+    if (table->count) {
+        memcpy(strings, table->strings, table->count * sizeof(Buf));
+    }
+    table->strings = strings;
+    table->capacity = new_capacity;
+
+    // Keep the load factor of the hash table at or below 50%.
+    usize num_slots = new_capacity << 1;
+    u64 *slots =
+        (u64 *)memory_arena_calloc(table->arena, num_slots, sizeof(u64));
+    usize slot_mask = num_slots - 1;
+    if (table->slots) {
+        for (usize i = 0; i <= table->slot_mask; ++i) {
+            u64 slot = table->slots[i];
+            if (slot) {
+                u64 hash = buf_hash(table->strings[slot_id(slot)]);
+                insert_slot(slots, slot_mask, hash, slot);
+            }
+        }
+    }
+    table->slots = slots;
+    table->slot_mask = slot_mask;
+}
+
+void intern_table_init(InternTable *table, MemoryArena *arena) {
+    *table = {.arena = arena};
+    grow(table);
+
+    u32 id = intern_table_intern(table, {});
+    ASSERT(id == 0);
+}
+
+static u8 *copy_to_pool(InternTable *table, Buf str) {
+    if (str.size > table->pool_remaining) {
+        if (str.size > POOL_BLOCK_SIZE / 4) {
+            u8 *data = (u8 *)memory_arena_alloc(table->arena, str.size);
+            memcpy(data, str.data, str.size);
+            return data;
+        }
+        table->pool = (u8 *)memory_arena_alloc(table->arena, POOL_BLOCK_SIZE);
+        table->pool_remaining = POOL_BLOCK_SIZE;
+    }
+
+    u8 *data = table->pool;
+    memcpy(data, str.data, str.size);
+    table->pool += str.size;
+    table->pool_remaining -= str.size;
+    return data;
+}
+
+bool intern_table_find(InternTable *table, Buf str, u32 *id) {
+    u64 hash = buf_hash(str);
+    u32 tag = (u32)(hash >> 32);
+    usize index = hash & table->slot_mask;
+    while (u64 slot = table->slots[index]) {
+        if (slot_hash(slot) == tag &&
+            buf_equal(table->strings[slot_id(slot)], str)) {
+            *id = slot_id(slot);
+            return true;
+        }
+        index = (index + 1) & table->slot_mask;
+    }
+    return false;
+}
+
+u32 intern_table_intern(InternTable *table, Buf str) {
+    u64 hash = buf_hash(str);
+    u32 tag = (u32)(hash >> 32);
+    usize index = hash & table->slot_mask;
+    while (u64 slot = table->slots[index]) {
+        if (slot_hash(slot) == tag &&
+            buf_equal(table->strings[slot_id(slot)], str)) {
+            return slot_id(slot);
+        }
+        index = (index + 1) & table->slot_mask;
+    }
+
+    if (table->count == table->capacity) {
+        grow(table);
+        index = hash & table->slot_mask;
+        while (table->slots[index]) {
+            index = (index + 1) & table->slot_mask;
+        }
+    }
+
+    u32 id = (u32)table->count++;
+    Buf *copy = &table->strings[id];
+    copy->size = str.size;
+    if (!str.size) {
+        copy->data = 0;
+    } else if (intern_table_is_in_source(table, str)) {
+        copy->data = str.data;
+    } else {
+        copy->data = copy_to_pool(table, str);
+    }
+    table->slots[index] = make_slot(tag, id);
+    return id;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "src/buf.h"
+#include "src/defs.h"
+#include "src/memory.h"
+
+// Maps each distinct string to a dense u32 id. Interned bytes are copied once
+// into the arena, so the returned strings stay valid as long as the arena.
+// Strings inside `source` are referenced in place instead.
+//
+// Id 0 is always the empty string.
+struct InternTable {
+    MemoryArena *arena;
+
+    // id -> string
+    Buf *strings;
+    usize count;
+    usize capacity;
+
+    // Open addressing hash table. Each slot holds the upper 32 bits of the
+    // string hash and id + 1 (0 means empty).
+    u64 *slots;
+    usize slot_mask;
+
+    // Current block that interned bytes are carved from.
+    u8 *pool;
+    usize pool_remaining;
+
+    // Input that outlives the table, e.g. a mapped file. Empty by default.
+    Buf source;
+};
+
+void intern_table_init(InternTable *table, MemoryArena *arena);
+
+u32 intern_table_intern(InternTable *table, Buf str);
+
+// Returns true and sets `id` if `str` was interned before.
+bool intern_table_find(InternTable *table, Buf str, u32 *id);
+
+inline bool intern_table_is_in_source(InternTable *table, Buf str) {
+    u8 *start = table->source.data;
+    return str.data >= start &&
+           str.data + str.size <= start + table->source.size;
+}
+
+inline Buf intern_table_get(InternTable *table, u32 id) {
+    ASSERT(id < table->count);
+    return table->strings[id];
+}
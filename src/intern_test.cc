@@ -0,0 +1,87 @@
+#include "src/intern.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+
+TEST(InternTableTest, EmptyStringIsZero) {
+    MemoryArena arena;
+    memory_arena_init(&arena);
+    InternTable table;
+    intern_table_init(&table, &arena);
+
+    ASSERT_EQ(table.count, 1);
+    ASSERT_EQ(intern_table_intern(&table, STR_LITERAL("")), 0);
+    ASSERT_EQ(intern_table_get(&table, 0).size, 0);
+
+    memory_arena_deinit(&arena);
+}
+
+TEST(InternTableTest, SameStringSameId) {
+    MemoryArena arena;
+    memory_arena_init(&arena);
+    InternTable table;
+    intern_table_init(&table, &arena);
+
+    char a[] = "name";
+    char b[] = "name";
+    u32 id = intern_table_intern(&table, Buf{.data = (u8 *)a, .size = 4});
+    ASSERT_EQ(id, 1);
+    ASSERT_EQ(intern_table_intern(&table, Buf{.data = (u8 *)b, .size = 4}),
+              id);
+    ASSERT_EQ(intern_table_intern(&table, STR_LITERAL("cat")), 2);
+
+    // The table keeps its own copy of the bytes.
+    a[0] = 'x';
+    ASSERT_TRUE(buf_equal(intern_table_get(&table, id), STR_LITERAL("name")));
+
+    u32 found;
+    ASSERT_TRUE(intern_table_find(&table, STR_LITERAL("cat"), &found));
+    ASSERT_EQ(found, 2);
+    ASSERT_FALSE(intern_table_find(&table, STR_LITERAL("dog"), &found));
+
+    memory_arena_deinit(&arena);
+}
+
+TEST(InternTableTest, Grow) {
+    MemoryArena arena;
+    memory_arena_init(&arena);
+    InternTable table;
+    intern_table_init(&table, &arena);
+
+    char buf[32];
+    for (u32 i = 0; i < 10000; ++i) {
+        int size = snprintf(buf, sizeof(buf), "F(%u)", i);
+        u32 id = intern_table_intern(&table, {(u8 *)buf, (usize)size});
+        ASSERT_EQ(id, i + 1);
+    }
+    for (u32 i = 0; i < 10000; ++i) {
+        int size = snprintf(buf, sizeof(buf), "F(%u)", i);
+        Buf str = {(u8 *)buf, (usize)size};
+        ASSERT_EQ(intern_table_intern(&table, str), i + 1);
+        ASSERT_TRUE(buf_equal(intern_table_get(&table, i + 1), str));
+    }
+    ASSERT_EQ(table.count, 10001);
+
+    memory_arena_deinit(&arena);
+}
+
+TEST(InternTableTest, Source) {
+    MemoryArena arena;
+    memory_arena_init(&arena);
+    InternTable table;
+    intern_table_init(&table, &arena);
+
+    char source[] = "name cat";
+    table.source = {.data = (u8 *)source, .size = 8};
+    u32 name = intern_table_intern(&table, {.data = (u8 *)source, .size = 4});
+    u32 other = intern_table_intern(&table, STR_LITERAL("other"));
+
+    // Strings inside the source are referenced, others are copied.
+    ASSERT_EQ(intern_table_get(&table, name).data, (u8 *)source);
+    ASSERT_NE(intern_table_get(&table, other).data, (u8 *)"other");
+    ASSERT_TRUE(
+        buf_equal(intern_table_get(&table, other), STR_LITERAL("other")));
+
+    memory_arena_deinit(&arena);
+}
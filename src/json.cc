@@ -533,3 +533,184 @@ bool json_scan(MemoryArena *arena, JsonInput *input, JsonToken *token,
     return set_error(arena, token, error, "JSON value expected but got '%c'",
                      ch);
 }
+
+static const u64 POW10[] = {
+    1,
+    10,
+    100,
+    1000,
+    10000,
+    100000,
+    1000000,
+    10000000,
+    100000000,
+    1000000000,
+    10000000000,
+    100000000000,
+    1000000000000,
+    10000000000000,
+    100000000000000,
+    1000000000000000,
+    10000000000000000,
+    100000000000000000,
+    1000000000000000000,
+    10000000000000000000U,
+};
+
+// Digits that always fit in a u64.
+static const usize MAX_MANTISSA_DIGITS = 19;
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "digits are loaded in little endian");
+
+static inline bool is_eight_digits(u64 val) {
+    return ((val & 0xF0F0F0F0F0F0F0F0) |
+            (((val + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ==
+           0x3333333333333333;
+}
+
+// Converts 8 ASCII digits to their value with 3 multiplications.
+static inline u64 parse_eight_digits(u64 val) {
+    const u64 mask = 0x000000FF000000FF;
+    const u64 mul1 = 0x000F424000000064;  // 100 + (1000000 << 32)
+    const u64 mul2 = 0x0000271000000001;  // 1 + (10000 << 32)
+    val -= 0x3030303030303030;
+    val = (val * 10) + (val >> 8);
+    return (((val & mask) * mul1) + (((val >> 16) & mask) * mul2)) >> 32;
+}
+
+struct Digits {
+    u64 mantissa;
+    // Significant digits in mantissa.
+    usize num_significant;
+    // Digits that didn't fit in mantissa.
+    usize num_dropped;
+};
+
+// Reads a run of digits into `digits`, 8 at a time where possible. Returns the
+// number of digits read.
+static usize parse_digits(Buf str, usize pos, Digits *digits) {
+    usize start = pos;
+    // Leading zeros don't take up precision.
+    if (digits->mantissa == 0) {
+        while (pos < str.size && str.data[pos] == '0') {
+            pos++;
+        }
+    }
+
+    u64 mantissa = digits->mantissa;
+    usize num_left = MAX_MANTISSA_DIGITS - digits->num_significant;
+    while (pos + 8 <= str.size && num_left >= 8) {
+        u64 val;
+        memcpy(&val, str.data + pos, 8);
+        if (!is_eight_digits(val)) {
+            break;
+        }
+        mantissa = mantissa * 100000000 + parse_eight_digits(val);
+        num_left -= 8;
+        pos += 8;
+    }
+    while (pos < str.size) {
+        u8 d = str.data[pos] - '0';
+        if (d >= 10) {
+            break;
+        }
+        if (num_left) {
+            mantissa = mantissa * 10 + d;
+            num_left--;
+        } else {
+            digits->num_dropped++;
+        }
+        pos++;
+    }
+
+    digits->mantissa = mantissa;
+    digits->num_significant = MAX_MANTISSA_DIGITS - num_left;
+    return pos - start;
+}
+
+bool json_parse_fixed_point(Buf str, u32 decimals, u64 *value) {
+    Digits digits = {};
+    usize pos = 0;
+    usize num_integer = parse_digits(str, pos, &digits);
+    if (num_integer == 0) {
+        return false;
+    }
+    pos += num_integer;
+    // Dropped integer digits scale the mantissa up.
+    i64 scale = (i64)decimals + (i64)digits.num_dropped;
+
+    if (pos < str.size && str.data[pos] == '.') {
+        pos++;
+        usize num_dropped = digits.num_dropped;
+        usize num_fraction = parse_digits(str, pos, &digits);
+        if (num_fraction == 0) {
+            return false;
+        }
+        pos += num_fraction;
+        // Fraction digits that made it into the mantissa scale it down, the
+        // dropped ones are below its precision.
+        scale -= (i64)(num_fraction - (digits.num_dropped - num_dropped));
+    }
+
+    if (pos < str.size && (str.data[pos] == 'e' || str.data[pos] == 'E')) {
+        pos++;
+        bool negative = false;
+        if (pos < str.size && (str.data[pos] == '+' || str.data[pos] == '-')) {
+            negative = str.data[pos] == '-';
+            pos++;
+        }
+        usize start = pos;
+        i64 exponent = 0;
+        while (pos < str.size && (u8)(str.data[pos] - '0') < 10) {
+            // Large enough to overflow or round to 0 whatever the mantissa.
+            if (exponent < 10000) {
+                exponent = exponent * 10 + (str.data[pos] - '0');
+            }
+            pos++;
+        }
+        if (pos == start) {
+            return false;
+        }
+        scale += negative ? -exponent : exponent;
+    }
+
+    if (pos != str.size) {
+        return false;
+    }
+
+    u64 mantissa = digits.mantissa;
+    if (mantissa == 0) {
+        *value = 0;
+        return true;
+    }
+    if (scale >= 0) {
+        if (scale >= (i64)ARRAY_SIZE(POW10) ||
+            __builtin_mul_overflow(mantissa, POW10[scale], value)) {
+            return false;
+        }
+    } else if (-scale >= (i64)ARRAY_SIZE(POW10)) {
+        *value = 0;
+    } else {
+        // Round half up.
+        u64 divisor = POW10[-scale];
+        u64 result = mantissa / divisor;
+        u64 remainder = mantissa % divisor;
+        *value = result + (remainder >= divisor - remainder);
+    }
+    return true;
+}
+
+bool json_parse_f64(Buf str, f64 *value) {
+    // Long enough for any double that is written out in full.
+    char buf[400];
+    if (!str.size || str.size >= sizeof(buf) ||
+        !(str.data[0] == '-' || (str.data[0] >= '0' && str.data[0] <= '9'))) {
+        return false;
+    }
+    memcpy(buf, str.data, str.size);
+    buf[str.size] = 0;
+    char *end;
+    *value = strtod(buf, &end);
+    return end == buf + str.size;
+}
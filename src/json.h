@@ -44,3 +44,13 @@ struct JsonToken {
 // Returns false if there is no more token or an error occurred
 bool json_scan(MemoryArena *arena, JsonInput *input, JsonToken *token,
                JsonError *error);
+
+// Parses a non-negative JSON number, which may have a fraction and an
+// exponent, into an integer in units of 10^-decimals, e.g. microseconds with
+// decimals = 3 become nanoseconds. Digits beyond that precision are rounded,
+// and only the first 19 significant digits are used. Returns false if `str`
+// is not such a number or the result overflows.
+bool json_parse_fixed_point(Buf str, u32 decimals, u64 *value);
+
+// Parses a JSON number into a double. Returns false if `str` is not a number.
+bool json_parse_f64(Buf str, f64 *value);
@@ -0,0 +1,332 @@
+#include "src/json_index.h"
+
+#include <memory.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JSON_INDEX_X86 1
+#endif
+
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+// Byte classes of one block before strings and escapes are taken into
+// account.
+struct RawMasks {
+    u64 quote;
+    u64 backslash;
+    // '{', '}', '[' and ']'
+    u64 bracket;
+    // ':' and ','
+    u64 separator;
+    u64 whitespace;
+};
+
+static inline void classify_scalar(const u8 *data, RawMasks *out) {
+    *out = {};
+    for (usize i = 0; i < JSON_INDEX_BLOCK_SIZE; ++i) {
+        u64 bit = 1ULL << i;
+        u8 ch = data[i];
+        switch (ch) {
+            case '"': {
+                out->quote |= bit;
+            } break;
+
+            case '\\': {
+                out->backslash |= bit;
+            } break;
+
+            case '{':
+            case '}':
+            case '[':
+            case ']': {
+                out->bracket |= bit;
+            } break;
+
+            case ':':
+            case ',': {
+                out->separator |= bit;
+            } break;
+
+            default: {
+                if (ch <= 32) {
+                    out->whitespace |= bit;
+                }
+            } break;
+        }
+    }
+}
+
+#if JSON_INDEX_X86
+static inline void classify_sse2(const u8 *data, RawMasks *out) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i lower_bit = _mm_set1_epi8(0x20);
+    // '[' | 0x20 == '{' and ']' | 0x20 == '}'
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i space = _mm_set1_epi8(32);
+
+    *out = {};
+    for (usize i = 0; i < 4; ++i) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i * 16));
+        __m128i lower = _mm_or_si128(v, lower_bit);
+        __m128i bracket = _mm_or_si128(_mm_cmpeq_epi8(lower, open),
+                                       _mm_cmpeq_epi8(lower, close));
+        __m128i separator =
+            _mm_or_si128(_mm_cmpeq_epi8(v, colon), _mm_cmpeq_epi8(v, comma));
+        __m128i ws = _mm_cmpeq_epi8(_mm_min_epu8(v, space), v);
+
+        usize shift = i * 16;
+        out->quote |=
+            (u64)(u16)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)) << shift;
+        out->backslash |=
+            (u64)(u16)_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash)) << shift;
+        out->bracket |= (u64)(u16)_mm_movemask_epi8(bracket) << shift;
+        out->separator |= (u64)(u16)_mm_movemask_epi8(separator) << shift;
+        out->whitespace |= (u64)(u16)_mm_movemask_epi8(ws) << shift;
+    }
+}
+
+__attribute__((target("avx2"))) static inline void classify_avx2(
+    const u8 *data, RawMasks *out) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i lower_bit = _mm256_set1_epi8(0x20);
+    const __m256i open = _mm256_set1_epi8('{');
+    const __m256i close = _mm256_set1_epi8('}');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i space = _mm256_set1_epi8(32);
+
+    *out = {};
+    for (usize i = 0; i < 2; ++i) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i * 32));
+        __m256i lower = _mm256_or_si256(v, lower_bit);
+        __m256i bracket = _mm256_or_si256(_mm256_cmpeq_epi8(lower, open),
+                                          _mm256_cmpeq_epi8(lower, close));
+        __m256i separator = _mm256_or_si256(_mm256_cmpeq_epi8(v, colon),
+                                            _mm256_cmpeq_epi8(v, comma));
+        __m256i ws = _mm256_cmpeq_epi8(_mm256_min_epu8(v, space), v);
+
+        usize shift = i * 32;
+        out->quote |=
+            (u64)(u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote))
+            << shift;
+        out->backslash |=
+            (u64)(u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash))
+            << shift;
+        out->bracket |= (u64)(u32)_mm256_movemask_epi8(bracket) << shift;
+        out->separator |= (u64)(u32)_mm256_movemask_epi8(separator) << shift;
+        out->whitespace |= (u64)(u32)_mm256_movemask_epi8(ws) << shift;
+    }
+}
+#endif  // JSON_INDEX_X86
+
+#if defined(__wasm_simd128__)
+static inline void classify_simd128(const u8 *data, RawMasks *out) {
+    const v128_t quote = wasm_i8x16_splat('"');
+    const v128_t backslash = wasm_i8x16_splat('\\');
+    const v128_t lower_bit = wasm_i8x16_splat(0x20);
+    const v128_t open = wasm_i8x16_splat('{');
+    const v128_t close = wasm_i8x16_splat('}');
+    const v128_t colon = wasm_i8x16_splat(':');
+    const v128_t comma = wasm_i8x16_splat(',');
+    const v128_t space = wasm_i8x16_splat(32);
+
+    *out = {};
+    for (usize i = 0; i < 4; ++i) {
+        v128_t v = wasm_v128_load(data + i * 16);
+        v128_t lower = wasm_v128_or(v, lower_bit);
+        v128_t bracket = wasm_v128_or(wasm_i8x16_eq(lower, open),
+                                      wasm_i8x16_eq(lower, close));
+        v128_t separator =
+            wasm_v128_or(wasm_i8x16_eq(v, colon), wasm_i8x16_eq(v, comma));
+        v128_t ws = wasm_u8x16_le(v, space);
+
+        usize shift = i * 16;
+        out->quote |= (u64)wasm_i8x16_bitmask(wasm_i8x16_eq(v, quote)) << shift;
+        out->backslash |= (u64)wasm_i8x16_bitmask(wasm_i8x16_eq(v, backslash))
+                          << shift;
+        out->bracket |= (u64)wasm_i8x16_bitmask(bracket) << shift;
+        out->separator |= (u64)wasm_i8x16_bitmask(separator) << shift;
+        out->whitespace |= (u64)wasm_i8x16_bitmask(ws) << shift;
+    }
+}
+#endif  // __wasm_simd128__
+
+static inline u64 prefix_xor(u64 x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+// Takes strings and escapes into account. `size` is the number of valid bytes
+// in the block, the carry is computed at the end of them.
+static inline void finish_block(JsonIndexCarry *carry, RawMasks *raw,
+                                usize size, u64 *quote, u64 *bracket,
+                                u64 *structural, u64 *non_whitespace) {
+    // Finds escaped characters, see simdjson's find_escaped_branchless. A
+    // character is escaped if it follows an odd-length run of backslashes.
+    const u64 even_bits = 0x5555555555555555ULL;
+    u64 backslash = raw->backslash & ~carry->escaped;
+    u64 follows_escape = (backslash << 1) | carry->escaped;
+    u64 odd_sequence_starts = backslash & ~even_bits & ~follows_escape;
+    u64 sequences_starting_on_even_bits;
+    u64 overflow = __builtin_add_overflow(odd_sequence_starts, backslash,
+                                          &sequences_starting_on_even_bits);
+    u64 invert_mask = sequences_starting_on_even_bits << 1;
+    u64 escaped = (even_bits ^ invert_mask) & follows_escape;
+
+    u64 q = raw->quote & ~escaped;
+    // Set from an opening quote up to, but not including, the closing quote.
+    u64 in_string = prefix_xor(q) ^ carry->in_string;
+
+    *quote = q;
+    *bracket = raw->bracket & ~in_string;
+    *structural = (raw->bracket | raw->separator) & ~in_string;
+    *non_whitespace = ~raw->whitespace | in_string;
+
+    if (size == JSON_INDEX_BLOCK_SIZE) {
+        carry->escaped = overflow;
+        carry->in_string = (u64)((i64)in_string >> 63);
+    } else {
+        *non_whitespace &= (1ULL << size) - 1;
+        carry->escaped = (escaped >> size) & 1;
+        carry->in_string = 0 - ((in_string >> (size - 1)) & 1);
+    }
+}
+
+// Classifies data[0, size). The last block may be partial, it is padded with
+// whitespace.
+#define DEFINE_INDEX_BLOCKS(name, classify, attr)                             \
+    attr static void name(JsonIndexCarry *carry, const u8 *data, usize size, \
+                          u64 *quote, u64 *bracket, u64 *structural,         \
+                          u64 *non_whitespace) {                             \
+        usize num_blocks = size / JSON_INDEX_BLOCK_SIZE;                     \
+        RawMasks raw;                                                        \
+        for (usize i = 0; i < num_blocks; ++i) {                             \
+            classify(data + i * JSON_INDEX_BLOCK_SIZE, &raw);                \
+            finish_block(carry, &raw, JSON_INDEX_BLOCK_SIZE, &quote[i],      \
+                         &bracket[i], &structural[i], &non_whitespace[i]);   \
+        }                                                                    \
+        usize rest = size % JSON_INDEX_BLOCK_SIZE;                           \
+        if (rest) {                                                          \
+            u8 block[JSON_INDEX_BLOCK_SIZE];                                 \
+            memset(block, ' ', sizeof(block));                               \
+            memcpy(block, data + num_blocks * JSON_INDEX_BLOCK_SIZE, rest);  \
+            classify(block, &raw);                                           \
+            finish_block(carry, &raw, rest, &quote[num_blocks],              \
+                         &bracket[num_blocks], &structural[num_blocks],      \
+                         &non_whitespace[num_blocks]);                       \
+        }                                                                    \
+    }
+
+DEFINE_INDEX_BLOCKS(index_blocks_scalar, classify_scalar, )
+#if JSON_INDEX_X86
+DEFINE_INDEX_BLOCKS(index_blocks_sse2, classify_sse2, )
+DEFINE_INDEX_BLOCKS(index_blocks_avx2, classify_avx2,
+                    __attribute__((target("avx2"))))
+#endif
+#if defined(__wasm_simd128__)
+DEFINE_INDEX_BLOCKS(index_blocks_simd128, classify_simd128, )
+#endif
+
+bool json_index_is_kernel_supported(JsonIndexKernel kernel) {
+    switch (kernel) {
+        case JsonIndexKernel_Scalar: {
+            return true;
+        } break;
+
+        case JsonIndexKernel_Sse2: {
+#if JSON_INDEX_X86
+            return __builtin_cpu_supports("sse2");
+#else
+            return false;
+#endif
+        } break;
+
+        case JsonIndexKernel_Avx2: {
+#if JSON_INDEX_X86
+            return __builtin_cpu_supports("avx2");
+#else
+            return false;
+#endif
+        } break;
+
+        case JsonIndexKernel_Simd128: {
+#if defined(__wasm_simd128__)
+            return true;
+#else
+            return false;
+#endif
+        } break;
+    }
+    return false;
+}
+
+void json_index_init(JsonIndex *index) {
+    index->kernel = JsonIndexKernel_Scalar;
+    index->carry = {};
+    index->start = 0;
+    index->end = 0;
+
+    JsonIndexKernel kernels[] = {
+        JsonIndexKernel_Avx2,
+        JsonIndexKernel_Simd128,
+        JsonIndexKernel_Sse2,
+    };
+    for (usize i = 0; i < ARRAY_SIZE(kernels); ++i) {
+        if (json_index_is_kernel_supported(kernels[i])) {
+            index->kernel = kernels[i];
+            break;
+        }
+    }
+}
+
+void json_index_advance(JsonIndex *index, Buf input, usize pos) {
+    ASSERT(pos < input.size);
+    while (index->end <= pos) {
+        usize start = index->end;
+        usize size = min(JSON_INDEX_WINDOW_SIZE, input.size - start);
+        const u8 *data = input.data + start;
+        switch (index->kernel) {
+#if JSON_INDEX_X86
+            case JsonIndexKernel_Sse2: {
+                index_blocks_sse2(&index->carry, data, size, index->quote,
+                                  index->bracket, index->structural,
+                                  index->non_whitespace);
+            } break;
+
+            case JsonIndexKernel_Avx2: {
+                index_blocks_avx2(&index->carry, data, size, index->quote,
+                                  index->bracket, index->structural,
+                                  index->non_whitespace);
+            } break;
+#endif
+
+#if defined(__wasm_simd128__)
+            case JsonIndexKernel_Simd128: {
+                index_blocks_simd128(&index->carry, data, size, index->quote,
+                                     index->bracket, index->structural,
+                                     index->non_whitespace);
+            } break;
+#endif
+
+            default: {
+                index_blocks_scalar(&index->carry, data, size, index->quote,
+                                    index->bracket, index->structural,
+                                    index->non_whitespace);
+            } break;
+        }
+        index->start = start;
+        index->end = start + size;
+    }
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "src/buf.h"
+#include "src/defs.h"
+
+// Stage 1 of the JSON trace parser, in the style of simdjson. Input is
+// classified 64 bytes at a time into bitmasks (one bit per byte), so that the
+// parser can jump between interesting positions instead of branching on every
+// byte.
+//
+// The index is computed for a window of the current input at a time. Windows
+// must be indexed in order because whether a byte is escaped or inside a
+// string depends on all bytes before it. The state at the end of one input is
+// carried over to the next one.
+
+static const usize JSON_INDEX_BLOCK_SIZE = 64;
+static const usize JSON_INDEX_WINDOW_BLOCKS = 256;
+static const usize JSON_INDEX_WINDOW_SIZE =
+    JSON_INDEX_BLOCK_SIZE * JSON_INDEX_WINDOW_BLOCKS;
+
+enum JsonIndexKernel {
+    JsonIndexKernel_Scalar,
+    JsonIndexKernel_Sse2,
+    JsonIndexKernel_Avx2,
+    JsonIndexKernel_Simd128,
+};
+
+struct JsonIndexCarry {
+    // 1 if the first byte of the next block is escaped.
+    u64 escaped;
+    // All ones if the next block starts inside a string.
+    u64 in_string;
+};
+
+struct JsonIndex {
+    JsonIndexKernel kernel;
+    JsonIndexCarry carry;
+
+    // The window covers input[start, end). start is a multiple of the block
+    // size.
+    usize start;
+    usize end;
+
+    // Unescaped '"'.
+    u64 quote[JSON_INDEX_WINDOW_BLOCKS];
+    // '{', '}', '[' and ']' outside of strings.
+    u64 bracket[JSON_INDEX_WINDOW_BLOCKS];
+    // '{', '}', '[', ']', ':' and ',' outside of strings.
+    u64 structural[JSON_INDEX_WINDOW_BLOCKS];
+    // Everything except whitespace outside of strings. Bytes past the end of
+    // input are treated as whitespace.
+    u64 non_whitespace[JSON_INDEX_WINDOW_BLOCKS];
+};
+
+// Initializes the index with the fastest kernel supported by the CPU.
+void json_index_init(JsonIndex *index);
+
+bool json_index_is_kernel_supported(JsonIndexKernel kernel);
+
+// Must be called before positions of a new input are queried.
+inline void json_index_begin_input(JsonIndex *index) {
+    index->start = 0;
+    index->end = 0;
+}
+
+// Indexes windows of input until the one that contains `pos`.
+void json_index_advance(JsonIndex *index, Buf input, usize pos);
+
+// Indexes the rest of the input so that the carried state is correct for the
+// next input.
+inline void json_index_end_input(JsonIndex *index, Buf input) {
+    if (input.size) {
+        json_index_advance(index, input, input.size - 1);
+    }
+}
+
+// Returns the position of the first bit set in `masks` at or after `pos`, or
+// input.size if there is none. The window only moves forward, so `pos` must not
+// be before the start of the window of the previous query.
+inline usize json_index_next(JsonIndex *index, Buf input, u64 *masks,
+                             usize pos) {
+    DEBUG_ASSERT(pos >= index->start);
+    while (pos < input.size) {
+        if (pos >= index->end) {
+            json_index_advance(index, input, pos);
+        }
+        usize offset = pos - index->start;
+        usize block = offset / JSON_INDEX_BLOCK_SIZE;
+        u64 mask = masks[block] & (~0ULL << (offset % JSON_INDEX_BLOCK_SIZE));
+        if (mask) {
+            usize result = index->start + block * JSON_INDEX_BLOCK_SIZE +
+                           __builtin_ctzll(mask);
+            return min(result, input.size);
+        }
+        pos = index->start + (block + 1) * JSON_INDEX_BLOCK_SIZE;
+    }
+    return input.size;
+}
+
+inline usize json_index_next_quote(JsonIndex *index, Buf input, usize pos) {
+    return json_index_next(index, input, index->quote, pos);
+}
+
+inline usize json_index_next_bracket(JsonIndex *index, Buf input, usize pos) {
+    return json_index_next(index, input, index->bracket, pos);
+}
+
+inline usize json_index_next_structural(JsonIndex *index, Buf input,
+                                        usize pos) {
+    return json_index_next(index, input, index->structural, pos);
+}
+
+inline usize json_index_next_non_whitespace(JsonIndex *index, Buf input,
+                                            usize pos) {
+    return json_index_next(index, input, index->non_whitespace, pos);
+}
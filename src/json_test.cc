@@ -181,3 +181,76 @@ TEST(JsonScanTest, Null) {
     };
     run_json_scan_test(input, tokens, ARRAY_SIZE(tokens), {});
 }
+
+static void check_fixed_point(const char *str, u32 decimals, u64 expected) {
+    u64 value;
+    Buf buf = {.data = (u8 *)str, .size = strlen(str)};
+    ASSERT_TRUE(json_parse_fixed_point(buf, decimals, &value)) << str;
+    ASSERT_EQ(value, expected) << str;
+}
+
+static void check_fixed_point_error(const char *str) {
+    u64 value;
+    Buf buf = {.data = (u8 *)str, .size = strlen(str)};
+    ASSERT_FALSE(json_parse_fixed_point(buf, 3, &value)) << str;
+}
+
+TEST(JsonParseFixedPointTest, Integers) {
+    check_fixed_point("0", 3, 0);
+    check_fixed_point("7", 3, 7000);
+    check_fixed_point("12345678", 3, 12345678000);
+    check_fixed_point("1234567890123456", 3, 1234567890123456000);
+    check_fixed_point("9999999999999999999", 0, 9999999999999999999U);
+    check_fixed_point("0000000000000000000001", 0, 1);
+}
+
+TEST(JsonParseFixedPointTest, Fractions) {
+    check_fixed_point("1234567.891", 3, 1234567891);
+    check_fixed_point("1234567.8915", 3, 1234567892);
+    check_fixed_point("1234567.8914", 3, 1234567891);
+    check_fixed_point("0.5", 0, 1);
+    check_fixed_point("0.4999", 0, 0);
+    check_fixed_point("0.000001", 3, 0);
+    check_fixed_point("0.0000000000000000000000012", 25, 12);
+    check_fixed_point("1.00000000000000000000000000001", 3, 1000);
+    check_fixed_point("12345678.12345678", 8, 1234567812345678);
+}
+
+TEST(JsonParseFixedPointTest, Exponents) {
+    check_fixed_point("1e3", 0, 1000);
+    check_fixed_point("1.5E+2", 3, 150000);
+    check_fixed_point("1234567891e-3", 3, 1234567891);
+    check_fixed_point("5e-4", 3, 1);
+    check_fixed_point("5e-99999999999", 3, 0);
+    check_fixed_point("0e99999999999", 3, 0);
+}
+
+TEST(JsonParseFixedPointTest, Errors) {
+    check_fixed_point_error("");
+    check_fixed_point_error("-1");
+    check_fixed_point_error(".5");
+    check_fixed_point_error("1.");
+    check_fixed_point_error("1e");
+    check_fixed_point_error("1e+");
+    check_fixed_point_error("1x");
+    check_fixed_point_error("12345678a");
+    check_fixed_point_error("99999999999999999999");
+    check_fixed_point_error("18446744073709552");
+    check_fixed_point_error("1e99999999999");
+}
+
+TEST(JsonParseF64Test, Numbers) {
+    f64 value;
+    ASSERT_TRUE(json_parse_f64(STR_LITERAL("1.5"), &value));
+    ASSERT_EQ(value, 1.5);
+    ASSERT_TRUE(json_parse_f64(STR_LITERAL("-2e3"), &value));
+    ASSERT_EQ(value, -2000.0);
+    ASSERT_TRUE(json_parse_f64(STR_LITERAL("0"), &value));
+    ASSERT_EQ(value, 0.0);
+
+    ASSERT_FALSE(json_parse_f64(STR_LITERAL(""), &value));
+    ASSERT_FALSE(json_parse_f64(STR_LITERAL("\"1\""), &value));
+    ASSERT_FALSE(json_parse_f64(STR_LITERAL(" 1"), &value));
+    ASSERT_FALSE(json_parse_f64(STR_LITERAL("1x"), &value));
+    ASSERT_FALSE(json_parse_f64(STR_LITERAL("true"), &value));
+}
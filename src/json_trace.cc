@@ -1,12 +1,16 @@
 #include "src/json_trace.h"
 
+#include <errno.h>
 #include <memory.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "src/buf.h"
 #include "src/defs.h"
 #include "src/json.h"
+#include "src/json_index.h"
+#include "src/parallel.h"
 
 enum {
     // Initial state. we need to skip whitespace and find a '{' or '[',
@@ -38,9 +42,9 @@ enum {
     // jump to State_ArrayFormat, or we need to consume an ARRAY_END and jump to
     // parent state (either done or State_ObjectFormat).
     State_ArrayFormat_AfterTraceEvent,
-    // The cursor was inside a TraceEvent, but we reached end of input. We need
-    // consume more input to reach the end of the TraceEvent.
-    State_ArrayFormat_TraceEvent_Continued,
+    // We have consumed the '{' of a TraceEvent. The cursor is inside the
+    // TraceEvent, see parser->trace_event for the detailed state.
+    State_TraceEvent,
     // We need to skip whitespace characters until we find a target. Skip it and
     // update to the next state.
     State_SkipChar,
@@ -50,26 +54,19 @@ enum {
 };
 
 static const usize INITIAL_BUF_SIZE = 4096;
+// Only address space is reserved, a single token can't get near this.
+static const usize MAX_BUF_SIZE = (usize)1 << 30;
 
-static void ensure_buf_size(MemoryArena *arena, Buf *buf, usize size) {
-    usize new_size = buf->size;
-    if (size <= new_size) {
-        return;
-    }
-
-    while (new_size < size) {
-        new_size <<= 1;
-    }
-    buf->size = new_size;
-    buf->data = (u8 *)memory_arena_realloc(arena, buf->data, new_size);
-    ASSERT(buf->data);
+static void ensure_buf_size(MemoryReserve *memory, Buf *buf, usize size) {
+    memory_reserve_grow(memory, size);
+    *buf = {.data = memory->data, .size = memory->size};
 }
 
 static JsonTraceResult set_error(JsonTraceParser *parser, const char *fmt,
                                  ...) {
     ASSERT(parser->state != State_Error);
 
-    ensure_buf_size(parser->arena, &parser->buf, INITIAL_BUF_SIZE);
+    ensure_buf_size(&parser->buf_memory, &parser->buf, INITIAL_BUF_SIZE);
 
     va_list va;
     va_start(va, fmt);
@@ -82,16 +79,20 @@ static JsonTraceResult set_error(JsonTraceParser *parser, const char *fmt,
 }
 
 // Returns true if cursor points to a non-whitespace character
-static bool skip_whitespace(Buf buf, usize *cursor) {
-    while (*cursor < buf.size) {
-        u8 ch = buf.data[*cursor];
-        if (ch <= 32) {
-            (*cursor)++;
-        } else {
-            return true;
-        }
+static inline bool skip_whitespace(JsonTraceParser *parser, Buf buf,
+                                   usize *cursor) {
+    // Most runs of whitespace between tokens are empty or a single space, look
+    // at them directly before going to the index.
+    usize i = *cursor;
+    if (i < buf.size && buf.data[i] > 32) {
+        return true;
     }
-    return false;
+    if (i + 1 < buf.size && buf.data[i + 1] > 32) {
+        *cursor = i + 1;
+        return true;
+    }
+    *cursor = json_index_next_non_whitespace(&parser->index, buf, i);
+    return *cursor < buf.size;
 }
 
 void json_trace_parser_init(JsonTraceParser *parser, MemoryArena *arena) {
@@ -99,15 +100,22 @@ void json_trace_parser_init(JsonTraceParser *parser, MemoryArena *arena) {
         .arena = arena,
         .state = State_Init,
     };
+    json_index_init(&parser->index);
+    memory_arena_init_bump(&parser->scratch);
 
-    parser->stack.size = INITIAL_BUF_SIZE;
-    parser->stack.data = (u8 *)memory_arena_alloc(arena, parser->stack.size);
+    memory_reserve_init(&parser->stack_memory, MAX_BUF_SIZE);
+    ensure_buf_size(&parser->stack_memory, &parser->stack, INITIAL_BUF_SIZE);
 
-    parser->buf.size = INITIAL_BUF_SIZE;
-    parser->buf.data = (u8 *)memory_arena_alloc(arena, parser->buf.size);
+    memory_reserve_init(&parser->buf_memory, MAX_BUF_SIZE);
+    ensure_buf_size(&parser->buf_memory, &parser->buf, INITIAL_BUF_SIZE);
 }
 
 void json_trace_parser_deinit(JsonTraceParser *parser) {
+    memory_arena_deinit(&parser->scratch);
+    memory_reserve_deinit(&parser->stack_memory);
+    memory_reserve_deinit(&parser->buf_memory);
+    parser->stack = {};
+    parser->buf = {};
     parser->state = State_Done;
 }
 
@@ -116,12 +124,7 @@ static void save_input(JsonTraceParser *parser, usize *cursor, Buf input) {
         return;
     }
 
-    if (*cursor + input.size > parser->buf.size) {
-        parser->buf.size = max(INITIAL_BUF_SIZE, *cursor + input.size);
-        parser->buf.data = (u8 *)memory_arena_realloc(
-            parser->arena, parser->buf.data, parser->buf.size);
-        ASSERT(parser->buf.data);
-    }
+    ensure_buf_size(&parser->buf_memory, &parser->buf, *cursor + input.size);
     memcpy(parser->buf.data + *cursor, input.data, input.size);
     *cursor += input.size;
 }
@@ -137,7 +140,8 @@ static void handle_object_format_key(JsonTraceParser *parser, Buf key) {
 }
 
 static void push_stack(JsonTraceParser *parser, u8 ch) {
-    ensure_buf_size(parser->arena, &parser->stack, parser->stack_cursor + 1);
+    ensure_buf_size(&parser->stack_memory, &parser->stack,
+                    parser->stack_cursor + 1);
     parser->stack.data[parser->stack_cursor++] = ch;
 }
 
@@ -157,206 +161,6 @@ static bool is_stack_empty(JsonTraceParser *parser) {
     return parser->stack_cursor == 0;
 }
 
-static bool accept_char(JsonTraceParser *parser, Buf buf, usize *cursor,
-                        u8 expected) {
-    if (!skip_whitespace(buf, cursor)) {
-        return false;
-    }
-
-    u8 ch = buf.data[*cursor];
-    if (ch == expected) {
-        *cursor += 1;
-        return true;
-    }
-
-    return false;
-}
-
-static bool expect_char(JsonTraceParser *parser, Buf buf, usize *cursor,
-                        u8 expected) {
-    if (!accept_char(parser, buf, cursor, expected)) {
-        u8 ch = 0;
-        if (*cursor < buf.size) {
-            ch = buf.data[*cursor];
-        }
-        return set_error(parser, "Expected '%c', but got '%c'", expected, ch);
-    }
-
-    return true;
-}
-
-static bool expect_string(JsonTraceParser *parser, Buf buf, usize *cursor,
-                          Buf *out) {
-    if (!expect_char(parser, buf, cursor, '"')) {
-        return false;
-    }
-
-    usize start = *cursor;
-    while (*cursor < buf.size) {
-        u8 ch = buf.data[(*cursor)++];
-        if (ch == '"' && buf.data[*cursor - 2] != '\\') {
-            *out = buf_slice(buf, start, *cursor - 1);
-            return true;
-        }
-    }
-
-    Buf view = buf_slice(buf, start - 1, buf.size);
-    return set_error(parser, "Unexpected eof before reaching '\"': %.*s",
-                     (int)view.size, view.data);
-}
-
-static bool skip_json_value(JsonTraceParser *parser, Buf buf, usize *cursor);
-
-static bool skip_json_object(JsonTraceParser *parser, Buf buf, usize *cursor) {
-    while (!accept_char(parser, buf, cursor, '}')) {
-        accept_char(parser, buf, cursor, ',');
-        Buf key;
-        if (!expect_string(parser, buf, cursor, &key)) {
-            return false;
-        }
-        if (!expect_char(parser, buf, cursor, ':')) {
-            return false;
-        }
-        if (!skip_json_value(parser, buf, cursor)) {
-            return false;
-        }
-    }
-    return true;
-}
-
-static bool skip_json_array(JsonTraceParser *parser, Buf buf, usize *cursor) {
-    while (!accept_char(parser, buf, cursor, ']')) {
-        accept_char(parser, buf, cursor, ',');
-        if (!skip_json_value(parser, buf, cursor)) {
-            return false;
-        }
-    }
-    return true;
-}
-
-static bool skip_json_number(JsonTraceParser *parser, Buf buf, usize *cursor) {
-    while (*cursor < buf.size) {
-        u8 ch = buf.data[*cursor];
-        switch (ch) {
-            case '0' ... '9':
-            case '.':
-            case 'e':
-            case 'E':
-            case '-':
-            case '+': {
-                *cursor += 1;
-            } break;
-
-            default: {
-                return true;
-            } break;
-        }
-    }
-    return true;
-}
-
-static bool skip_json_value(JsonTraceParser *parser, Buf buf, usize *cursor) {
-    if (!skip_whitespace(buf, cursor)) {
-        return set_error(parser, "Unexpected eof");
-    }
-
-    u8 ch = buf.data[(*cursor)++];
-    switch (ch) {
-        case '{': {
-            return skip_json_object(parser, buf, cursor);
-        } break;
-
-        case '[': {
-            return skip_json_array(parser, buf, cursor);
-        } break;
-
-        case '"': {
-            *cursor -= 1;
-            Buf s;
-            return expect_string(parser, buf, cursor, &s);
-        } break;
-
-        case '-':
-        case '0' ... '9': {
-            return skip_json_number(parser, buf, cursor);
-        } break;
-
-        case 't': {
-            Buf s = STR_LITERAL("rue");
-            if (!buf_starts_with(buf_slice(buf, *cursor, buf.size), s)) {
-                return set_error(parser, "Unexpected character %c", ch);
-            }
-            *cursor += s.size;
-            return true;
-        } break;
-
-        case 'f': {
-            Buf s = STR_LITERAL("alse");
-            if (!buf_starts_with(buf_slice(buf, *cursor, buf.size), s)) {
-                return set_error(parser, "Unexpected character %c", ch);
-            }
-            *cursor += s.size;
-            return true;
-        } break;
-
-        case 'n': {
-            Buf s = STR_LITERAL("ull");
-            if (!buf_starts_with(buf_slice(buf, *cursor, buf.size), s)) {
-                return set_error(parser, "Unexpected character %c", ch);
-            }
-            *cursor += s.size;
-            return true;
-        } break;
-
-        default: {
-            return set_error(parser, "Unexpected character %c", ch);
-        } break;
-    }
-}
-
-static bool str_to_u64(Buf buf, u64 *val) {
-    static const u64 pow10[] = {
-        10000000000000000000U,
-        1000000000000000000,
-        100000000000000000,
-        10000000000000000,
-        1000000000000000,
-        100000000000000,
-        10000000000000,
-        1000000000000,
-        100000000000,
-        10000000000,
-        1000000000,
-        100000000,
-        10000000,
-        1000000,
-        100000,
-        10000,
-        1000,
-        100,
-        10,
-        1,
-    };
-
-    usize i = ARRAY_SIZE(pow10) - buf.size;
-    if (i >= ARRAY_SIZE(pow10)) {
-        return false;
-    }
-
-    u64 result = 0;
-    u8 *end = buf.data + buf.size;
-    u8 *p = buf.data;
-    for (; p != end; ++p) {
-        u8 d = *p - '0';
-        if (d >= 10) {
-            return false;
-        }
-        result += pow10[i++] * d;
-    }
-    *val = result;
-    return true;
-}
-
 static bool str_to_u32(Buf buf, u32 *val) {
     static const u32 pow10[] = {
         1000000000U,  //
@@ -390,100 +194,9 @@ static bool str_to_u32(Buf buf, u32 *val) {
     return true;
 }
 
-static bool expect_u64(JsonTraceParser *parser, Buf buf, usize *cursor,
-                       u64 *value) {
-    if (!skip_whitespace(buf, cursor)) {
-        return set_error(parser, "Unexpected eof");
-    }
-
-    usize start = *cursor;
-    if (!skip_json_number(parser, buf, cursor)) {
-        return false;
-    }
-    usize end = *cursor;
-    if (!str_to_u64(buf_slice(buf, start, end), value)) {
-        return set_error(parser, "Expected u64, but got '%.*s'",
-                         (int)(end - start), buf.data + start);
-    }
-    return true;
-}
-
-static bool expect_u32(JsonTraceParser *parser, Buf buf, usize *cursor,
-                       u32 *value) {
-    if (!skip_whitespace(buf, cursor)) {
-        return set_error(parser, "Unexpected eof");
-    }
-
-    usize start = *cursor;
-    if (!skip_json_number(parser, buf, cursor)) {
-        return false;
-    }
-    usize end = *cursor;
-    if (!str_to_u32(buf_slice(buf, start, end), value)) {
-        return set_error(parser, "Expected u32, but got '%.*s'",
-                         (int)(end - start), buf.data + start);
-    }
-    return true;
-}
-
-static JsonTraceResult handle_trace_event(JsonTraceParser *parser, Trace *trace,
-                                          Buf trace_event) {
-    usize cursor = 0;
-    if (!expect_char(parser, trace_event, &cursor, '{')) {
-        return JsonTraceResult_Error;
-    }
-
-    TraceEvent event = {};
-
-    while (!accept_char(parser, trace_event, &cursor, '}')) {
-        accept_char(parser, trace_event, &cursor, ',');
-        Buf key;
-        if (!expect_string(parser, trace_event, &cursor, &key)) {
-            return JsonTraceResult_Error;
-        }
-        expect_char(parser, trace_event, &cursor, ':');
-
-        if (buf_equal(key, STR_LITERAL("name"))) {
-            if (!expect_string(parser, trace_event, &cursor, &event.name)) {
-                return JsonTraceResult_Error;
-            }
-        } else if (buf_equal(key, STR_LITERAL("cat"))) {
-            if (!expect_string(parser, trace_event, &cursor, &event.cat)) {
-                return JsonTraceResult_Error;
-            }
-        } else if (buf_equal(key, STR_LITERAL("ph"))) {
-            Buf str;
-            if (!expect_string(parser, trace_event, &cursor, &str)) {
-                return JsonTraceResult_Error;
-            }
-            if (str.size > 0) {
-                event.ph = str.data[0];
-            }
-        } else if (buf_equal(key, STR_LITERAL("ts"))) {
-            if (!expect_u64(parser, trace_event, &cursor, &event.ts)) {
-                return JsonTraceResult_Error;
-            }
-        } else if (buf_equal(key, STR_LITERAL("pid"))) {
-            if (!expect_u32(parser, trace_event, &cursor, &event.pid)) {
-                return JsonTraceResult_Error;
-            }
-        } else if (buf_equal(key, STR_LITERAL("tid"))) {
-            if (!expect_u32(parser, trace_event, &cursor, &event.tid)) {
-                return JsonTraceResult_Error;
-            }
-        } else {
-            if (!skip_json_value(parser, trace_event, &cursor)) {
-                return JsonTraceResult_Error;
-            }
-        }
-    }
-
-    return JsonTraceResult_Done;
-}
-
 static JsonTraceResult on_state_init(JsonTraceParser *parser, Buf buf,
                                      usize *cursor) {
-    if (!skip_whitespace(buf, cursor)) {
+    if (!skip_whitespace(parser, buf, cursor)) {
         return JsonTraceResult_NeedMoreInput;
     }
     u8 ch = buf.data[*cursor];
@@ -513,7 +226,7 @@ static JsonTraceResult on_state_init(JsonTraceParser *parser, Buf buf,
 
 static JsonTraceResult on_state_object_format(JsonTraceParser *parser, Buf buf,
                                               usize *cursor) {
-    if (!skip_whitespace(buf, cursor)) {
+    if (!skip_whitespace(parser, buf, cursor)) {
         return JsonTraceResult_NeedMoreInput;
     }
 
@@ -560,7 +273,7 @@ static JsonTraceResult on_state_object_format(JsonTraceParser *parser, Buf buf,
 
 static JsonTraceResult on_state_object_format_trace_events(
     JsonTraceParser *parser, Buf buf, usize *cursor) {
-    if (!skip_whitespace(buf, cursor)) {
+    if (!skip_whitespace(parser, buf, cursor)) {
         return JsonTraceResult_NeedMoreInput;
     }
 
@@ -585,11 +298,11 @@ static JsonTraceResult on_state_object_format_key_continued(
     while (*cursor < buf.size) {
         u8 ch = buf.data[*cursor];
         if (ch == '"') {
-            u8 last_char;
-            if (*cursor == 0) {
-                last_char = parser->buf.data[parser->buf_cursor - 1];
-            } else {
+            u8 last_char = 0;
+            if (*cursor > 0) {
                 last_char = buf.data[*cursor - 1];
+            } else if (parser->buf_cursor > 0) {
+                last_char = parser->buf.data[parser->buf_cursor - 1];
             }
 
             if (last_char != '\\') {
@@ -598,9 +311,11 @@ static JsonTraceResult on_state_object_format_key_continued(
                 Buf key = buf_slice(parser->buf, 0, parser->buf_cursor);
                 handle_object_format_key(parser, key);
                 found_key = true;
+                (*cursor)++;
                 break;
             }
         }
+        (*cursor)++;
     }
     if (!found_key) {
         save_input(parser, &parser->buf_cursor, buf);
@@ -615,7 +330,7 @@ static JsonTraceResult on_state_object_format_unknown_key(
     // object.
 
     if (!parser->unknown_key.init) {
-        if (!skip_whitespace(buf, cursor)) {
+        if (!skip_whitespace(parser, buf, cursor)) {
             return JsonTraceResult_NeedMoreInput;
         }
 
@@ -672,12 +387,11 @@ static JsonTraceResult on_state_object_format_unknown_key(
 
                         case '}': {
                             if (!is_stack_top(parser, '"')) {
+                                pop_stack(parser);
                                 if (is_stack_empty(parser)) {
                                     parser->state =
                                         State_ObjectFormat_AfterValue;
                                     done = true;
-                                } else {
-                                    pop_stack(parser);
                                 }
                             }
                         } break;
@@ -709,12 +423,11 @@ static JsonTraceResult on_state_object_format_unknown_key(
 
                         case ']': {
                             if (!is_stack_top(parser, '"')) {
+                                pop_stack(parser);
                                 if (is_stack_empty(parser)) {
                                     parser->state =
                                         State_ObjectFormat_AfterValue;
                                     done = true;
-                                } else {
-                                    pop_stack(parser);
                                 }
                             }
                         } break;
@@ -760,7 +473,7 @@ static JsonTraceResult on_state_object_format_unknown_key(
 
 static JsonTraceResult on_state_object_format_after_value(
     JsonTraceParser *parser, Buf buf, usize *cursor) {
-    if (!skip_whitespace(buf, cursor)) {
+    if (!skip_whitespace(parser, buf, cursor)) {
         return JsonTraceResult_NeedMoreInput;
     }
 
@@ -788,130 +501,895 @@ static JsonTraceResult on_state_object_format_after_value(
     return JsonTraceResult_Continue;
 }
 
-static JsonTraceResult on_state_array_format(JsonTraceParser *parser, Buf buf,
-                                             usize *cursor, Trace *trace) {
-    usize start = *cursor;
-
-    if (parser->buf_cursor == 0) {
-        if (!skip_whitespace(buf, cursor)) {
-            return JsonTraceResult_NeedMoreInput;
-        }
+enum {
+    // We need to skip whitespace and find a '"' that starts the next key, or
+    // a '}' that ends the TraceEvent.
+    Event_Key,
+    // We are inside the string of a key.
+    Event_KeyString,
+    // We need to skip whitespace and eat a ':'.
+    Event_Colon,
+    // We need to skip whitespace and look at the first character of the value.
+    Event_Value,
+    // We are inside the string value of a known key.
+    Event_StringValue,
+    // We are inside the number value of a known key.
+    Event_NumberValue,
+    // We are skipping the value of a key we don't care about, which is a
+    // string, an other scalar, or an object or array.
+    Event_SkipString,
+    Event_SkipScalar,
+    Event_SkipContainer,
+    // We have processed a key-value pair. We need to eat a ',' or '}'.
+    Event_AfterValue,
+};
 
-        u8 ch = buf.data[*cursor];
-        if (ch != '{') {
-            return set_error(parser,
-                             "Invalid JSON Trace: expected '{' but got "
-                             "'%c'",
-                             ch);
-        }
+enum {
+    Key_Unknown,
+    // Keys whose values are stored.
+    Key_Name,
+    Key_Cat,
+    Key_Ph,
+    Key_Ts,
+    Key_Dur,
+    Key_Tdur,
+    Key_Pid,
+    Key_Tid,
+    // Other keys of the Trace Event Format, their values are skipped for now.
+    Key_Tts,
+    Key_Id,
+    Key_Id2,
+    Key_BindId,
+    Key_S,
+    Key_Args,
+    Key_FlowIn,
+    Key_FlowOut,
+};
 
-        parser->stack_cursor = 0;
-        push_stack(parser, '{');
-        parser->array_format.last_char = ch;
-        parser->array_format.is_in_str = false;
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "key words are compared in little endian");
 
-        start = *cursor;
-        (*cursor) += 1;
+// The bytes of a key of at most 8 bytes as a little endian integer.
+static constexpr u64 key_word(const char *key) {
+    u64 word = 0;
+    for (usize i = 0; key[i]; ++i) {
+        word |= (u64)(u8)key[i] << (8 * i);
     }
+    return word;
+}
 
-    bool found = false;
-    while (*cursor < buf.size && !found) {
-        u8 ch = buf.data[(*cursor)++];
-        switch (ch) {
-            case '"': {
-                if (parser->array_format.is_in_str) {
-                    if (parser->array_format.last_char != '\\') {
-                        parser->array_format.is_in_str = false;
-                    }
-                } else {
-                    parser->array_format.is_in_str = true;
-                }
-            } break;
+template <usize N>
+static inline u64 load_key_word(u8 *data) {
+    u64 word = 0;
+    memcpy(&word, data, N);
+    return word;
+}
 
-            case '{': {
-                if (!parser->array_format.is_in_str) {
-                    push_stack(parser, '{');
-                }
-            } break;
+// All known keys fit in 8 bytes, so a key is matched with a switch on its
+// length and a single integer compare per candidate.
+static u8 match_trace_event_key(Buf key) {
+    switch (key.size) {
+        case 1: {
+            if (key.data[0] == 's') {
+                return Key_S;
+            }
+        } break;
 
-            case '}': {
-                if (!parser->array_format.is_in_str) {
-                    pop_stack(parser);
-
-                    if (is_stack_empty(parser)) {
-                        usize end = *cursor;
-                        Buf trace_event;
-                        if (parser->buf_cursor) {
-                            save_input(parser, &parser->buf_cursor,
-                                       buf_slice(buf, start, end));
-                            trace_event =
-                                buf_slice(parser->buf, 0, parser->buf_cursor);
-                        } else {
-                            trace_event = buf_slice(buf, start, end);
-                        }
-                        if (handle_trace_event(parser, trace, trace_event) ==
-                            JsonTraceResult_Error) {
-                            return JsonTraceResult_Error;
-                        }
-                        found = true;
-                    }
-                }
-            } break;
+        case 2: {
+            u64 word = load_key_word<2>(key.data);
+            if (word == key_word("ph")) {
+                return Key_Ph;
+            } else if (word == key_word("ts")) {
+                return Key_Ts;
+            } else if (word == key_word("id")) {
+                return Key_Id;
+            }
+        } break;
 
-            default: {
-            } break;
-        }
+        case 3: {
+            u64 word = load_key_word<3>(key.data);
+            if (word == key_word("pid")) {
+                return Key_Pid;
+            } else if (word == key_word("tid")) {
+                return Key_Tid;
+            } else if (word == key_word("dur")) {
+                return Key_Dur;
+            } else if (word == key_word("cat")) {
+                return Key_Cat;
+            } else if (word == key_word("tts")) {
+                return Key_Tts;
+            } else if (word == key_word("id2")) {
+                return Key_Id2;
+            }
+        } break;
 
-        parser->array_format.last_char = ch;
-    }
+        case 4: {
+            u64 word = load_key_word<4>(key.data);
+            if (word == key_word("name")) {
+                return Key_Name;
+            } else if (word == key_word("args")) {
+                return Key_Args;
+            } else if (word == key_word("tdur")) {
+                return Key_Tdur;
+            }
+        } break;
 
-    if (found) {
-        parser->state = State_ArrayFormat_AfterTraceEvent;
-        return JsonTraceResult_Continue;
-    } else {
-        save_input(parser, &parser->buf_cursor,
-                   buf_slice(buf, start, buf.size));
-        return JsonTraceResult_NeedMoreInput;
+        case 7: {
+            u64 word = load_key_word<7>(key.data);
+            if (word == key_word("bind_id")) {
+                return Key_BindId;
+            } else if (word == key_word("flow_in")) {
+                return Key_FlowIn;
+            }
+        } break;
+
+        case 8: {
+            if (load_key_word<8>(key.data) == key_word("flow_out")) {
+                return Key_FlowOut;
+            }
+        } break;
     }
+    return Key_Unknown;
 }
 
-static JsonTraceResult on_state_array_format_after_trace_event(
-    JsonTraceParser *parser, Buf buf, usize *cursor) {
-    if (!skip_whitespace(buf, cursor)) {
-        return JsonTraceResult_NeedMoreInput;
+static bool is_skipped_key(u8 key) {
+    return key == Key_Unknown || key >= Key_Tts;
+}
+
+static bool is_string_key(u8 key) {
+    return key == Key_Name || key == Key_Cat || key == Key_Ph;
+}
+
+static bool is_number_char(u8 ch) {
+    return (ch >= '0' && ch <= '9') || ch == '.' || ch == 'e' || ch == 'E' ||
+           ch == '-' || ch == '+';
+}
+
+// Returns the token that started in a previous input (saved in parser->buf)
+// and ends at buf[0, end), or buf[start, end) if the token starts in this
+// input.
+static Buf finish_token(JsonTraceParser *parser, Buf buf, usize start,
+                        usize end) {
+    if (parser->buf_cursor) {
+        save_input(parser, &parser->buf_cursor, buf_slice(buf, start, end));
+        return buf_slice(parser->buf, 0, parser->buf_cursor);
     }
+    return buf_slice(buf, start, end);
+}
 
-    u8 ch = buf.data[*cursor];
-    if (ch == ',') {
-        (*cursor)++;
-        parser->state = State_ArrayFormat;
-        parser->buf_cursor = 0;
-    } else if (ch == ']') {
-        (*cursor)++;
-        if (parser->has_object_format) {
-            parser->state = State_ObjectFormat_AfterValue;
-        } else {
-            parser->state = State_Done;
-            return JsonTraceResult_Done;
+// Scans the content of a string until the closing '"'. Returns false if the
+// end of input was reached first, in which case the scanned part is saved if
+// `save` is true.
+static bool scan_string(JsonTraceParser *parser, Buf buf, usize *cursor,
+                        bool save, Buf *out) {
+    usize start = *cursor;
+    usize end = json_index_next_quote(&parser->index, buf, start);
+    if (end == buf.size) {
+        *cursor = end;
+        if (save) {
+            save_input(parser, &parser->buf_cursor,
+                       buf_slice(buf, start, end));
         }
-    } else {
-        return set_error(parser,
-                         "Invalid JSON Trace: expected ',' or ']' but got "
-                         "'%c'",
-                         ch);
+        return false;
     }
 
-    return JsonTraceResult_Continue;
+    *cursor = end + 1;
+    if (save) {
+        *out = finish_token(parser, buf, start, end);
+    }
+    return true;
 }
 
-static JsonTraceResult on_state_skip_char(JsonTraceParser *parser, Buf buf,
-                                          usize *cursor) {
-    if (!skip_whitespace(buf, cursor)) {
-        return JsonTraceResult_NeedMoreInput;
-    }
-    u8 ch = buf.data[*cursor];
-    if (ch != parser->skip_char.target) {
-        return set_error(parser,
+static JsonTraceResult handle_string_value(JsonTraceParser *parser,
+                                           Trace *trace, Buf str) {
+    TraceEvent *event = &parser->trace_event.event;
+    switch (parser->trace_event.key) {
+        // name and cat point into the input which is only valid until the
+        // next chunk arrives, so they are interned right away.
+        case Key_Name: {
+            event->name = trace_intern(trace, str);
+        } break;
+
+        case Key_Cat: {
+            event->cat = trace_intern(trace, str);
+        } break;
+
+        case Key_Ph: {
+            if (str.size > 0) {
+                event->ph = str.data[0];
+            }
+        } break;
+
+        default: {
+            UNREACHABLE;
+        } break;
+    }
+    return JsonTraceResult_Continue;
+}
+
+static JsonTraceResult handle_number_value(JsonTraceParser *parser, Buf str) {
+    TraceEvent *event = &parser->trace_event.event;
+    switch (parser->trace_event.key) {
+        // Times are in microseconds, stored as nanoseconds. They are unsigned,
+        // negative ones are errors.
+        case Key_Ts: {
+            if (!json_parse_fixed_point(str, 3, &event->ts)) {
+                return set_error(parser,
+                                 "Expected non-negative time, but got '%.*s'",
+                                 (int)str.size, str.data);
+            }
+        } break;
+
+        case Key_Dur: {
+            if (!json_parse_fixed_point(str, 3, &event->dur)) {
+                return set_error(parser,
+                                 "Expected non-negative time, but got '%.*s'",
+                                 (int)str.size, str.data);
+            }
+        } break;
+
+        case Key_Tdur: {
+            if (!json_parse_fixed_point(str, 3, &event->tdur)) {
+                return set_error(parser,
+                                 "Expected non-negative time, but got '%.*s'",
+                                 (int)str.size, str.data);
+            }
+        } break;
+
+        case Key_Pid: {
+            if (!str_to_u32(str, &event->pid)) {
+                return set_error(parser, "Expected u32, but got '%.*s'",
+                                 (int)str.size, str.data);
+            }
+        } break;
+
+        case Key_Tid: {
+            if (!str_to_u32(str, &event->tid)) {
+                return set_error(parser, "Expected u32, but got '%.*s'",
+                                 (int)str.size, str.data);
+            }
+        } break;
+
+        default: {
+            UNREACHABLE;
+        } break;
+    }
+    return JsonTraceResult_Continue;
+}
+
+// Skips a scalar other than string, it ends at the next delimiter. Returns
+// false if more input is needed.
+static bool skip_scalar(Buf buf, usize *cursor) {
+    usize i = *cursor;
+    while (i < buf.size) {
+        u8 ch = buf.data[i];
+        if (ch == ',' || ch == '}' || ch == ']' || ch <= 32) {
+            *cursor = i;
+            return true;
+        }
+        i++;
+    }
+    *cursor = i;
+    return false;
+}
+
+// Skips an object or array by jumping between brackets. Strings inside are
+// never looked at. Returns false if more input is needed.
+static bool skip_container(JsonTraceParser *parser, Buf buf, usize *cursor) {
+    JsonTraceParserState_TraceEvent *state = &parser->trace_event;
+    usize i = *cursor;
+    while (true) {
+        i = json_index_next_bracket(&parser->index, buf, i);
+        if (i == buf.size) {
+            *cursor = i;
+            return false;
+        }
+        u8 ch = buf.data[i++];
+        if (ch == '{' || ch == '[') {
+            state->depth++;
+        } else if (--state->depth == 0) {
+            *cursor = i;
+            return true;
+        }
+    }
+}
+
+// Scans the value that starts at the next token. Returns false on error.
+static bool scan_json_value(MemoryArena *arena, JsonInput *input) {
+    JsonToken token;
+    JsonError error;
+    usize depth = 0;
+    do {
+        if (!json_scan(arena, input, &token, &error)) {
+            return false;
+        }
+        if (token.type == JsonToken_ObjectStart ||
+            token.type == JsonToken_ArrayStart) {
+            depth++;
+        } else if (token.type == JsonToken_ObjectEnd ||
+                   token.type == JsonToken_ArrayEnd) {
+            if (depth == 0) {
+                return false;
+            }
+            depth--;
+        }
+    } while (depth);
+    return true;
+}
+
+// Returns the value of `key` in the JSON object `raw`, or an empty Buf.
+static Buf find_field(Buf raw, Buf key, MemoryArena *arena) {
+    JsonInput input;
+    json_input_init(&input, raw);
+    JsonToken token;
+    JsonError error;
+    if (!json_scan(arena, &input, &token, &error) ||
+        token.type != JsonToken_ObjectStart) {
+        return {};
+    }
+
+    while (true) {
+        if (!json_scan(arena, &input, &token, &error) ||
+            token.type != JsonToken_String) {
+            return {};
+        }
+        bool found = buf_equal(token.value, key);
+        if (!json_scan(arena, &input, &token, &error) ||
+            token.type != JsonToken_Colon) {
+            return {};
+        }
+
+        usize start = input.cursor;
+        if (!scan_json_value(arena, &input)) {
+            return {};
+        }
+        if (found) {
+            while (start < input.cursor && raw.data[start] <= 32) {
+                start++;
+            }
+            return buf_slice(raw, start, input.cursor);
+        }
+
+        if (!json_scan(arena, &input, &token, &error) ||
+            token.type != JsonToken_Comma) {
+            return {};
+        }
+    }
+}
+
+// Adds a sample for every key in the args of a 'C' event whose value is a
+// number.
+static void push_counter_samples(Trace *trace, TraceEvent *event, Buf args,
+                                 MemoryArena *arena) {
+    JsonInput input;
+    json_input_init(&input, args);
+    JsonToken token;
+    JsonError error;
+    if (!json_scan(arena, &input, &token, &error) ||
+        token.type != JsonToken_ObjectStart) {
+        return;
+    }
+
+    while (json_scan(arena, &input, &token, &error) &&
+           token.type == JsonToken_String) {
+        Buf key = token.value;
+        if (!json_scan(arena, &input, &token, &error) ||
+            token.type != JsonToken_Colon) {
+            return;
+        }
+
+        usize start = input.cursor;
+        if (!scan_json_value(arena, &input)) {
+            return;
+        }
+        while (start < input.cursor && args.data[start] <= 32) {
+            start++;
+        }
+        f64 value;
+        if (json_parse_f64(buf_slice(args, start, input.cursor), &value)) {
+            trace_push_counter_sample(trace, event->pid, event->name,
+                                      trace_intern(trace, key), event->ts,
+                                      value);
+        }
+
+        if (!json_scan(arena, &input, &token, &error) ||
+            token.type != JsonToken_Comma) {
+            return;
+        }
+    }
+}
+
+// Returns the kind of the link point of an event with phase `ph`, or false if
+// the phase is not part of a flow or an async operation.
+static bool get_link_kind(u8 ph, u8 *kind) {
+    switch (ph) {
+        case 's': {
+            *kind = TraceLink_FlowStart;
+        } break;
+        case 't': {
+            *kind = TraceLink_FlowStep;
+        } break;
+        case 'f': {
+            *kind = TraceLink_FlowEnd;
+        } break;
+        case 'b':
+        case 'S': {
+            *kind = TraceLink_AsyncBegin;
+        } break;
+        case 'e':
+        case 'F': {
+            *kind = TraceLink_AsyncEnd;
+        } break;
+        case 'n':
+        case 'T':
+        case 'p': {
+            *kind = TraceLink_AsyncInstant;
+        } break;
+        default: {
+            return false;
+        } break;
+    }
+    return true;
+}
+
+static Buf unquote(Buf str) {
+    if (str.size >= 2 && str.data[0] == '"') {
+        return buf_slice(str, 1, str.size - 1);
+    }
+    return {};
+}
+
+// Ids are numbers, or strings that are hex numbers or opaque.
+static bool parse_link_id(Trace *trace, Buf value, u64 *id) {
+    Buf str = unquote(value);
+    if (!str.data) {
+        return json_parse_fixed_point(value, 0, id) &&
+               !(*id & TRACE_LINK_STRING_ID);
+    }
+    if (str.size > 2 && str.size <= 18 && str.data[0] == '0' &&
+        (str.data[1] == 'x' || str.data[1] == 'X')) {
+        u64 result = 0;
+        usize i = 2;
+        for (; i < str.size; ++i) {
+            u8 ch = str.data[i] | 0x20;
+            if (ch >= '0' && ch <= '9') {
+                result = (result << 4) | (ch - '0');
+            } else if (ch >= 'a' && ch <= 'f') {
+                result = (result << 4) | (ch - 'a' + 10);
+            } else {
+                break;
+            }
+        }
+        if (i == str.size && !(result & TRACE_LINK_STRING_ID)) {
+            *id = result;
+            return true;
+        }
+    }
+    *id = TRACE_LINK_STRING_ID | trace_intern(trace, str);
+    return true;
+}
+
+// Top level fields of an event that link it to other events.
+struct LinkFields {
+    Buf id;
+    Buf id2;
+    Buf bind_id;
+    Buf scope;
+    bool flow_in;
+    bool flow_out;
+};
+
+static void scan_link_fields(Buf raw, MemoryArena *arena, LinkFields *fields) {
+    JsonInput input;
+    json_input_init(&input, raw);
+    JsonToken token;
+    JsonError error;
+    if (!json_scan(arena, &input, &token, &error) ||
+        token.type != JsonToken_ObjectStart) {
+        return;
+    }
+
+    while (json_scan(arena, &input, &token, &error) &&
+           token.type == JsonToken_String) {
+        Buf key = token.value;
+        if (!json_scan(arena, &input, &token, &error) ||
+            token.type != JsonToken_Colon) {
+            return;
+        }
+        usize start = input.cursor;
+        if (!scan_json_value(arena, &input)) {
+            return;
+        }
+        while (start < input.cursor && raw.data[start] <= 32) {
+            start++;
+        }
+        Buf value = buf_slice(raw, start, input.cursor);
+        if (buf_equal(key, STR_LITERAL("id"))) {
+            fields->id = value;
+        } else if (buf_equal(key, STR_LITERAL("id2"))) {
+            fields->id2 = value;
+        } else if (buf_equal(key, STR_LITERAL("bind_id"))) {
+            fields->bind_id = value;
+        } else if (buf_equal(key, STR_LITERAL("scope"))) {
+            fields->scope = value;
+        } else if (buf_equal(key, STR_LITERAL("flow_in"))) {
+            fields->flow_in = buf_equal(value, STR_LITERAL("true"));
+        } else if (buf_equal(key, STR_LITERAL("flow_out"))) {
+            fields->flow_out = buf_equal(value, STR_LITERAL("true"));
+        }
+
+        if (!json_scan(arena, &input, &token, &error) ||
+            token.type != JsonToken_Comma) {
+            return;
+        }
+    }
+}
+
+// Adds the link points of the event at `index`. Flow and async events are
+// keyed by (cat, id, scope), slices with "flow_in" or "flow_out" by
+// "bind_id" (or "id") alone.
+static void push_link_points(Trace *trace, TraceEvent *event, usize index,
+                             Buf raw, MemoryArena *arena) {
+    LinkFields fields = {};
+    scan_link_fields(raw, arena, &fields);
+
+    TraceLinkPoint point = {.cat = event->cat,
+                            .pid = event->pid,
+                            .event = (u32)index};
+    Buf scope = unquote(fields.scope);
+    if (scope.data) {
+        point.scope = trace_intern(trace, scope);
+    }
+    Buf id = fields.id;
+    if (!id.data && fields.id2.data) {
+        id = find_field(fields.id2, STR_LITERAL("global"), arena);
+        if (!id.data) {
+            id = find_field(fields.id2, STR_LITERAL("local"), arena);
+            point.local = id.data != 0;
+        }
+    }
+
+    u8 kind;
+    if (get_link_kind(event->ph, &kind)) {
+        point.kind = kind;
+        if (parse_link_id(trace, id, &point.id)) {
+            trace_push_link_point(trace, &point);
+        }
+        return;
+    }
+
+    point.cat = 0;
+    if (fields.bind_id.data) {
+        id = fields.bind_id;
+    }
+    if (!parse_link_id(trace, id, &point.id)) {
+        return;
+    }
+    // A slice can end one flow and start the next one.
+    if (fields.flow_in) {
+        point.kind = TraceLink_FlowIn;
+        trace_push_link_point(trace, &point);
+    }
+    if (fields.flow_out) {
+        point.kind = TraceLink_FlowOut;
+        trace_push_link_point(trace, &point);
+    }
+}
+
+// Decodes the args of a process_name, thread_name, process_sort_index or
+// thread_sort_index event into the track info table.
+static void push_metadata(Trace *trace, TraceEvent *event, Buf args,
+                          MemoryArena *arena) {
+    Buf name = trace_get_string(trace, event->name);
+    bool is_process = buf_starts_with(name, STR_LITERAL("process_"));
+    if (!is_process && !buf_starts_with(name, STR_LITERAL("thread_"))) {
+        return;
+    }
+    name = buf_slice(name, is_process ? 8 : 7, name.size);
+    u32 tid = is_process ? TRACE_PROCESS_TID : event->tid;
+    if (buf_equal(name, STR_LITERAL("name"))) {
+        Buf value = unquote(find_field(args, STR_LITERAL("name"), arena));
+        if (value.data) {
+            u32 id = trace_intern(trace, value);
+            trace_get_track_info(trace, event->pid, tid)->name = id;
+        }
+    } else if (buf_equal(name, STR_LITERAL("sort_index"))) {
+        Buf value = find_field(args, STR_LITERAL("sort_index"), arena);
+        f64 sort_index;
+        if (json_parse_f64(value, &sort_index)) {
+            sort_index = max(min(sort_index, (f64)INT32_MAX), (f64)INT32_MIN);
+            TraceTrackInfo *info =
+                trace_get_track_info(trace, event->pid, tid);
+            info->has_sort_index = true;
+            info->sort_index = (i32)sort_index;
+        }
+    }
+}
+
+// Pushes the event that ends at buf[end - 1]. If it has fields that are not
+// stored in columns, its raw bytes are referenced in the source of the trace
+// when possible, or copied to the raw store.
+static void finish_event(JsonTraceParser *parser, Trace *trace, Buf buf,
+                         usize end) {
+    JsonTraceParserState_TraceEvent *state = &parser->trace_event;
+    if (state->has_raw) {
+        Buf bytes = buf_slice(buf, state->start, end);
+        if (state->raw_pending ||
+            !trace_get_source_offset(trace, bytes, &state->event.raw)) {
+            trace_append_pending_raw(trace, bytes);
+            state->event.raw =
+                trace_commit_pending_raw(trace, &state->event.raw_size);
+            ASSERT(state->event.raw_size == state->raw_pending + bytes.size);
+        } else {
+            state->event.raw_size = (u32)bytes.size;
+        }
+    } else if (state->raw_pending) {
+        trace_discard_pending_raw(trace);
+    }
+    usize index = trace_get_event_count(trace);
+    trace_push_event(trace, &state->event);
+
+    // Counter values, metadata, ids and flow bindings are only kept as raw
+    // bytes.
+    if (!state->has_raw) {
+        return;
+    }
+    u8 kind;
+    bool is_counter = state->event.ph == 'C';
+    bool is_metadata = state->event.ph == 'M';
+    bool is_link = state->has_link || get_link_kind(state->event.ph, &kind);
+    if (is_counter || is_metadata || is_link) {
+        MemoryArena *scratch = &parser->scratch;
+        Buf raw = state->raw_pending
+                      ? trace_get_event_raw(trace, index, scratch)
+                      : buf_slice(buf, state->start, end);
+        if (is_counter || is_metadata) {
+            Buf args = find_field(raw, STR_LITERAL("args"), scratch);
+            if (is_counter) {
+                push_counter_samples(trace, &state->event, args, scratch);
+            } else {
+                push_metadata(trace, &state->event, args, scratch);
+            }
+        }
+        if (is_link) {
+            push_link_points(trace, &state->event, index, raw, scratch);
+        }
+        memory_arena_clear(scratch);
+    }
+}
+
+// Parses a TraceEvent in a single pass, extracting the fields while scanning.
+// Only the token that straddles two inputs is saved, never the whole event.
+static JsonTraceResult on_state_trace_event(JsonTraceParser *parser, Buf buf,
+                                            usize *cursor, Trace *trace) {
+    JsonTraceParserState_TraceEvent *state = &parser->trace_event;
+    while (true) {
+        switch (state->state) {
+            case Event_Key: {
+                if (!skip_whitespace(parser, buf, cursor)) {
+                    return JsonTraceResult_NeedMoreInput;
+                }
+                u8 ch = buf.data[(*cursor)++];
+                if (ch == '"') {
+                    parser->buf_cursor = 0;
+                    state->state = Event_KeyString;
+                } else if (ch == '}') {
+                    finish_event(parser, trace, buf, *cursor);
+                    parser->state = State_ArrayFormat_AfterTraceEvent;
+                    return JsonTraceResult_Continue;
+                } else {
+                    return set_error(parser,
+                                     "Invalid JSON Trace: expected '\"' or "
+                                     "'}' but got '%c'",
+                                     ch);
+                }
+            } break;
+
+            case Event_KeyString: {
+                Buf key;
+                if (!scan_string(parser, buf, cursor, true, &key)) {
+                    return JsonTraceResult_NeedMoreInput;
+                }
+                state->key = match_trace_event_key(key);
+                state->state = Event_Colon;
+            } break;
+
+            case Event_Colon: {
+                if (!skip_whitespace(parser, buf, cursor)) {
+                    return JsonTraceResult_NeedMoreInput;
+                }
+                u8 ch = buf.data[(*cursor)++];
+                if (ch != ':') {
+                    return set_error(
+                        parser, "Invalid JSON Trace: expected ':' but got '%c'",
+                        ch);
+                }
+                state->state = Event_Value;
+            } break;
+
+            case Event_Value: {
+                if (!skip_whitespace(parser, buf, cursor)) {
+                    return JsonTraceResult_NeedMoreInput;
+                }
+                u8 ch = buf.data[*cursor];
+                parser->buf_cursor = 0;
+                if (is_skipped_key(state->key)) {
+                    state->has_raw = true;
+                    state->has_link |= state->key == Key_BindId ||
+                                       state->key == Key_FlowIn ||
+                                       state->key == Key_FlowOut;
+                    switch (ch) {
+                        case '"': {
+                            (*cursor)++;
+                            state->state = Event_SkipString;
+                        } break;
+
+                        case '{':
+                        case '[': {
+                            (*cursor)++;
+                            state->depth = 1;
+                            state->state = Event_SkipContainer;
+                        } break;
+
+                        case '-':
+                        case '0' ... '9':
+                        case 't':
+                        case 'f':
+                        case 'n': {
+                            state->state = Event_SkipScalar;
+                        } break;
+
+                        default: {
+                            return set_error(parser,
+                                             "Unexpected character %c", ch);
+                        } break;
+                    }
+                } else if (is_string_key(state->key)) {
+                    if (ch != '"') {
+                        return set_error(parser, "Expected '\"', but got '%c'",
+                                         ch);
+                    }
+                    (*cursor)++;
+                    state->state = Event_StringValue;
+                } else {
+                    state->state = Event_NumberValue;
+                }
+            } break;
+
+            case Event_StringValue: {
+                Buf str;
+                if (!scan_string(parser, buf, cursor, true, &str)) {
+                    return JsonTraceResult_NeedMoreInput;
+                }
+                if (handle_string_value(parser, trace, str) ==
+                    JsonTraceResult_Error) {
+                    return JsonTraceResult_Error;
+                }
+                state->state = Event_AfterValue;
+            } break;
+
+            case Event_NumberValue: {
+                usize start = *cursor;
+                while (*cursor < buf.size &&
+                       is_number_char(buf.data[*cursor])) {
+                    (*cursor)++;
+                }
+                if (*cursor == buf.size) {
+                    save_input(parser, &parser->buf_cursor,
+                               buf_slice(buf, start, *cursor));
+                    return JsonTraceResult_NeedMoreInput;
+                }
+                Buf str = finish_token(parser, buf, start, *cursor);
+                if (handle_number_value(parser, str) == JsonTraceResult_Error) {
+                    return JsonTraceResult_Error;
+                }
+                state->state = Event_AfterValue;
+            } break;
+
+            case Event_SkipString: {
+                if (!scan_string(parser, buf, cursor, false, 0)) {
+                    return JsonTraceResult_NeedMoreInput;
+                }
+                state->state = Event_AfterValue;
+            } break;
+
+            case Event_SkipScalar: {
+                if (!skip_scalar(buf, cursor)) {
+                    return JsonTraceResult_NeedMoreInput;
+                }
+                state->state = Event_AfterValue;
+            } break;
+
+            case Event_SkipContainer: {
+                if (!skip_container(parser, buf, cursor)) {
+                    return JsonTraceResult_NeedMoreInput;
+                }
+                state->state = Event_AfterValue;
+            } break;
+
+            case Event_AfterValue: {
+                if (!skip_whitespace(parser, buf, cursor)) {
+                    return JsonTraceResult_NeedMoreInput;
+                }
+                u8 ch = buf.data[(*cursor)++];
+                if (ch == ',') {
+                    state->state = Event_Key;
+                } else if (ch == '}') {
+                    finish_event(parser, trace, buf, *cursor);
+                    parser->state = State_ArrayFormat_AfterTraceEvent;
+                    return JsonTraceResult_Continue;
+                } else {
+                    return set_error(parser,
+                                     "Invalid JSON Trace: expected ',' or "
+                                     "'}' but got '%c'",
+                                     ch);
+                }
+            } break;
+
+            default: {
+                UNREACHABLE;
+            } break;
+        }
+    }
+}
+
+static JsonTraceResult on_state_array_format(JsonTraceParser *parser, Buf buf,
+                                             usize *cursor) {
+    if (!skip_whitespace(parser, buf, cursor)) {
+        return JsonTraceResult_NeedMoreInput;
+    }
+
+    u8 ch = buf.data[*cursor];
+    if (ch != '{') {
+        return set_error(parser,
+                         "Invalid JSON Trace: expected '{' but got "
+                         "'%c'",
+                         ch);
+    }
+    parser->state = State_TraceEvent;
+    parser->trace_event = {.state = Event_Key, .start = *cursor};
+    (*cursor) += 1;
+
+    return JsonTraceResult_Continue;
+}
+
+static JsonTraceResult on_state_array_format_after_trace_event(
+    JsonTraceParser *parser, Buf buf, usize *cursor) {
+    if (!skip_whitespace(parser, buf, cursor)) {
+        return JsonTraceResult_NeedMoreInput;
+    }
+
+    u8 ch = buf.data[*cursor];
+    if (ch == ',') {
+        (*cursor)++;
+        parser->state = State_ArrayFormat;
+        parser->buf_cursor = 0;
+    } else if (ch == ']') {
+        (*cursor)++;
+        if (parser->has_object_format) {
+            parser->state = State_ObjectFormat_AfterValue;
+        } else {
+            parser->state = State_Done;
+            return JsonTraceResult_Done;
+        }
+    } else {
+        return set_error(parser,
+                         "Invalid JSON Trace: expected ',' or ']' but got "
+                         "'%c'",
+                         ch);
+    }
+
+    return JsonTraceResult_Continue;
+}
+
+static JsonTraceResult on_state_skip_char(JsonTraceParser *parser, Buf buf,
+                                          usize *cursor) {
+    if (!skip_whitespace(parser, buf, cursor)) {
+        return JsonTraceResult_NeedMoreInput;
+    }
+    u8 ch = buf.data[*cursor];
+    if (ch != parser->skip_char.target) {
+        return set_error(parser,
                          "Invalid JSON Trace: expected '%c' but got '%c'",
                          parser->skip_char.target, ch);
     }
@@ -933,8 +1411,7 @@ static JsonTraceResult on_state_skip_char(JsonTraceParser *parser, Buf buf,
     return JsonTraceResult_Continue;
 }
 
-JsonTraceResult json_trace_parser_parse(JsonTraceParser *parser, Trace *trace,
-                                        Buf buf) {
+static JsonTraceResult parse(JsonTraceParser *parser, Trace *trace, Buf buf) {
     usize cursor = 0;
     while (true) {
         switch (parser->state) {
@@ -987,7 +1464,15 @@ JsonTraceResult json_trace_parser_parse(JsonTraceParser *parser, Trace *trace,
 
             case State_ArrayFormat: {
                 JsonTraceResult result =
-                    on_state_array_format(parser, buf, &cursor, trace);
+                    on_state_array_format(parser, buf, &cursor);
+                if (result != JsonTraceResult_Continue) {
+                    return result;
+                }
+            } break;
+
+            case State_TraceEvent: {
+                JsonTraceResult result =
+                    on_state_trace_event(parser, buf, &cursor, trace);
                 if (result != JsonTraceResult_Continue) {
                     return result;
                 }
@@ -1017,7 +1502,288 @@ JsonTraceResult json_trace_parser_parse(JsonTraceParser *parser, Trace *trace,
     }
 }
 
+JsonTraceResult json_trace_parser_parse(JsonTraceParser *parser, Trace *trace,
+                                        Buf buf) {
+    // Nothing points into the buffers between inputs.
+    memory_reserve_trim(&parser->buf_memory);
+    memory_reserve_trim(&parser->stack_memory);
+    json_index_begin_input(&parser->index);
+    JsonTraceResult result = parse(parser, trace, buf);
+    if (result == JsonTraceResult_NeedMoreInput) {
+        json_index_end_input(&parser->index, buf);
+
+        // The rest of the input goes away, save the part of the event that
+        // is in it in case the event needs its raw bytes.
+        if (parser->state == State_TraceEvent) {
+            JsonTraceParserState_TraceEvent *state = &parser->trace_event;
+            Buf bytes = buf_slice(buf, state->start, buf.size);
+            trace_append_pending_raw(trace, bytes);
+            state->start = 0;
+            state->raw_pending += bytes.size;
+        }
+    } else if (result == JsonTraceResult_Done) {
+        // Close 'B' events that were never ended.
+        trace_finish(trace);
+    }
+    return result;
+}
+
 char *json_trace_parser_get_error(JsonTraceParser *parser) {
     ASSERT(parser->state == State_Error);
     return (char *)parser->buf.data;
 }
+
+// Don't bother splitting inputs into ranges smaller than this.
+static const usize MIN_PARALLEL_RANGE_SIZE = 1024 * 1024;
+
+static bool is_json_whitespace(u8 ch) {
+    return ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t';
+}
+
+static usize skip_json_whitespace(Buf input, usize pos) {
+    while (pos < input.size && is_json_whitespace(input.data[pos])) {
+        pos++;
+    }
+    return pos;
+}
+
+// Guesses the position right after a ',' that separates two trace events, at
+// or after `pos`. Returns input.size if there is none.
+//
+// Whether `pos` is inside a string is unknown, so it is speculated from the
+// first unescaped quote: a quote followed by one of ":,}]" most likely closes a
+// string. From there strings are tracked exactly, and the first "}, {" outside
+// of strings is taken as the boundary. The guess can be wrong (e.g. for arrays
+// of objects inside args), which the caller must detect.
+static usize find_event_boundary(Buf input, usize pos) {
+    usize quote = pos;
+    while (true) {
+        u8 *found = (u8 *)memchr(input.data + quote, '"', input.size - quote);
+        if (!found) {
+            return input.size;
+        }
+        quote = found - input.data;
+        usize num_backslashes = 0;
+        while (num_backslashes < quote &&
+               input.data[quote - num_backslashes - 1] == '\\') {
+            num_backslashes++;
+        }
+        if (num_backslashes % 2 == 0) {
+            break;
+        }
+        quote++;
+    }
+
+    usize next = skip_json_whitespace(input, quote + 1);
+    bool in_string = true;
+    if (next < input.size) {
+        u8 ch = input.data[next];
+        in_string = !(ch == ':' || ch == ',' || ch == '}' || ch == ']');
+    }
+
+    bool escaped = false;
+    for (usize i = quote + 1; i < input.size; ++i) {
+        u8 ch = input.data[i];
+        if (in_string) {
+            if (escaped) {
+                escaped = false;
+            } else if (ch == '\\') {
+                escaped = true;
+            } else if (ch == '"') {
+                in_string = false;
+            }
+        } else if (ch == '"') {
+            in_string = true;
+        } else if (ch == '}') {
+            usize comma = skip_json_whitespace(input, i + 1);
+            if (comma < input.size && input.data[comma] == ',') {
+                usize open = skip_json_whitespace(input, comma + 1);
+                if (open < input.size && input.data[open] == '{') {
+                    return comma + 1;
+                }
+            }
+        }
+    }
+    return input.size;
+}
+
+static bool is_before_trace_event(JsonTraceParser *parser) {
+    return parser->state == State_ArrayFormat;
+}
+
+struct ParallelParse {
+    Buf input;
+    // ranges + 1 boundaries, range i is input[boundaries[i], boundaries[i+1]).
+    usize *boundaries;
+    JsonTraceParser *parsers;
+    Trace **traces;
+    JsonTraceResult *results;
+};
+
+static void parse_range(void *ctx, usize index) {
+    ParallelParse *work = (ParallelParse *)ctx;
+    Buf range = buf_slice(work->input, work->boundaries[index],
+                          work->boundaries[index + 1]);
+    work->results[index] = json_trace_parser_parse(
+        &work->parsers[index], work->traces[index], range);
+}
+
+JsonTraceResult json_trace_parser_parse_parallel(JsonTraceParser *parser,
+                                                 Trace *trace, Buf input,
+                                                 usize num_threads) {
+    ASSERT(parser->state == State_Init);
+
+    // Parse sequentially until the parser is right before a trace event, so
+    // that everything before the first range is known to be correct.
+    usize start = 0;
+    while (!is_before_trace_event(parser)) {
+        if (start == input.size) {
+            return JsonTraceResult_NeedMoreInput;
+        }
+        usize end;
+        if (parser->state == State_TraceEvent) {
+            // Likely the end of the current event.
+            u8 *found = (u8 *)memchr(input.data + start, '}',
+                                     input.size - start);
+            end = found ? found - input.data + 1 : input.size;
+        } else if (parser->state == State_ArrayFormat_AfterTraceEvent) {
+            end = start + 1;
+        } else {
+            end = min(start + INITIAL_BUF_SIZE, input.size);
+        }
+        Buf part = buf_slice(input, start, end);
+        JsonTraceResult result = json_trace_parser_parse(parser, trace, part);
+        if (result != JsonTraceResult_NeedMoreInput) {
+            return result;
+        }
+        start = end;
+    }
+
+    usize num_ranges = min(num_threads,
+                           (input.size - start) / MIN_PARALLEL_RANGE_SIZE);
+    if (num_ranges <= 1) {
+        return json_trace_parser_parse(parser, trace,
+                                       buf_slice(input, start, input.size));
+    }
+
+    ParallelParse work = {.input = input};
+    work.boundaries =
+        (usize *)memory_alloc((num_ranges + 1) * sizeof(usize));
+    work.parsers = (JsonTraceParser *)memory_alloc(num_ranges *
+                                                   sizeof(JsonTraceParser));
+    work.traces = (Trace **)memory_alloc(num_ranges * sizeof(Trace *));
+    Trace *range_traces = (Trace *)memory_alloc(num_ranges * sizeof(Trace));
+    work.results = (JsonTraceResult *)memory_alloc(num_ranges *
+                                                   sizeof(JsonTraceResult));
+    MemoryArena *arenas =
+        (MemoryArena *)memory_alloc(num_ranges * sizeof(MemoryArena));
+    ASSERT(work.boundaries && work.parsers && work.traces && range_traces &&
+           work.results && arenas);
+
+    work.boundaries[0] = start;
+    work.boundaries[num_ranges] = input.size;
+    for (usize i = 1; i < num_ranges; ++i) {
+        usize target = start + (input.size - start) / num_ranges * i;
+        work.boundaries[i] = max(find_event_boundary(input, target),
+                                 work.boundaries[i - 1]);
+    }
+
+    // The first range continues with the caller's parser and trace, the
+    // others start from a fresh state inside the traceEvents array. The trace
+    // isn't copied because its intern table points to its arena.
+    work.parsers[0] = *parser;
+    work.traces[0] = trace;
+    for (usize i = 1; i < num_ranges; ++i) {
+        memory_arena_init(&arenas[i]);
+        json_trace_parser_init(&work.parsers[i], &arenas[i]);
+        work.parsers[i].state = State_ArrayFormat;
+        work.parsers[i].has_object_format = parser->has_object_format;
+        Trace *range_trace = &range_traces[i];
+        trace_init(range_trace);
+        range_trace->strings.source = trace->strings.source;
+        range_trace->raw.compress = trace->raw.compress;
+        // 'B' and 'E' events can be in different ranges, so slices are only
+        // paired within the range and the rest is fixed up when appending.
+        range_trace->is_range = true;
+        work.traces[i] = range_trace;
+    }
+
+    parallel_for(num_ranges, num_threads, parse_range, &work);
+
+    // A range is only used if the parser of the previous ranges stopped right
+    // before a trace event at its start, which proves that the guessed
+    // boundary was right. Otherwise the previous parser continues over the
+    // range, so the result is always the same as parsing sequentially.
+    Trace **used = (Trace **)memory_alloc(num_ranges * sizeof(Trace *));
+    ASSERT(used);
+    usize current = 0;
+    usize num_used = 0;
+    JsonTraceResult result = work.results[0];
+    for (usize i = 1; i < num_ranges; ++i) {
+        if (result != JsonTraceResult_NeedMoreInput) {
+            break;
+        }
+        if (is_before_trace_event(&work.parsers[current])) {
+            if (current != 0) {
+                used[num_used++] = work.traces[current];
+            }
+            current = i;
+            result = work.results[i];
+        } else {
+            Buf range = buf_slice(input, work.boundaries[i],
+                                  work.boundaries[i + 1]);
+            result = json_trace_parser_parse(&work.parsers[current],
+                                             work.traces[current], range);
+        }
+    }
+    if (current != 0) {
+        used[num_used++] = work.traces[current];
+    }
+    trace_append_ranges(trace, used, num_used, num_threads);
+    memory_free(used);
+
+    *parser = work.parsers[0];
+    if (current != 0) {
+        if (result == JsonTraceResult_Error) {
+            set_error(parser, "%s",
+                      json_trace_parser_get_error(&work.parsers[current]));
+        } else if (result == JsonTraceResult_Done) {
+            parser->state = State_Done;
+        }
+    }
+    if (result == JsonTraceResult_Done) {
+        trace_finish(trace);
+    }
+
+    for (usize i = 1; i < num_ranges; ++i) {
+        trace_deinit(&range_traces[i]);
+        json_trace_parser_deinit(&work.parsers[i]);
+        memory_arena_deinit(&arenas[i]);
+    }
+    memory_free(arenas);
+    memory_free(work.results);
+    memory_free(range_traces);
+    memory_free(work.traces);
+    memory_free(work.parsers);
+    memory_free(work.boundaries);
+
+    return result;
+}
+
+JsonTraceResult json_trace_parser_parse_file(JsonTraceParser *parser,
+                                             Trace *trace, const char *path,
+                                             usize num_threads) {
+    MappedFile file;
+    if (!mapped_file_open(&file, path)) {
+        return set_error(parser, "Failed to open %s: %s", path,
+                         strerror(errno));
+    }
+    trace_set_file(trace, file);
+    return json_trace_parser_parse_parallel(parser, trace, trace->file.data,
+                                            num_threads);
+}
+
+Buf json_trace_get_event_field(Trace *trace, usize index, Buf key,
+                               MemoryArena *arena) {
+    return find_field(trace_get_event_raw(trace, index, arena), key, arena);
+}
@@ -2,12 +2,27 @@
 
 #include "src/buf.h"
 #include "src/defs.h"
+#include "src/json_index.h"
 #include "src/memory.h"
 #include "src/trace.h"
 
-struct JsonTraceParserState_ArrayFormat {
-    u8 last_char;
-    bool is_in_str;
+struct JsonTraceParserState_TraceEvent {
+    u8 state;
+    // The key whose value is being parsed.
+    u8 key;
+    // True if a field was skipped, so the raw bytes of the event are kept.
+    bool has_raw;
+    // Number of bytes of the event from previous inputs. They are saved to
+    // the raw store of the trace once, and each input extends them.
+    usize raw_pending;
+    // True if the event has "bind_id", "flow_in" or "flow_out".
+    bool has_link;
+    // Nesting depth of the value being skipped.
+    u32 depth;
+    // Offset of the '{' of the event in the current input, 0 if it started in
+    // a previous one.
+    usize start;
+    TraceEvent event;
 };
 
 struct JsonTraceParserState_SkipChar {
@@ -22,14 +37,21 @@ struct JsonTraceParserState_UnknownKey {
 
 struct JsonTraceParser {
     MemoryArena *arena;
+    // Temporaries of one event, cleared after each event.
+    MemoryArena scratch;
+    // `buf` and `stack` are the committed memory of these, which grows in
+    // place.
+    MemoryReserve buf_memory;
+    MemoryReserve stack_memory;
     Buf buf;
     usize buf_cursor;
     Buf stack;
     usize stack_cursor;
     bool has_object_format;
+    JsonIndex index;
     u8 state;
     union {
-        JsonTraceParserState_ArrayFormat array_format;
+        JsonTraceParserState_TraceEvent trace_event;
         JsonTraceParserState_SkipChar skip_char;
         JsonTraceParserState_UnknownKey unknown_key;
     };
@@ -49,4 +71,24 @@ void json_trace_parser_deinit(JsonTraceParser *parser);
 
 JsonTraceResult json_trace_parser_parse(JsonTraceParser *parser, Trace *trace,
                                         Buf buf);
+// Parses the whole trace in `input` with up to `num_threads` threads. The
+// traceEvents array is split into ranges that are parsed into separate traces
+// and appended to `trace` in order, so the result is the same as parsing
+// sequentially. The parser must be freshly initialized, and can't be fed more
+// input afterwards.
+JsonTraceResult json_trace_parser_parse_parallel(JsonTraceParser *parser,
+                                                 Trace *trace, Buf input,
+                                                 usize num_threads);
+// Maps the file at `path` and parses it in place like
+// json_trace_parser_parse_parallel. The mapping is owned by `trace`, and
+// strings point into it instead of being copied.
+JsonTraceResult json_trace_parser_parse_file(JsonTraceParser *parser,
+                                             Trace *trace, const char *path,
+                                             usize num_threads);
+// Decodes the raw bytes of the event at `index` and returns the JSON value of
+// its field `key` (e.g. "args"), or an empty Buf if it has no such field.
+// Memory needed for decoding is allocated from `arena`.
+Buf json_trace_get_event_field(Trace *trace, usize index, Buf key,
+                               MemoryArena *arena);
+
 char *json_trace_parser_get_error(JsonTraceParser *parser);
@@ -0,0 +1,899 @@
+#include "src/json_trace.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "src/buf.h"
+
+// Parses `input` by feeding it `chunk_size` bytes at a time.
+static JsonTraceResult parse_in_chunks(Trace *trace, Buf input,
+                                       usize chunk_size) {
+    MemoryArena arena;
+    memory_arena_init(&arena);
+    JsonTraceParser parser;
+    json_trace_parser_init(&parser, &arena);
+
+    JsonTraceResult result = JsonTraceResult_NeedMoreInput;
+    usize cursor = 0;
+    while (cursor < input.size && result == JsonTraceResult_NeedMoreInput) {
+        usize end = min(cursor + chunk_size, input.size);
+        result = json_trace_parser_parse(&parser, trace,
+                                         buf_slice(input, cursor, end));
+        cursor = end;
+    }
+
+    json_trace_parser_deinit(&parser);
+    memory_arena_deinit(&arena);
+    return result;
+}
+
+static const char *TRACE = R"({"traceEvents": [
+  {"name": "a", "cat": "c1", "ph": "X", "ts": 10.5, "dur": 5e-3, "pid": 1,
+   "tid": 2},
+  {"args": {"x": [1, {"y": "}"}], "s": "q\"}\\"}, "name": "b\"}",
+   "ph": "B", "ts": 12, "pid": 1, "tid": 3, "flag": true, "none": null},
+  { "tid" : 3 , "ph" : "E" , "ts" : 20 , "pid" : 1 , "name" : "" }
+], "displayTimeUnit": "ns", "otherData": {"version": "1"}}
+)";
+
+static void check_trace(Trace *trace) {
+    ASSERT_EQ(trace_get_event_count(trace), 3);
+
+    TraceEvent a = trace_get_event(trace, 0);
+    ASSERT_TRUE(buf_equal(trace_get_string(trace, a.name), STR_LITERAL("a")));
+    ASSERT_TRUE(buf_equal(trace_get_string(trace, a.cat), STR_LITERAL("c1")));
+    ASSERT_EQ(a.ph, 'X');
+    ASSERT_EQ(a.ts, 10500);
+    ASSERT_EQ(a.dur, 5);
+    ASSERT_EQ(a.pid, 1);
+    ASSERT_EQ(a.tid, 2);
+
+    TraceEvent b = trace_get_event(trace, 1);
+    ASSERT_TRUE(
+        buf_equal(trace_get_string(trace, b.name), STR_LITERAL("b\\\"}")));
+    ASSERT_EQ(b.cat, 0);
+    ASSERT_EQ(b.ph, 'B');
+    ASSERT_EQ(b.ts, 12000);
+    ASSERT_EQ(b.tid, 3);
+
+    TraceEvent e = trace_get_event(trace, 2);
+    ASSERT_EQ(e.name, 0);
+    ASSERT_EQ(e.ph, 'E');
+    ASSERT_EQ(e.ts, 20000);
+    ASSERT_EQ(e.pid, 1);
+    ASSERT_EQ(e.tid, 3);
+}
+
+TEST(JsonTraceParserTest, WholeInput) {
+    Trace trace;
+    trace_init(&trace);
+    Buf input = {.data = (u8 *)TRACE, .size = strlen(TRACE)};
+    ASSERT_EQ(parse_in_chunks(&trace, input, input.size),
+              JsonTraceResult_Done);
+    check_trace(&trace);
+    trace_deinit(&trace);
+}
+
+TEST(JsonTraceParserTest, SplitAnywhere) {
+    Buf input = {.data = (u8 *)TRACE, .size = strlen(TRACE)};
+    for (usize chunk_size = 1; chunk_size < 16; ++chunk_size) {
+        Trace trace;
+        trace_init(&trace);
+        ASSERT_EQ(parse_in_chunks(&trace, input, chunk_size),
+                  JsonTraceResult_Done)
+            << "chunk_size = " << chunk_size;
+        check_trace(&trace);
+        trace_deinit(&trace);
+    }
+}
+
+static void check_raw(Trace *trace) {
+    MemoryArena arena;
+    memory_arena_init(&arena);
+
+    // Events without other fields don't keep their bytes.
+    ASSERT_EQ(trace_get_event(trace, 0).raw_size, 0);
+    ASSERT_EQ(trace_get_event(trace, 2).raw_size, 0);
+    ASSERT_EQ(json_trace_get_event_field(trace, 0, STR_LITERAL("args"), &arena)
+                  .size,
+              0);
+
+    Buf args =
+        json_trace_get_event_field(trace, 1, STR_LITERAL("args"), &arena);
+    ASSERT_TRUE(buf_equal(
+        args, STR_LITERAL(R"({"x": [1, {"y": "}"}], "s": "q\"}\\"})")));
+    Buf flag =
+        json_trace_get_event_field(trace, 1, STR_LITERAL("flag"), &arena);
+    ASSERT_TRUE(buf_equal(flag, STR_LITERAL("true")));
+    Buf name =
+        json_trace_get_event_field(trace, 1, STR_LITERAL("name"), &arena);
+    ASSERT_TRUE(buf_equal(name, STR_LITERAL(R"("b\"}")")));
+    ASSERT_EQ(json_trace_get_event_field(trace, 1, STR_LITERAL("x"), &arena)
+                  .size,
+              0);
+
+    memory_arena_deinit(&arena);
+}
+
+TEST(JsonTraceParserTest, RawSplitAnywhere) {
+    Buf input = {.data = (u8 *)TRACE, .size = strlen(TRACE)};
+    for (usize chunk_size = 1; chunk_size < 16; ++chunk_size) {
+        for (int compress = 0; compress < 2; ++compress) {
+            Trace trace;
+            trace_init(&trace);
+            trace.raw.compress = compress;
+            ASSERT_EQ(parse_in_chunks(&trace, input, chunk_size),
+                      JsonTraceResult_Done);
+            check_raw(&trace);
+            trace_deinit(&trace);
+        }
+    }
+}
+
+TEST(JsonTraceParserTest, RawSpansManyInputs) {
+    std::string event = R"({"name": "a", "ph": "X", "ts": 1, "dur": 2, )"
+                        R"("args": {"s": ")";
+    event.append(100000, 'x');
+    event += R"("}})";
+    std::string input = "[" + event + "]";
+
+    Trace trace;
+    trace_init(&trace);
+    ASSERT_EQ(parse_in_chunks(&trace, {(u8 *)input.data(), input.size()}, 97),
+              JsonTraceResult_Done);
+    ASSERT_EQ(trace_get_event(&trace, 0).raw_size, event.size());
+    // The bytes of the event are stored once however many inputs it spans.
+    ASSERT_EQ(trace.raw.num_blocks, 0);
+    ASSERT_EQ(trace.raw.current_size, event.size());
+    trace_deinit(&trace);
+}
+
+TEST(JsonTraceParserTest, RawInSource) {
+    Trace trace;
+    trace_init(&trace);
+    Buf input = {.data = (u8 *)TRACE, .size = strlen(TRACE)};
+    trace.strings.source = input;
+    ASSERT_EQ(parse_in_chunks(&trace, input, input.size),
+              JsonTraceResult_Done);
+    ASSERT_FALSE(trace_get_event(&trace, 1).raw & TRACE_RAW_IN_STORE);
+    ASSERT_EQ(trace.raw.current_size, 0);
+    check_raw(&trace);
+    trace_deinit(&trace);
+}
+
+TEST(JsonTraceParserTest, ArrayFormat) {
+    Trace trace;
+    trace_init(&trace);
+    Buf input = STR_LITERAL(R"([{"ph": "i", "ts": 1}, {"ph": "i", "ts": 2}])");
+    ASSERT_EQ(parse_in_chunks(&trace, input, 1), JsonTraceResult_Done);
+    ASSERT_EQ(trace_get_event_count(&trace), 2);
+    ASSERT_EQ(trace_get_event(&trace, 1).ts, 2000);
+    trace_deinit(&trace);
+}
+
+TEST(JsonTraceParserTest, InvalidNumber) {
+    Trace trace;
+    trace_init(&trace);
+    Buf input = STR_LITERAL(R"([{"ph": "i", "pid": "1"}])");
+    ASSERT_EQ(parse_in_chunks(&trace, input, input.size),
+              JsonTraceResult_Error);
+    trace_deinit(&trace);
+
+    // Times are unsigned.
+    const char *negative_times[] = {
+        R"([{"ph": "i", "ts": -1}])",
+        R"([{"ph": "X", "ts": 1, "dur": -0.5}])",
+        R"([{"ph": "X", "ts": 1, "dur": 1, "tdur": -2}])",
+    };
+    for (const char *str : negative_times) {
+        MemoryArena arena;
+        memory_arena_init(&arena);
+        JsonTraceParser parser;
+        json_trace_parser_init(&parser, &arena);
+        trace_init(&trace);
+        ASSERT_EQ(json_trace_parser_parse(&parser, &trace,
+                                          {(u8 *)str, strlen(str)}),
+                  JsonTraceResult_Error)
+            << str;
+        ASSERT_NE(strstr(json_trace_parser_get_error(&parser), "non-negative"),
+                  nullptr);
+        trace_deinit(&trace);
+        json_trace_parser_deinit(&parser);
+        memory_arena_deinit(&arena);
+    }
+}
+
+TEST(JsonTraceParserTest, Keys) {
+    Trace trace;
+    trace_init(&trace);
+    Buf input = STR_LITERAL(
+        R"([{"nam": 1, "names": "x", "name": "a", "cats": [1], "cat": "c",)"
+        R"( "ph": "X", "phase": "B", "ts": 1, "tss": 2, "dur": 3,)"
+        R"( "duration": 4, "tdur": 5, "tts": 6, "pid": 7, "pids": [8],)"
+        R"( "tid": 9, "id": "0x1", "id2": {"local": "0x2"}, "bind_id": "b",)"
+        R"( "s": "g", "args": {"name": "b"}, "flow_in": true,)"
+        R"( "flow_out": false, "flow_ou": null, "": 10}])");
+    ASSERT_EQ(parse_in_chunks(&trace, input, input.size),
+              JsonTraceResult_Done);
+    ASSERT_EQ(trace_get_event_count(&trace), 1);
+    TraceEvent event = trace_get_event(&trace, 0);
+    ASSERT_TRUE(
+        buf_equal(trace_get_string(&trace, event.name), STR_LITERAL("a")));
+    ASSERT_TRUE(
+        buf_equal(trace_get_string(&trace, event.cat), STR_LITERAL("c")));
+    ASSERT_EQ(event.ph, 'X');
+    ASSERT_EQ(event.ts, 1000);
+    ASSERT_EQ(event.dur, 3000);
+    ASSERT_EQ(event.tdur, 5000);
+    ASSERT_EQ(event.pid, 7);
+    ASSERT_EQ(event.tid, 9);
+    trace_deinit(&trace);
+}
+
+// Generates a trace big enough to be split into several ranges, with strings
+// and args that look like event boundaries.
+static std::string generate_trace(usize num_events) {
+    std::string trace = "{\"otherData\": {\"a\": [{}, {}]}, \"traceEvents\": [";
+    char buf[320];
+    char counter_args[64];
+    char link[64];
+    for (usize i = 0; i < num_events; ++i) {
+        const char *args;
+        switch (i % 4) {
+            case 0:
+                args = R"({"list": [{"a": 1}, {"b": "}, {\""}]})";
+                break;
+            case 1:
+                args = R"({"s": "\"}, {\"name\": \"x\"}, {"})";
+                break;
+            case 2:
+                snprintf(counter_args, sizeof(counter_args),
+                         R"({"v": %zu, "w": -1.5})", i % 9);
+                args = counter_args;
+                break;
+            default:
+                args = "{}";
+                break;
+        }
+        // 'B' and 'E' events pair up across threads, and across ranges of the
+        // parallel parser. Every fifth event is a counter.
+        const char *ph = i % 5 == 1   ? "B"
+                         : i % 5 == 3 ? "E"
+                         : i % 5 == 4 ? "C"
+                                      : "X";
+        // Flows between slices, which may cross ranges too.
+        link[0] = 0;
+        if (i % 4 == 3) {
+            snprintf(link, sizeof(link), R"(, "bind_id": %zu, "%s": true)",
+                     i / 8, (i / 4) % 2 ? "flow_in" : "flow_out");
+        }
+        int size = snprintf(buf, sizeof(buf),
+                            R"(%s{"name": "e%zu", "cat": "c%zu", "ph": "%s",)"
+                            R"( "ts": %zu, "dur": 1, "pid": 1, "tid": %zu,)"
+                            R"( "args": %s%s})",
+                            i ? ",\n" : "", i % 100, i % 3, ph, i, i % 7,
+                            args, link);
+        // Thread names and sort indexes, renamed over time.
+        if (i % 1000 == 500) {
+            size = snprintf(buf, sizeof(buf),
+                            R"(,
+{"name": "thread_name", "ph": "M",)"
+                            R"( "pid": 1, "tid": %zu,)"
+                            R"( "args": {"name": "t%zu"}})",
+                            i % 7, i);
+        } else if (i % 1000 == 0) {
+            size = snprintf(buf, sizeof(buf),
+                            R"(%s{"name": "thread_sort_index", "ph": "M",)"
+                            R"( "pid": 1, "tid": %zu,)"
+                            R"( "args": {"sort_index": %d}})",
+                            i ? ",\n" : "", i % 7, 3 - (int)(i / 1000));
+        }
+        trace.append(buf, size);
+    }
+    trace += "], \"displayTimeUnit\": \"ns\"}";
+    return trace;
+}
+
+// Checks that the raw bytes of every `step`th event are the same.
+static void check_raw_matches(Trace *trace, Trace *expected, usize step = 1) {
+    for (usize i = 0; i < trace_get_event_count(trace); i += step) {
+        MemoryArena arena;
+        memory_arena_init(&arena);
+        Buf a = trace_get_event_raw(trace, i, &arena);
+        Buf b = trace_get_event_raw(expected, i, &arena);
+        ASSERT_TRUE(buf_equal(a, b)) << "at " << i;
+        memory_arena_deinit(&arena);
+    }
+}
+
+static const char *COUNTER_TRACE = R"([
+  {"name": "mem", "ph": "C", "ts": 1, "pid": 1,
+   "args": {"heap": 10, "stack": 2.5}},
+  {"name": "mem", "ph": "C", "ts": 2, "pid": 2, "args": {"heap": 7}},
+  {"name": "mem", "ph": "C", "ts": 3, "pid": 1,
+   "args": {"s": "1", "o": {"heap": 1}, "heap": -1e1}},
+  {"name": "mem", "ph": "X", "ts": 4, "pid": 1, "args": {"heap": 99}}
+])";
+
+static void check_counter(Trace *trace, u32 pid, const char *series,
+                          std::vector<f64> values) {
+    u32 name = trace_intern(trace, STR_LITERAL("mem"));
+    u32 key = trace_intern(trace, {(u8 *)series, strlen(series)});
+    u32 id;
+    ASSERT_TRUE(trace_find_counter(trace, pid, name, key, &id)) << series;
+    TraceCounterSeries *counter = &trace->counters[id];
+    ASSERT_EQ(counter->num_samples, values.size()) << series;
+    for (usize i = 0; i < values.size(); ++i) {
+        ASSERT_EQ(counter->values[i], values[i]) << series << " " << i;
+    }
+}
+
+TEST(JsonTraceParserTest, Counters) {
+    Buf input = {.data = (u8 *)COUNTER_TRACE, .size = strlen(COUNTER_TRACE)};
+    for (usize chunk_size = 1; chunk_size <= input.size; chunk_size += 7) {
+        Trace trace;
+        trace_init(&trace);
+        ASSERT_EQ(parse_in_chunks(&trace, input, chunk_size),
+                  JsonTraceResult_Done);
+
+        ASSERT_EQ(trace.num_counters, 3);
+        check_counter(&trace, 1, "heap", {10, -10});
+        check_counter(&trace, 1, "stack", {2.5});
+        check_counter(&trace, 2, "heap", {7});
+        u32 id;
+        ASSERT_FALSE(trace_find_counter(
+            &trace, 1, trace_intern(&trace, STR_LITERAL("mem")),
+            trace_intern(&trace, STR_LITERAL("s")), &id));
+
+        trace_deinit(&trace);
+    }
+}
+
+static const char *METADATA_TRACE = R"([
+  {"name": "A", "ph": "X", "ts": 0, "dur": 1, "pid": 1, "tid": 1},
+  {"name": "A", "ph": "X", "ts": 0, "dur": 1, "pid": 1, "tid": 2},
+  {"name": "A", "ph": "X", "ts": 0, "dur": 1, "pid": 2, "tid": 1},
+  {"name": "A", "ph": "X", "ts": 0, "dur": 1, "pid": 3, "tid": 1},
+  {"name": "process_name", "ph": "M", "pid": 1, "tid": 1,
+   "args": {"name": "Browser"}},
+  {"name": "process_sort_index", "ph": "M", "pid": 1,
+   "args": {"sort_index": 5}},
+  {"name": "process_sort_index", "ph": "M", "pid": 2,
+   "args": {"sort_index": -1}},
+  {"name": "thread_name", "ph": "M", "pid": 1, "tid": 2,
+   "args": {"name": "Main"}},
+  {"name": "thread_sort_index", "ph": "M", "pid": 1, "tid": 2,
+   "args": {"sort_index": -3}},
+  {"name": "thread_name", "ph": "M", "pid": 1, "tid": 1,
+   "args": {"name": 1}},
+  {"name": "process_labels", "ph": "M", "pid": 3,
+   "args": {"labels": "x"}}
+])";
+
+TEST(JsonTraceParserTest, Metadata) {
+    Buf input = {.data = (u8 *)METADATA_TRACE, .size = strlen(METADATA_TRACE)};
+    for (usize chunk_size : {(usize)11, input.size}) {
+        Trace trace;
+        trace_init(&trace);
+        ASSERT_EQ(parse_in_chunks(&trace, input, chunk_size),
+                  JsonTraceResult_Done);
+
+        ASSERT_EQ(trace.num_track_infos, 3);
+        TraceTrackInfo *info =
+            trace_find_track_info(&trace, 1, TRACE_PROCESS_TID);
+        ASSERT_TRUE(info);
+        ASSERT_TRUE(buf_equal(trace_get_string(&trace, info->name),
+                              STR_LITERAL("Browser")));
+        ASSERT_TRUE(info->has_sort_index);
+        ASSERT_EQ(info->sort_index, 5);
+        info = trace_find_track_info(&trace, 2, TRACE_PROCESS_TID);
+        ASSERT_TRUE(info);
+        ASSERT_EQ(info->name, 0);
+        ASSERT_EQ(info->sort_index, -1);
+        info = trace_find_track_info(&trace, 1, 2);
+        ASSERT_TRUE(info);
+        ASSERT_TRUE(buf_equal(trace_get_string(&trace, info->name),
+                              STR_LITERAL("Main")));
+        ASSERT_EQ(info->sort_index, -3);
+        // Names that aren't strings and other metadata are ignored.
+        ASSERT_FALSE(trace_find_track_info(&trace, 1, 1));
+        ASSERT_FALSE(trace_find_track_info(&trace, 3, TRACE_PROCESS_TID));
+
+        // Processes by sort index, then threads by sort index.
+        trace_build_index(&trace);
+        ASSERT_EQ(trace.num_tracks, 4);
+        u32 expected[][2] = {{2, 1}, {3, 1}, {1, 2}, {1, 1}};
+        for (usize i = 0; i < trace.num_tracks; ++i) {
+            TraceTrack *track = &trace.tracks[trace.track_order[i]];
+            ASSERT_EQ(track->pid, expected[i][0]) << i;
+            ASSERT_EQ(track->tid, expected[i][1]) << i;
+        }
+
+        trace_deinit(&trace);
+    }
+}
+
+static const char *LINK_TRACE = R"([
+  {"name": "A", "ph": "X", "ts": 0, "dur": 100, "pid": 1, "tid": 1,
+   "bind_id": "0x7", "flow_out": true},
+  {"name": "B", "ph": "X", "ts": 10, "dur": 10, "pid": 1, "tid": 1},
+  {"name": "C", "ph": "X", "ts": 50, "dur": 30, "pid": 1, "tid": 2},
+  {"name": "D", "ph": "X", "ts": 200, "dur": 10, "pid": 1, "tid": 2,
+   "bind_id": 7, "flow_in": true},
+  {"name": "f", "cat": "x", "ph": "s", "ts": 15, "pid": 1, "tid": 1,
+   "id": "0x10"},
+  {"name": "f", "cat": "x", "ph": "t", "ts": 60, "pid": 1, "tid": 2, "id": 16},
+  {"name": "f", "cat": "x", "ph": "f", "ts": 205, "pid": 1, "tid": 2,
+   "id": "0x10"},
+  {"name": "f", "cat": "y", "ph": "f", "ts": 205, "pid": 1, "tid": 2,
+   "id": "0x10"},
+  {"name": "a", "cat": "c", "ph": "b", "ts": 5, "pid": 1, "id": "a"},
+  {"name": "a2", "cat": "c", "ph": "b", "ts": 6, "pid": 1, "id": "a"},
+  {"name": "a2", "cat": "c", "ph": "e", "ts": 7, "pid": 1, "id": "a"},
+  {"name": "i", "cat": "c", "ph": "n", "ts": 8, "pid": 1, "id": "a"},
+  {"name": "a", "cat": "c", "ph": "e", "ts": 30, "pid": 1, "id": "a"},
+  {"name": "s", "cat": "c", "ph": "b", "ts": 1, "pid": 1, "id": "a",
+   "scope": "other"},
+  {"name": "l", "cat": "c", "ph": "b", "ts": 2, "pid": 1,
+   "id2": {"local": 1}},
+  {"name": "l", "cat": "c", "ph": "b", "ts": 3, "pid": 2,
+   "id2": {"local": 1}},
+  {"name": "l", "cat": "c", "ph": "e", "ts": 4, "pid": 2,
+   "id2": {"local": 1}}
+])";
+
+TEST(JsonTraceParserTest, Links) {
+    Buf input = {.data = (u8 *)LINK_TRACE, .size = strlen(LINK_TRACE)};
+    for (usize chunk_size : {(usize)13, input.size}) {
+        Trace trace;
+        trace_init(&trace);
+        ASSERT_EQ(parse_in_chunks(&trace, input, chunk_size),
+                  JsonTraceResult_Done);
+        trace_build_index(&trace);
+
+        // A -> D by bind id, and the 's', 't', 'f' chain B -> C -> D. The
+        // 'f' of category "y" has no start.
+        ASSERT_EQ(trace.num_flows, 3);
+        u32 a = 0, b = 1, c = 2, d = 3;
+        TraceRange out = trace_get_flows_out(&trace, a);
+        ASSERT_EQ(out.end - out.begin, 1);
+        ASSERT_EQ(trace.flows[out.begin].to, d);
+        out = trace_get_flows_out(&trace, b);
+        ASSERT_EQ(out.end - out.begin, 1);
+        ASSERT_EQ(trace.flows[out.begin].to, c);
+        out = trace_get_flows_out(&trace, c);
+        ASSERT_EQ(out.end - out.begin, 1);
+        ASSERT_EQ(trace.flows[out.begin].to, d);
+        out = trace_get_flows_out(&trace, d);
+        ASSERT_EQ(out.end - out.begin, 0);
+        TraceRange in = trace_get_flows_in(&trace, d);
+        ASSERT_EQ(in.end - in.begin, 2);
+        ASSERT_EQ(trace.flows[trace.flow_in[in.begin]].from, a);
+        ASSERT_EQ(trace.flows[trace.flow_in[in.begin + 1]].from, c);
+        in = trace_get_flows_in(&trace, a);
+        ASSERT_EQ(in.end - in.begin, 0);
+
+        // Groups: "a", "a" in scope "other", local 1 of pid 1 and pid 2.
+        ASSERT_EQ(trace.num_async_groups, 4);
+        TraceAsyncGroup *group = &trace.async_groups[0];
+        ASSERT_EQ(group->count, 3);
+        struct {
+            u64 ts, dur;
+            const char *name;
+            u32 depth;
+        } expected[] = {{5, 25, "a", 0}, {6, 1, "a2", 1}, {8, 0, "i", 1}};
+        for (u32 i = 0; i < 3; ++i) {
+            TraceAsyncSlice *slice = &trace.async_slices[group->first + i];
+            ASSERT_EQ(slice->ts, expected[i].ts * 1000) << i;
+            ASSERT_EQ(slice->dur, expected[i].dur * 1000) << i;
+            ASSERT_TRUE(buf_equal(
+                trace_get_string(&trace, slice->name),
+                {(u8 *)expected[i].name, strlen(expected[i].name)}))
+                << i;
+            ASSERT_EQ(slice->depth, expected[i].depth) << i;
+            ASSERT_EQ(slice->group, 0);
+        }
+
+        // Unmatched begins end at the end of the trace.
+        group = &trace.async_groups[2];
+        ASSERT_EQ(group->pid, 1);
+        ASSERT_EQ(trace.async_slices[group->first].dur, (210 - 2) * 1000);
+        group = &trace.async_groups[3];
+        ASSERT_EQ(group->pid, 2);
+        ASSERT_EQ(trace.async_slices[group->first].dur, 1000);
+
+        // Lanes of pid 1 in order of start: "s", "l", "a", "a2", and "i"
+        // reuses the lane of "a2".
+        ASSERT_EQ(trace.num_async_tracks, 2);
+        TraceAsyncTrack *track = &trace.async_tracks[0];
+        ASSERT_EQ(track->pid, 1);
+        ASSERT_EQ(track->num_slices, 5);
+        ASSERT_EQ(track->num_lanes, 4);
+        u32 lanes[] = {0, 1, 2, 3, 3};
+        for (u32 i = 0; i < 5; ++i) {
+            ASSERT_EQ(trace.async_slices[track->slices[i]].lane, lanes[i]);
+        }
+        ASSERT_EQ(trace.async_tracks[1].num_lanes, 1);
+
+        trace_deinit(&trace);
+    }
+}
+
+TEST(JsonTraceParserTest, RawCompressed) {
+    std::string input_str = generate_trace(60000);
+    Buf input = {.data = (u8 *)input_str.data(), .size = input_str.size()};
+
+    Trace expected;
+    trace_init(&expected);
+    expected.strings.source = input;
+    ASSERT_EQ(parse_in_chunks(&expected, input, input.size),
+              JsonTraceResult_Done);
+
+    Trace trace;
+    trace_init(&trace);
+    trace.raw.compress = true;
+    ASSERT_EQ(parse_in_chunks(&trace, input, 4096), JsonTraceResult_Done);
+    ASSERT_GT(trace.raw.num_blocks, 1);
+    ASSERT_NE(trace.raw.blocks[0].compressed_size, 0);
+    check_raw_matches(&trace, &expected, 97);
+
+    trace_deinit(&trace);
+    trace_deinit(&expected);
+}
+
+TEST(JsonTraceParserTest, ParallelMatchesSequential) {
+    std::string input_str = generate_trace(60000);
+    Buf input = {.data = (u8 *)input_str.data(), .size = input_str.size()};
+
+    Trace expected;
+    trace_init(&expected);
+    ASSERT_EQ(parse_in_chunks(&expected, input, input.size),
+              JsonTraceResult_Done);
+
+    for (usize num_threads = 1; num_threads <= 8; num_threads *= 2) {
+        MemoryArena arena;
+        memory_arena_init(&arena);
+        JsonTraceParser parser;
+        json_trace_parser_init(&parser, &arena);
+        Trace trace;
+        trace_init(&trace);
+
+        ASSERT_EQ(json_trace_parser_parse_parallel(&parser, &trace, input,
+                                                   num_threads),
+                  JsonTraceResult_Done);
+        ASSERT_EQ(trace_get_event_count(&trace),
+                  trace_get_event_count(&expected));
+        ASSERT_EQ(trace.strings.count, expected.strings.count);
+        for (usize i = 0; i < trace_get_event_count(&trace); ++i) {
+            TraceEvent a = trace_get_event(&trace, i);
+            TraceEvent b = trace_get_event(&expected, i);
+            ASSERT_TRUE(a.name == b.name && a.cat == b.cat && a.ts == b.ts &&
+                        a.tid == b.tid)
+                << "num_threads = " << num_threads << " at " << i;
+        }
+        check_raw_matches(&trace, &expected);
+
+        ASSERT_EQ(trace_get_slice_count(&trace),
+                  trace_get_slice_count(&expected));
+        for (usize i = 0; i < trace_get_slice_count(&trace); ++i) {
+            TraceSlice a = trace_get_slice(&trace, i);
+            TraceSlice b = trace_get_slice(&expected, i);
+            ASSERT_TRUE(a.ts == b.ts && a.dur == b.dur && a.name == b.name &&
+                        a.track == b.track && a.depth == b.depth &&
+                        a.event == b.event)
+                << "num_threads = " << num_threads << " at slice " << i;
+        }
+
+        ASSERT_EQ(trace.num_link_points, expected.num_link_points);
+        ASSERT_GT(trace.num_link_points, 0);
+        for (usize i = 0; i < trace.num_link_points; ++i) {
+            TraceLinkPoint *a = &trace.link_points[i];
+            TraceLinkPoint *b = &expected.link_points[i];
+            ASSERT_TRUE(a->id == b->id && a->cat == b->cat &&
+                        a->event == b->event && a->kind == b->kind)
+                << "num_threads = " << num_threads << " at link " << i;
+        }
+
+        ASSERT_EQ(trace.num_track_infos, expected.num_track_infos);
+        ASSERT_GT(trace.num_track_infos, 0);
+        for (usize i = 0; i < trace.num_track_infos; ++i) {
+            TraceTrackInfo *a = &trace.track_infos[i];
+            TraceTrackInfo *b =
+                trace_find_track_info(&expected, a->pid, a->tid);
+            ASSERT_TRUE(b && a->name == b->name &&
+                        a->has_sort_index == b->has_sort_index &&
+                        a->sort_index == b->sort_index)
+                << "num_threads = " << num_threads << " at info " << i;
+        }
+
+        for (u32 name = 0; name < trace.strings.count; ++name) {
+            Sketch *a = trace_get_duration_sketch(&trace, name);
+            Sketch *b = trace_get_duration_sketch(&expected, name);
+            ASSERT_EQ(!a, !b) << "num_threads = " << num_threads;
+            if (!a) {
+                continue;
+            }
+            ASSERT_EQ(a->count, b->count) << "num_threads = " << num_threads;
+            for (f64 q : {0.0, 0.5, 0.9, 0.99, 1.0}) {
+                ASSERT_EQ(sketch_get_quantile(a, q), sketch_get_quantile(b, q))
+                    << "num_threads = " << num_threads << " q = " << q;
+            }
+        }
+
+        ASSERT_EQ(trace.num_counters, expected.num_counters);
+        for (usize i = 0; i < trace.num_counters; ++i) {
+            TraceCounterSeries *a = &trace.counters[i];
+            TraceCounterSeries *b = &expected.counters[i];
+            ASSERT_TRUE(a->pid == b->pid && a->name == b->name &&
+                        a->series == b->series &&
+                        a->num_samples == b->num_samples);
+            ASSERT_EQ(memcmp(a->ts, b->ts, a->num_samples * sizeof(u64)), 0);
+            ASSERT_EQ(
+                memcmp(a->values, b->values, a->num_samples * sizeof(f64)), 0);
+        }
+
+        trace_deinit(&trace);
+        json_trace_parser_deinit(&parser);
+        memory_arena_deinit(&arena);
+    }
+
+    trace_deinit(&expected);
+}
+
+TEST(JsonTraceParserTest, ParallelError) {
+    std::string input_str = generate_trace(60000);
+    input_str[input_str.find(", \"pid\"", input_str.size() / 2)] = '#';
+    Buf input = {.data = (u8 *)input_str.data(), .size = input_str.size()};
+
+    MemoryArena arena;
+    memory_arena_init(&arena);
+    JsonTraceParser parser;
+    json_trace_parser_init(&parser, &arena);
+    Trace trace;
+    trace_init(&trace);
+
+    ASSERT_EQ(json_trace_parser_parse_parallel(&parser, &trace, input, 4),
+              JsonTraceResult_Error);
+    ASSERT_NE(strlen(json_trace_parser_get_error(&parser)), 0);
+
+    trace_deinit(&trace);
+    json_trace_parser_deinit(&parser);
+    memory_arena_deinit(&arena);
+}
+
+static bool is_in_arena(MemoryArena *arena, void *data) {
+    for (MemoryBlock *block = arena->head; block; block = block->next) {
+        u8 *begin = (u8 *)block;
+        if ((u8 *)data >= begin && (u8 *)data < begin + block->size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+TEST(JsonTraceParserTest, ParallelKeepsArenaBlocks) {
+    // Escaped names are copied into the arena, enough of them and their
+    // columns to need more than one block.
+    std::string input_str = "[";
+    char event[128];
+    for (u32 i = 0; i < 300000; ++i) {
+        snprintf(event, sizeof(event),
+                 "%s{\"name\": \"e\\t%u\", \"ph\": \"X\", \"ts\": %u, "
+                 "\"dur\": 1, \"pid\": 1, \"tid\": 1}",
+                 i ? ",\n" : "", i, i);
+        input_str += event;
+    }
+    input_str += "]";
+    Buf input = {.data = (u8 *)input_str.data(), .size = input_str.size()};
+
+    MemoryArena arena;
+    memory_arena_init(&arena);
+    JsonTraceParser parser;
+    json_trace_parser_init(&parser, &arena);
+    Trace trace;
+    trace_init(&trace);
+
+    ASSERT_EQ(json_trace_parser_parse_parallel(&parser, &trace, input, 4),
+              JsonTraceResult_Done);
+    ASSERT_EQ(trace_get_event_count(&trace), 300000);
+    ASSERT_GT(trace.arena.num_blocks, 1);
+
+    usize num_blocks = 0;
+    MemoryBlock *last = 0;
+    for (MemoryBlock *block = trace.arena.head; block; block = block->next) {
+        num_blocks++;
+        last = block;
+    }
+    ASSERT_EQ(num_blocks, trace.arena.num_blocks);
+    ASSERT_EQ(last, trace.arena.tail);
+    for (usize i = 0; i < trace.num_chunks; ++i) {
+        ASSERT_TRUE(is_in_arena(&trace.arena, trace.chunks[i].ts)) << i;
+    }
+    for (u32 id = 1; id < trace.strings.count; ++id) {
+        Buf name = trace_get_string(&trace, id);
+        ASSERT_TRUE(is_in_arena(&trace.arena, name.data)) << id;
+    }
+
+    trace_deinit(&trace);
+    json_trace_parser_deinit(&parser);
+    memory_arena_deinit(&arena);
+}
+
+TEST(JsonTraceParserTest, ParseFile) {
+    std::string input_str = generate_trace(60000);
+    std::string path = testing::TempDir() + "/parse_file.json";
+    FILE *file = fopen(path.c_str(), "wb");
+    ASSERT_TRUE(file);
+    fwrite(input_str.data(), 1, input_str.size(), file);
+    fclose(file);
+
+    MemoryArena arena;
+    memory_arena_init(&arena);
+    JsonTraceParser parser;
+    json_trace_parser_init(&parser, &arena);
+    Trace trace;
+    trace_init(&trace);
+
+    ASSERT_EQ(json_trace_parser_parse_file(&parser, &trace, path.c_str(), 4),
+              JsonTraceResult_Done);
+    ASSERT_EQ(trace_get_event_count(&trace), 60000);
+
+    // Names point into the mapped file.
+    Buf file_data = trace.file.data;
+    ASSERT_EQ(file_data.size, input_str.size());
+    Buf name = trace_get_string(&trace, trace_get_event(&trace, 59999).name);
+    ASSERT_TRUE(buf_equal(name, STR_LITERAL("e99")));
+    ASSERT_TRUE(name.data >= file_data.data &&
+                name.data < file_data.data + file_data.size);
+
+    // So do args.
+    ASSERT_FALSE(trace_get_event(&trace, 59999).raw & TRACE_RAW_IN_STORE);
+    Buf args = json_trace_get_event_field(&trace, 59999, STR_LITERAL("args"),
+                                          &arena);
+    ASSERT_TRUE(buf_equal(args, STR_LITERAL("{}")));
+
+    trace_deinit(&trace);
+    json_trace_parser_deinit(&parser);
+    memory_arena_deinit(&arena);
+    remove(path.c_str());
+}
+
+TEST(JsonTraceParserTest, ParseMissingFile) {
+    MemoryArena arena;
+    memory_arena_init(&arena);
+    JsonTraceParser parser;
+    json_trace_parser_init(&parser, &arena);
+    Trace trace;
+    trace_init(&trace);
+
+    ASSERT_EQ(
+        json_trace_parser_parse_file(&parser, &trace, "/nonexistent", 1),
+        JsonTraceResult_Error);
+
+    trace_deinit(&trace);
+    json_trace_parser_deinit(&parser);
+    memory_arena_deinit(&arena);
+}
+
+// Byte at a time version of the index, see json_index.h for the masks.
+static void index_reference(Buf input, bool *quote, bool *bracket,
+                            bool *non_whitespace) {
+    bool in_string = false;
+    bool escaped = false;
+    for (usize i = 0; i < input.size; ++i) {
+        u8 ch = input.data[i];
+        bool is_quote = !escaped && ch == '"';
+        escaped = !escaped && ch == '\\';
+        quote[i] = is_quote;
+        bracket[i] = !in_string && (ch == '{' || ch == '}' || ch == '[' ||
+                                    ch == ']');
+        non_whitespace[i] = in_string || ch > 32;
+        if (is_quote) {
+            in_string = !in_string;
+        }
+    }
+}
+
+static usize next_in_mask(JsonIndex *index, Buf input, usize mask,
+                          usize pos) {
+    switch (mask) {
+        case 0:
+            return json_index_next_quote(index, input, pos);
+        case 1:
+            return json_index_next_bracket(index, input, pos);
+        default:
+            return json_index_next_non_whitespace(index, input, pos);
+    }
+}
+
+// Feeds the input in parts of random size up to `max_part_size`, and walks
+// the positions of one mask.
+static void check_index(JsonIndexKernel kernel, Buf input, usize mask,
+                        bool *expected, usize max_part_size, usize seed) {
+    JsonIndex *index = new JsonIndex;
+    json_index_init(index);
+    index->kernel = kernel;
+
+    usize start = 0;
+    while (start < input.size) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        usize size = min((usize)(seed >> 33) % max_part_size + 1,
+                         input.size - start);
+        Buf part = buf_slice(input, start, start + size);
+        json_index_begin_input(index);
+        usize pos = 0;
+        while (pos < part.size) {
+            usize next = next_in_mask(index, part, mask, pos);
+            for (; pos < next; ++pos) {
+                ASSERT_FALSE(expected[start + pos])
+                    << "kernel " << kernel << " mask " << mask << " at "
+                    << start + pos;
+            }
+            if (next < part.size) {
+                ASSERT_TRUE(expected[start + next])
+                    << "kernel " << kernel << " mask " << mask << " at "
+                    << start + next;
+                pos = next + 1;
+            }
+        }
+        json_index_end_input(index, part);
+        start += size;
+    }
+
+    delete index;
+}
+
+TEST(JsonIndexTest, MatchesReference) {
+    const char alphabet[] = "\"\"\\\\{}[]:, \nab";
+    u64 seed = 1;
+    usize size = 100000;
+    u8 *data = new u8[size];
+    for (usize i = 0; i < size; ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        data[i] = alphabet[(seed >> 33) % (sizeof(alphabet) - 1)];
+    }
+    Buf input = {.data = data, .size = size};
+
+    JsonIndexKernel kernels[] = {
+        JsonIndexKernel_Scalar,
+        JsonIndexKernel_Sse2,
+        JsonIndexKernel_Avx2,
+        JsonIndexKernel_Simd128,
+    };
+    bool *expected[3];
+    for (usize mask = 0; mask < 3; ++mask) {
+        expected[mask] = new bool[size];
+    }
+    index_reference(input, expected[0], expected[1], expected[2]);
+
+    for (usize i = 0; i < ARRAY_SIZE(kernels); ++i) {
+        if (!json_index_is_kernel_supported(kernels[i])) {
+            continue;
+        }
+        for (usize mask = 0; mask < 3; ++mask) {
+            check_index(kernels[i], input, mask, expected[mask], 300, i);
+            check_index(kernels[i], input, mask, expected[mask],
+                        3 * JSON_INDEX_WINDOW_SIZE, i);
+        }
+    }
+
+    for (usize mask = 0; mask < 3; ++mask) {
+        delete[] expected[mask];
+    }
+    delete[] data;
+}
+
+TEST(JsonIndexTest, EscapedBackslashEndsString) {
+    Buf input = STR_LITERAL(R"(["a\\", "b\"c", {}])");
+    JsonIndex *index = new JsonIndex;
+    json_index_init(index);
+    json_index_begin_input(index);
+    // The quote after an escaped backslash closes the string.
+    ASSERT_EQ(json_index_next_quote(index, input, 2), 5);
+    // The escaped quote doesn't.
+    ASSERT_EQ(json_index_next_quote(index, input, 9), 13);
+    ASSERT_EQ(json_index_next_bracket(index, input, 1), 16);
+    delete index;
+}
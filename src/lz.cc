@@ -0,0 +1,146 @@
+#include "src/lz.h"
+
+#include <memory.h>
+
+static const usize HASH_BITS = 12;
+static const usize MIN_MATCH = 4;
+static const usize MAX_OFFSET = 65535;
+
+static inline u32 load_u32(u8 *p) {
+    u32 value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline u32 hash_u32(u32 value) {
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Writes the part of a length that doesn't fit in the 4 bits of the token.
+static u8 *write_length(u8 *out, usize length) {
+    while (length >= 255) {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = (u8)length;
+    return out;
+}
+
+static u8 *write_sequence(u8 *out, u8 *literals, usize num_literals,
+                          usize offset, usize match_length) {
+    u8 *token = out++;
+    *token = (u8)(min(num_literals, (usize)15) << 4);
+    if (num_literals >= 15) {
+        out = write_length(out, num_literals - 15);
+    }
+    if (num_literals) {
+        memcpy(out, literals, num_literals);
+        out += num_literals;
+    }
+
+    if (match_length) {
+        *out++ = (u8)offset;
+        *out++ = (u8)(offset >> 8);
+        usize length = match_length - MIN_MATCH;
+        *token |= (u8)min(length, (usize)15);
+        if (length >= 15) {
+            out = write_length(out, length - 15);
+        }
+    }
+    return out;
+}
+
+usize lz_compress(Buf src, u8 *dst) {
+    // Positions + 1 of the last occurrence of each hashed 4 bytes.
+    u32 table[1 << HASH_BITS] = {};
+
+    u8 *data = src.data;
+    u8 *out = dst;
+    usize anchor = 0;
+    usize pos = 0;
+    while (pos + MIN_MATCH <= src.size) {
+        u32 value = load_u32(data + pos);
+        u32 hash = hash_u32(value);
+        usize ref = table[hash];
+        table[hash] = (u32)(pos + 1);
+        if (!ref || pos - (ref - 1) > MAX_OFFSET ||
+            load_u32(data + ref - 1) != value) {
+            pos++;
+            continue;
+        }
+
+        ref--;
+        usize length = MIN_MATCH;
+        while (pos + length < src.size &&
+               data[ref + length] == data[pos + length]) {
+            length++;
+        }
+        out = write_sequence(out, data + anchor, pos - anchor, pos - ref,
+                             length);
+        pos += length;
+        anchor = pos;
+    }
+
+    // The last sequence only has literals.
+    out = write_sequence(out, data + anchor, src.size - anchor, 0, 0);
+    return out - dst;
+}
+
+// Reads the rest of a length whose 4 bits in the token were all set.
+static bool read_length(u8 **in, u8 *end, usize *length) {
+    while (true) {
+        if (*in == end) {
+            return false;
+        }
+        u8 byte = *(*in)++;
+        *length += byte;
+        if (byte != 255) {
+            return true;
+        }
+    }
+}
+
+bool lz_decompress(Buf src, Buf dst) {
+    u8 *in = src.data;
+    u8 *in_end = src.data + src.size;
+    usize pos = 0;
+    while (in < in_end) {
+        u8 token = *in++;
+
+        usize num_literals = token >> 4;
+        if (num_literals == 15 && !read_length(&in, in_end, &num_literals)) {
+            return false;
+        }
+        if (num_literals > (usize)(in_end - in) ||
+            num_literals > dst.size - pos) {
+            return false;
+        }
+        memcpy(dst.data + pos, in, num_literals);
+        in += num_literals;
+        pos += num_literals;
+        if (in == in_end) {
+            break;
+        }
+
+        if (in_end - in < 2) {
+            return false;
+        }
+        usize offset = in[0] | ((usize)in[1] << 8);
+        in += 2;
+        usize length = token & 15;
+        if (length == 15 && !read_length(&in, in_end, &length)) {
+            return false;
+        }
+        length += MIN_MATCH;
+        if (offset == 0 || offset > pos || length > dst.size - pos) {
+            return false;
+        }
+        // Matches can overlap with the bytes they produce.
+        u8 *match = dst.data + pos - offset;
+        for (usize i = 0; i < length; ++i) {
+            dst.data[pos + i] = match[i];
+        }
+        pos += length;
+    }
+    return pos == dst.size;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "src/buf.h"
+#include "src/defs.h"
+
+// A small LZ77 block compressor in the LZ4 block format. It is built for speed
+// rather than ratio, which is still good on repetitive data like JSON.
+
+// Returns the maximum compressed size of `size` bytes.
+inline usize lz_compress_bound(usize size) { return size + size / 255 + 16; }
+
+// Compresses `src` into `dst`, which must hold lz_compress_bound(src.size)
+// bytes. Returns the compressed size.
+usize lz_compress(Buf src, u8 *dst);
+
+// Decompresses `src` into `dst`, whose size must be the exact decompressed
+// size. Returns false if `src` is malformed.
+bool lz_decompress(Buf src, Buf dst);
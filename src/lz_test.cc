@@ -0,0 +1,57 @@
+#include "src/lz.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+
+#include <string>
+
+static void check_round_trip(Buf input) {
+    u8 *compressed = new u8[lz_compress_bound(input.size)];
+    usize size = lz_compress(input, compressed);
+    ASSERT_LE(size, lz_compress_bound(input.size));
+
+    u8 *output = new u8[input.size + 1];
+    ASSERT_TRUE(lz_decompress({compressed, size}, {output, input.size}));
+    ASSERT_TRUE(buf_equal({output, input.size}, input));
+
+    // Wrong sizes are detected.
+    if (input.size) {
+        ASSERT_FALSE(
+            lz_decompress({compressed, size}, {output, input.size - 1}));
+    }
+    ASSERT_FALSE(lz_decompress({compressed, size}, {output, input.size + 1}));
+
+    delete[] output;
+    delete[] compressed;
+}
+
+TEST(LzTest, Empty) { check_round_trip({}); }
+
+TEST(LzTest, Short) { check_round_trip(STR_LITERAL("abc")); }
+
+TEST(LzTest, Repetitive) {
+    char buf[64];
+    std::string input;
+    for (int i = 0; i < 10000; ++i) {
+        int size = snprintf(buf, sizeof(buf), R"({"args": {"id": %d}}, )", i);
+        input.append(buf, size);
+    }
+    Buf data = {(u8 *)input.data(), input.size()};
+    check_round_trip(data);
+
+    u8 *compressed = new u8[lz_compress_bound(data.size)];
+    ASSERT_LT(lz_compress(data, compressed), data.size / 3);
+    delete[] compressed;
+}
+
+TEST(LzTest, Runs) {
+    // Long overlapping matches and long literal runs.
+    std::string input(100000, 'a');
+    u64 seed = 1;
+    for (usize i = 50000; i < 51000; ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        input[i] = (char)(seed >> 56);
+    }
+    check_round_trip({(u8 *)input.data(), input.size()});
+}
@@ -0,0 +1,50 @@
+#include "src/mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool mapped_file_open(MappedFile *file, const char *path) {
+    *file = {};
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+
+    // mmap rejects empty mappings.
+    if (st.st_size == 0) {
+        close(fd);
+        return true;
+    }
+
+    void *data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file.
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    // Hints only, failures are harmless.
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    madvise(data, st.st_size, MADV_HUGEPAGE);
+#endif
+
+    file->data = {.data = (u8 *)data, .size = (usize)st.st_size};
+    return true;
+}
+
+void mapped_file_close(MappedFile *file) {
+    if (file->data.data) {
+        munmap(file->data.data, file->data.size);
+    }
+    *file = {};
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "src/buf.h"
+#include "src/defs.h"
+
+// A whole file mapped read-only into memory.
+struct MappedFile {
+    Buf data;
+};
+
+// Maps the file at `path` and hints the kernel that it will be read
+// sequentially, with huge pages where supported. Returns false and leaves errno
+// set on failure.
+bool mapped_file_open(MappedFile *file, const char *path);
+void mapped_file_close(MappedFile *file);
@@ -2,6 +2,7 @@
 
 #include <memory.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 
 struct MemoryHeader {
     usize prev;
@@ -14,8 +15,48 @@ static inline MemoryHeader *get_header(MemoryBlock *block, usize offset) {
     return (MemoryHeader *)((u8 *)block + offset);
 }
 
+static const usize MIN_BLOCK_SIZE = 4096;
+// Blocks stop doubling at this size, unless a single allocation needs more.
+static const usize MAX_GROWTH_BLOCK_SIZE = 64 * 1024 * 1024;
+// Blocks of at least this size are mapped directly so that they can be backed
+// by transparent huge pages. Wasm has no huge pages, its blocks all come from
+// the heap.
+static const usize MMAP_BLOCK_SIZE = 2 * 1024 * 1024;
+
+static MemoryBlock *alloc_block(usize block_size) {
+#ifdef __EMSCRIPTEN__
+    return (MemoryBlock *)memory_alloc(block_size);
+#else
+    if (block_size < MMAP_BLOCK_SIZE) {
+        return (MemoryBlock *)memory_alloc(block_size);
+    }
+    void *data = mmap(0, block_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+        return 0;
+    }
+    // Hint only, failures are harmless.
+#ifdef MADV_HUGEPAGE
+    madvise(data, block_size, MADV_HUGEPAGE);
+#endif
+    return (MemoryBlock *)data;
+#endif
+}
+
+static void free_block(MemoryBlock *block) {
+#ifdef __EMSCRIPTEN__
+    memory_free(block);
+#else
+    if (block->size < MMAP_BLOCK_SIZE) {
+        memory_free(block);
+    } else {
+        munmap(block, block->size);
+    }
+#endif
+}
+
 static MemoryBlock *push_block(MemoryArena *arena, usize block_size) {
-    MemoryBlock *block = (MemoryBlock *)memory_alloc(block_size);
+    MemoryBlock *block = alloc_block(block_size);
     ASSERT(block);
     block->size = block_size;
     block->cursor = sizeof(MemoryBlock);
@@ -24,6 +65,9 @@ static MemoryBlock *push_block(MemoryArena *arena, usize block_size) {
 
     block->next = 0;
     block->prev = arena->tail;
+    if (arena->tail) {
+        arena->tail->next = block;
+    }
     arena->tail = block;
     if (!arena->head) {
         arena->head = block;
@@ -34,17 +78,19 @@ static MemoryBlock *push_block(MemoryArena *arena, usize block_size) {
     return block;
 }
 
-static const usize MIN_BLOCK_SIZE = 4096;
-
 void memory_arena_init(MemoryArena *arena) {
     *arena = {.min_block_size = MIN_BLOCK_SIZE};
 }
 
+void memory_arena_init_bump(MemoryArena *arena) {
+    *arena = {.min_block_size = MIN_BLOCK_SIZE, .bump = true};
+}
+
 void memory_arena_deinit(MemoryArena *arena) {
     MemoryBlock *block = arena->head;
     while (block) {
         MemoryBlock *next = block->next;
-        free(block);
+        free_block(block);
         block = next;
     }
     *arena = {};
@@ -55,6 +101,9 @@ static void ensure_current_block_size(MemoryArena *arena, usize size) {
         arena->current = arena->head;
     }
 
+    // Blocks after the current one are only there after a clear or a free,
+    // and the ones skipped here stay skipped until then, so this is amortized
+    // constant time. While the arena only grows the current block is the tail.
     MemoryBlock *block = arena->current;
     while (block) {
         if (block->cursor + size <= block->size) {
@@ -64,9 +113,13 @@ static void ensure_current_block_size(MemoryArena *arena, usize size) {
     }
 
     if (!block) {
+        // Grow geometrically so that the number of blocks stays logarithmic
+        // in the total size.
         usize block_size = arena->min_block_size;
-        if (block && block->prev) {
-            block_size = block->prev->size << 1;
+        if (arena->tail) {
+            usize next_size =
+                min(arena->tail->size << 1, MAX_GROWTH_BLOCK_SIZE);
+            block_size = max(block_size, next_size);
         }
         while ((block_size - sizeof(MemoryBlock)) <= size) {
             block_size <<= 1;
@@ -78,14 +131,38 @@ static void ensure_current_block_size(MemoryArena *arena, usize size) {
     arena->current = block;
 }
 
+static inline usize align_up(usize value, usize alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static void *bump(MemoryArena *arena, usize size) {
+    // Reserve the worst case padding, malloc() may return blocks that are
+    // less aligned.
+    ensure_current_block_size(arena, size + MEMORY_ARENA_BUMP_ALIGNMENT);
+
+    MemoryBlock *block = arena->current;
+    ASSERT(block);
+    usize base = (usize)block;
+    usize offset =
+        align_up(base + block->cursor, MEMORY_ARENA_BUMP_ALIGNMENT) - base;
+    ASSERT(offset + size <= block->size);
+    block->cursor = offset + size;
+    return (u8 *)block + offset;
+}
+
 void *memory_arena_alloc(MemoryArena *arena, usize size) {
     ASSERT(size > 0);
+    if (arena->bump) {
+        return bump(arena, size);
+    }
 
+    // The header of the next allocation follows this one.
     usize total_size = sizeof(MemoryHeader) + size;
-    ensure_current_block_size(arena, total_size);
+    ensure_current_block_size(arena, total_size + sizeof(MemoryHeader));
 
     MemoryBlock *block = arena->current;
-    ASSERT(block && block->cursor + total_size <= block->size);
+    ASSERT(block && block->cursor + total_size + sizeof(MemoryHeader) <=
+                        block->size);
 
     MemoryHeader *header = get_header(block, block->cursor);
     header->size = total_size;
@@ -101,7 +178,16 @@ void *memory_arena_alloc(MemoryArena *arena, usize size) {
     return data;
 }
 
+void *memory_arena_calloc(MemoryArena *arena, usize count, usize size) {
+    void *data = memory_arena_alloc(arena, count * size);
+    if (arena->bump) {
+        memset(data, 0, count * size);
+    }
+    return data;
+}
+
 void *memory_arena_realloc(MemoryArena *arena, void *data, usize new_size) {
+    ASSERT(!arena->bump);
     if (!data) {
         return memory_arena_alloc(arena, new_size);
     }
@@ -134,6 +220,7 @@ static void maybe_shrink(MemoryArena *arena) {
 }
 
 void memory_arena_free(MemoryArena *arena, void *data) {
+    ASSERT(!arena->bump);
     if (!data) {
         return;
     }
@@ -151,4 +238,107 @@ void memory_arena_clear(MemoryArena *arena) {
         block = block->next;
     }
     arena->current = arena->head;
+}
+
+void memory_arena_adopt(MemoryArena *dst, MemoryArena *src) {
+    ASSERT(dst->bump && src->bump);
+    if (!src->head) {
+        return;
+    }
+
+    if (!dst->head) {
+        dst->head = src->head;
+        dst->tail = src->tail;
+        dst->current = src->current;
+    } else {
+        // The adopted blocks go first, so that `dst` keeps filling its
+        // current block and never walks over them until it is cleared.
+        src->tail->next = dst->head;
+        dst->head->prev = src->tail;
+        dst->head = src->head;
+    }
+    dst->num_blocks += src->num_blocks;
+
+    *src = {.min_block_size = src->min_block_size, .bump = true};
+}
+
+// Commits are rounded up to this, a multiple of the page size everywhere.
+static const usize COMMIT_GRANULARITY = 64 * 1024;
+
+#ifdef __EMSCRIPTEN__
+// Every copy of the data starts with a pointer to the previous copy.
+static const usize COPY_HEADER_SIZE = 16;
+
+static u8 *get_copy(u8 *data) { return data ? data - COPY_HEADER_SIZE : 0; }
+#endif
+
+void memory_reserve_init(MemoryReserve *reserve, usize capacity) {
+    *reserve = {.capacity = capacity};
+#ifndef __EMSCRIPTEN__
+    void *data = mmap(0, capacity, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    ASSERT(data != MAP_FAILED);
+    reserve->data = (u8 *)data;
+#endif
+}
+
+void memory_reserve_deinit(MemoryReserve *reserve) {
+#ifdef __EMSCRIPTEN__
+    u8 *copy = get_copy(reserve->data);
+    while (copy) {
+        u8 *prev = *(u8 **)copy;
+        memory_free(copy);
+        copy = prev;
+    }
+#else
+    if (reserve->data) {
+        munmap(reserve->data, reserve->capacity);
+    }
+#endif
+    *reserve = {};
+}
+
+void memory_reserve_grow(MemoryReserve *reserve, usize size) {
+    if (size <= reserve->size) {
+        return;
+    }
+    ASSERT(size <= reserve->capacity);
+
+    // Commit geometrically so that growing by a little at a time is cheap.
+    usize new_size = max(size, reserve->size << 1);
+    new_size = min(align_up(new_size, COMMIT_GRANULARITY), reserve->capacity);
+#ifdef __EMSCRIPTEN__
+    // The heap itself grows with memory.grow. The old copy is kept for
+    // readers that still point to it.
+    u8 *copy = (u8 *)memory_alloc(COPY_HEADER_SIZE + new_size);
+    ASSERT(copy);
+    *(u8 **)copy = get_copy(reserve->data);
+    if (reserve->size) {
+        memcpy(copy + COPY_HEADER_SIZE, reserve->data, reserve->size);
+    }
+    reserve->data = copy + COPY_HEADER_SIZE;
+#else
+    int error = mprotect(reserve->data + reserve->size,
+                         new_size - reserve->size, PROT_READ | PROT_WRITE);
+    ASSERT(!error);
+#endif
+    reserve->size = new_size;
+}
+
+void memory_reserve_trim(MemoryReserve *reserve) {
+#ifdef __EMSCRIPTEN__
+    u8 *copy = get_copy(reserve->data);
+    if (!copy) {
+        return;
+    }
+    u8 *prev = *(u8 **)copy;
+    while (prev) {
+        u8 *next = *(u8 **)prev;
+        memory_free(prev);
+        prev = next;
+    }
+    *(u8 **)copy = 0;
+#else
+    (void)reserve;
+#endif
 }
\ No newline at end of file
@@ -23,13 +23,54 @@ struct MemoryArena {
     MemoryBlock *current;
     usize min_block_size;
     usize num_blocks;
+    // Allocations are only bumped: no headers, no zeroing and they can't be
+    // reallocated or freed individually.
+    bool bump;
 };
 
+// Allocations are aligned to this in bump mode.
+static const usize MEMORY_ARENA_BUMP_ALIGNMENT = 16;
+
 void memory_arena_init(MemoryArena *arena);
+void memory_arena_init_bump(MemoryArena *arena);
 void memory_arena_deinit(MemoryArena *arena);
 
+// The memory is zeroed, except in bump mode.
 void *memory_arena_alloc(MemoryArena *arena, usize size);
+// Always zeroed.
+void *memory_arena_calloc(MemoryArena *arena, usize count, usize size);
+// Not available in bump mode.
 void *memory_arena_realloc(MemoryArena *arena, void *data, usize new_size);
 void memory_arena_free(MemoryArena *arena, void *data);
 
 void memory_arena_clear(MemoryArena *arena);
+
+// Moves all blocks of `src` to `dst` without copying, so that allocations made
+// from `src`, e.g. by another thread, live as long as `dst`. `src` is left
+// empty. Both arenas must be in bump mode.
+void memory_arena_adopt(MemoryArena *dst, MemoryArena *src);
+
+// A range of address space that is reserved up front and committed as it
+// grows, so that growing never moves or copies the data. Wasm has no virtual
+// memory, there growing copies the data to a new heap allocation and keeps the
+// old ones until memory_reserve_trim(), so that pointers to old data stay
+// valid, like tables that are grown in a MemoryArena.
+struct MemoryReserve {
+    u8 *data;
+    // Committed size.
+    usize size;
+    // Reserved size.
+    usize capacity;
+};
+
+// Only reserves address space, nothing is committed.
+void memory_reserve_init(MemoryReserve *reserve, usize capacity);
+void memory_reserve_deinit(MemoryReserve *reserve);
+
+// Commits at least the first `size` bytes, up to the capacity. Newly
+// committed bytes are not zeroed.
+void memory_reserve_grow(MemoryReserve *reserve, usize size);
+
+// Frees the copies of the data left by earlier grows on wasm, pointers into
+// them become invalid. Does nothing elsewhere, where the data never moves.
+void memory_reserve_trim(MemoryReserve *reserve);
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include <gtest/gtest.h>
 
+#include <memory.h>
+
 TEST(MemoryArenaTest, SingleBlock) {
     MemoryArena arena;
     memory_arena_init(&arena);
@@ -67,3 +69,170 @@ TEST(MemoryArenaTest, PopAndPushNewBlock) {
 
     memory_arena_deinit(&arena);
 }
+
+TEST(MemoryArenaTest, ClearReusesBlocks) {
+    MemoryArena arena;
+    memory_arena_init(&arena);
+
+    memory_arena_alloc(&arena, 1);
+    memory_arena_alloc(&arena, arena.min_block_size + 1);
+    ASSERT_EQ(arena.num_blocks, 2);
+    ASSERT_EQ(arena.head->next, arena.tail);
+
+    memory_arena_clear(&arena);
+    memory_arena_alloc(&arena, 1);
+    memory_arena_alloc(&arena, arena.min_block_size + 1);
+    ASSERT_EQ(arena.num_blocks, 2);
+    ASSERT_EQ(arena.current, arena.tail);
+
+    memory_arena_deinit(&arena);
+}
+
+TEST(MemoryArenaBumpTest, AlignedWithoutHeaders) {
+    MemoryArena arena;
+    memory_arena_init_bump(&arena);
+
+    u8 *a = (u8 *)memory_arena_alloc(&arena, 1);
+    u8 *b = (u8 *)memory_arena_alloc(&arena, 1);
+    u8 *c = (u8 *)memory_arena_alloc(&arena, 17);
+    u8 *d = (u8 *)memory_arena_alloc(&arena, 1);
+    ASSERT_EQ((usize)a % MEMORY_ARENA_BUMP_ALIGNMENT, 0);
+    ASSERT_EQ(b - a, MEMORY_ARENA_BUMP_ALIGNMENT);
+    ASSERT_EQ(c - b, MEMORY_ARENA_BUMP_ALIGNMENT);
+    ASSERT_EQ(d - c, 2 * MEMORY_ARENA_BUMP_ALIGNMENT);
+    ASSERT_EQ(arena.num_blocks, 1);
+
+    memory_arena_deinit(&arena);
+}
+
+TEST(MemoryArenaBumpTest, MultipleBlocks) {
+    MemoryArena arena;
+    memory_arena_init_bump(&arena);
+
+    memory_arena_alloc(&arena, 1);
+    u8 *data = (u8 *)memory_arena_alloc(&arena, arena.min_block_size);
+    ASSERT_EQ(arena.num_blocks, 2);
+    ASSERT_EQ(arena.current, arena.tail);
+    ASSERT_EQ(arena.head->next, arena.tail);
+    ASSERT_EQ((usize)data % MEMORY_ARENA_BUMP_ALIGNMENT, 0);
+    ASSERT_LE(arena.current->cursor, arena.current->size);
+
+    memory_arena_deinit(&arena);
+}
+
+TEST(MemoryArenaBumpTest, ClearReusesBlocks) {
+    MemoryArena arena;
+    memory_arena_init_bump(&arena);
+
+    u8 *first = (u8 *)memory_arena_alloc(&arena, 64);
+    memset(first, 0xCC, 64);
+    memory_arena_alloc(&arena, arena.min_block_size);
+    ASSERT_EQ(arena.num_blocks, 2);
+
+    memory_arena_clear(&arena);
+    ASSERT_EQ(arena.current, arena.head);
+    // Bump allocations aren't zeroed, calloc still is.
+    u8 *data = (u8 *)memory_arena_calloc(&arena, 64, 1);
+    ASSERT_EQ(data, first);
+    for (u32 i = 0; i < 64; ++i) {
+        ASSERT_EQ(data[i], 0);
+    }
+    memory_arena_alloc(&arena, arena.min_block_size);
+    ASSERT_EQ(arena.num_blocks, 2);
+    ASSERT_EQ(arena.current, arena.tail);
+
+    memory_arena_deinit(&arena);
+}
+
+TEST(MemoryArenaTest, GeometricGrowth) {
+    MemoryArena arena;
+    memory_arena_init(&arena);
+
+    while (arena.num_blocks < 4) {
+        memory_arena_alloc(&arena, 1024);
+    }
+    MemoryBlock *block = arena.head;
+    for (usize i = 0; i < 3; ++i) {
+        ASSERT_EQ(block->next->size, block->size << 1);
+        block = block->next;
+    }
+    ASSERT_EQ(arena.current, arena.tail);
+
+    // Large blocks are mapped, and work the same.
+    u8 *data = (u8 *)memory_arena_alloc(&arena, 4 * 1024 * 1024);
+    data[0] = 1;
+    data[4 * 1024 * 1024 - 1] = 1;
+    ASSERT_GT(arena.tail->size, 4 * 1024 * 1024);
+    ASSERT_EQ(arena.current, arena.tail);
+
+    memory_arena_deinit(&arena);
+}
+
+TEST(MemoryReserveTest, GrowInPlace) {
+    MemoryReserve reserve;
+    memory_reserve_init(&reserve, 64 * 1024 * 1024);
+    ASSERT_EQ(reserve.size, 0);
+
+    memory_reserve_grow(&reserve, 1);
+    u8 *data = reserve.data;
+    ASSERT_GE(reserve.size, 1);
+    data[0] = 0xCC;
+
+    for (usize size = 2; size <= reserve.capacity; size <<= 1) {
+        memory_reserve_grow(&reserve, size);
+        ASSERT_GE(reserve.size, size);
+        ASSERT_LE(reserve.size, reserve.capacity);
+        reserve.data[size - 1] = 0xCC;
+    }
+    ASSERT_EQ(reserve.data, data);
+    ASSERT_EQ(data[0], 0xCC);
+
+    // Trimming keeps the current data.
+    memory_reserve_trim(&reserve);
+    ASSERT_EQ(reserve.data, data);
+    ASSERT_EQ(data[reserve.size - 1], 0xCC);
+
+    memory_reserve_deinit(&reserve);
+    ASSERT_EQ(reserve.data, nullptr);
+}
+
+TEST(MemoryArenaBumpTest, Adopt) {
+    MemoryArena dst;
+    memory_arena_init_bump(&dst);
+    MemoryArena src;
+    memory_arena_init_bump(&src);
+
+    // Adopting into an empty arena takes over the blocks.
+    u8 *a = (u8 *)memory_arena_alloc(&src, 16);
+    a[0] = 0xAA;
+    MemoryBlock *block = src.head;
+    memory_arena_adopt(&dst, &src);
+    ASSERT_EQ(dst.head, block);
+    ASSERT_EQ(dst.num_blocks, 1);
+    ASSERT_EQ(src.head, nullptr);
+    ASSERT_EQ(src.num_blocks, 0);
+
+    // Adopted blocks go before the current one, which keeps being filled.
+    u8 *b = (u8 *)memory_arena_alloc(&src, src.min_block_size);
+    b[0] = 0xBB;
+    memory_arena_alloc(&src, 1);
+    usize num_src_blocks = src.num_blocks;
+    MemoryBlock *current = dst.current;
+    memory_arena_adopt(&dst, &src);
+    ASSERT_EQ(dst.num_blocks, 1 + num_src_blocks);
+    ASSERT_EQ(dst.tail, current);
+    ASSERT_EQ(dst.current, current);
+    ASSERT_EQ(dst.head->prev, nullptr);
+    usize count = 0;
+    for (MemoryBlock *it = dst.head; it; it = it->next) {
+        count++;
+    }
+    ASSERT_EQ(count, dst.num_blocks);
+    u8 *c = (u8 *)memory_arena_alloc(&dst, 16);
+    ASSERT_EQ(c, a + 16);
+    ASSERT_EQ(a[0], 0xAA);
+    ASSERT_EQ(b[0], 0xBB);
+
+    memory_arena_deinit(&src);
+    memory_arena_deinit(&dst);
+}
@@ -0,0 +1,80 @@
+#include "src/parallel.h"
+
+#if !defined(__EMSCRIPTEN__) || defined(__EMSCRIPTEN_PTHREADS__)
+#define PARALLEL_HAS_THREADS 1
+#include <atomic>
+#include <thread>
+#endif
+
+usize parallel_get_num_threads() {
+#if PARALLEL_HAS_THREADS
+    usize num_threads = std::thread::hardware_concurrency();
+    return max(num_threads, (usize)1);
+#else
+    return 1;
+#endif
+}
+
+#if PARALLEL_HAS_THREADS
+struct ParallelFor {
+    std::atomic<usize> next;
+    usize count;
+    ParallelForThreadFn fn;
+    void *ctx;
+};
+
+static void run_parallel_for(ParallelFor *work, usize thread) {
+    while (true) {
+        usize index = work->next.fetch_add(1, std::memory_order_relaxed);
+        if (index >= work->count) {
+            break;
+        }
+        work->fn(work->ctx, thread, index);
+    }
+}
+#endif
+
+void parallel_for_thread(usize count, usize num_threads, ParallelForThreadFn fn,
+                         void *ctx) {
+#if PARALLEL_HAS_THREADS
+    num_threads = min(num_threads, count);
+    if (num_threads > 1) {
+        ParallelFor work;
+        work.next = 0;
+        work.count = count;
+        work.fn = fn;
+        work.ctx = ctx;
+
+        std::thread *threads = new std::thread[num_threads - 1];
+        for (usize i = 0; i < num_threads - 1; ++i) {
+            threads[i] = std::thread(run_parallel_for, &work, i + 1);
+        }
+        run_parallel_for(&work, 0);
+        for (usize i = 0; i < num_threads - 1; ++i) {
+            threads[i].join();
+        }
+        delete[] threads;
+        return;
+    }
+#endif
+
+    for (usize i = 0; i < count; ++i) {
+        fn(ctx, 0, i);
+    }
+}
+
+struct ParallelForCall {
+    ParallelForFn fn;
+    void *ctx;
+};
+
+static void call_without_thread(void *ctx, usize /*thread*/, usize index) {
+    ParallelForCall *call = (ParallelForCall *)ctx;
+    call->fn(call->ctx, index);
+}
+
+void parallel_for(usize count, usize num_threads, ParallelForFn fn,
+                  void *ctx) {
+    ParallelForCall call = {.fn = fn, .ctx = ctx};
+    parallel_for_thread(count, num_threads, call_without_thread, &call);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "src/defs.h"
+
+// Returns the number of threads that can run in parallel, at least 1. Always 1
+// if threads are not available (e.g. wasm built without pthreads).
+usize parallel_get_num_threads();
+
+typedef void (*ParallelForFn)(void *ctx, usize index);
+
+// Calls fn(ctx, index) for every index in [0, count) from up to `num_threads`
+// threads (including the calling thread). Indices are handed out in order, but
+// may finish in any order. Returns after all calls have finished.
+void parallel_for(usize count, usize num_threads, ParallelForFn fn, void *ctx);
+
+typedef void (*ParallelForThreadFn)(void *ctx, usize thread, usize index);
+
+// Same as parallel_for(), but also passes the index of the calling thread, in
+// [0, max(num_threads, 1)), so that each thread can have its own state such as
+// a MemoryArena.
+void parallel_for_thread(usize count, usize num_threads, ParallelForThreadFn fn,
+                         void *ctx);
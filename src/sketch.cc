@@ -0,0 +1,161 @@
+#include "src/sketch.h"
+
+#include <math.h>
+#include <memory.h>
+
+#include "src/memory.h"
+
+// Values in (gamma^(i - 1), gamma^i] go to bin i. The middle of the bin in
+// relative terms is within the accuracy of every value in it.
+static const f64 GAMMA =
+    (1 + SKETCH_RELATIVE_ACCURACY) / (1 - SKETCH_RELATIVE_ACCURACY);
+static const f64 INV_LOG_GAMMA = 1 / log(GAMMA);
+
+static const u32 INITIAL_BIN_COUNT = 16;
+
+static inline i32 get_index(u64 value) {
+    return (i32)ceil(log((f64)value) * INV_LOG_GAMMA);
+}
+
+static inline f64 get_value(i32 index) {
+    return 2 * pow(GAMMA, index) / (1 + GAMMA);
+}
+
+void sketch_deinit(Sketch *sketch) {
+    memory_free(sketch->bins);
+    *sketch = {};
+}
+
+// Returns the indices of the first and the last non-empty bins, or false if
+// all bins are empty.
+static bool get_used_range(Sketch *sketch, i32 *lo, i32 *hi) {
+    u32 first = 0;
+    while (first < sketch->num_bins && !sketch->bins[first]) {
+        first++;
+    }
+    if (first == sketch->num_bins) {
+        return false;
+    }
+    u32 last = sketch->num_bins - 1;
+    while (!sketch->bins[last]) {
+        last--;
+    }
+    *lo = sketch->offset + (i32)first;
+    *hi = sketch->offset + (i32)last;
+    return true;
+}
+
+// Makes the bins cover indices [lo, hi]. The bins grow geometrically towards
+// the new indices so that widening them one index at a time is cheap. If the
+// used indices would span more than SKETCH_MAX_BINS, the lowest ones are
+// collapsed into the first bin.
+static void reserve_bins(Sketch *sketch, i32 lo, i32 hi) {
+    i32 old_lo = sketch->offset;
+    if (sketch->num_bins && lo >= old_lo &&
+        hi < old_lo + (i32)sketch->num_bins) {
+        return;
+    }
+    bool grow_down = sketch->num_bins && lo < old_lo;
+    i32 used_lo, used_hi;
+    if (get_used_range(sketch, &used_lo, &used_hi)) {
+        lo = min(lo, used_lo);
+        hi = max(hi, used_hi);
+    }
+
+    u32 needed = (u32)(hi - lo + 1);
+    u32 size = min(max(max(needed, 2 * sketch->num_bins), INITIAL_BIN_COUNT),
+                   SKETCH_MAX_BINS);
+    i32 new_lo;
+    if (needed >= SKETCH_MAX_BINS) {
+        new_lo = hi - (i32)SKETCH_MAX_BINS + 1;
+    } else if (!sketch->num_bins) {
+        new_lo = lo - (i32)(size - needed) / 2;
+    } else if (grow_down) {
+        new_lo = hi - (i32)size + 1;
+    } else {
+        new_lo = lo;
+    }
+
+    u32 *bins = (u32 *)memory_calloc(size, sizeof(u32));
+    ASSERT(bins);
+    for (u32 i = 0; i < sketch->num_bins; ++i) {
+        if (sketch->bins[i]) {
+            i32 index = max(old_lo + (i32)i, new_lo);
+            bins[index - new_lo] += sketch->bins[i];
+        }
+    }
+    memory_free(sketch->bins);
+    sketch->bins = bins;
+    sketch->offset = new_lo;
+    sketch->num_bins = size;
+}
+
+static void add_min_max(Sketch *sketch, u64 min_value, u64 max_value) {
+    if (sketch->count) {
+        sketch->min = min(sketch->min, min_value);
+        sketch->max = max(sketch->max, max_value);
+    } else {
+        sketch->min = min_value;
+        sketch->max = max_value;
+    }
+}
+
+void sketch_add(Sketch *sketch, u64 value) {
+    add_min_max(sketch, value, value);
+    sketch->count++;
+    if (!value) {
+        sketch->zero_count++;
+        return;
+    }
+
+    // Once the used bins span the maximum, lower values are collapsed into
+    // the first bin.
+    i32 index = get_index(value);
+    bool full = sketch->num_bins == SKETCH_MAX_BINS &&
+                sketch->bins[SKETCH_MAX_BINS - 1];
+    if (!full || index >= sketch->offset) {
+        reserve_bins(sketch, index, index);
+    }
+    sketch->bins[max(index, sketch->offset) - sketch->offset]++;
+}
+
+void sketch_merge(Sketch *dst, Sketch *src) {
+    if (!src->count) {
+        return;
+    }
+    add_min_max(dst, src->min, src->max);
+    dst->count += src->count;
+    dst->zero_count += src->zero_count;
+    i32 lo, hi;
+    if (!get_used_range(src, &lo, &hi)) {
+        return;
+    }
+
+    reserve_bins(dst, lo, hi);
+    for (i32 i = lo; i <= hi; ++i) {
+        dst->bins[max(i, dst->offset) - dst->offset] +=
+            src->bins[i - src->offset];
+    }
+}
+
+u64 sketch_get_quantile(Sketch *sketch, f64 q) {
+    if (!sketch->count) {
+        return 0;
+    }
+    f64 rank = max(min(q, 1.0), 0.0) * (f64)(sketch->count - 1);
+    u64 count = sketch->zero_count;
+    if ((f64)count > rank) {
+        return sketch->min;
+    }
+    for (u32 i = 0; i < sketch->num_bins; ++i) {
+        count += sketch->bins[i];
+        if ((f64)count > rank) {
+            f64 value = get_value(sketch->offset + (i32)i);
+            if (value >= (f64)sketch->max) {
+                return sketch->max;
+            }
+            return max((u64)(value + 0.5), sketch->min);
+        }
+    }
+    return sketch->max;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "src/defs.h"
+
+// A DDSketch of non-negative integers: values are counted in bins whose width
+// grows exponentially, so that every quantile is estimated within
+// SKETCH_RELATIVE_ACCURACY of a value of the input. Sketches merge by adding
+// bins. The number of bins is bounded by SKETCH_MAX_BINS, enough for about 17
+// orders of magnitude. Past that the lowest bins are collapsed, which only
+// affects the accuracy of low quantiles.
+
+static const f64 SKETCH_RELATIVE_ACCURACY = 0.01;
+static const u32 SKETCH_MAX_BINS = 2048;
+
+struct Sketch {
+    // Including zeros.
+    u64 count;
+    u64 zero_count;
+    u64 min;
+    u64 max;
+    // bins[i] counts the values whose index is offset + i.
+    i32 offset;
+    u32 num_bins;
+    u32 *bins;
+};
+
+// A zero-initialized Sketch is empty.
+void sketch_deinit(Sketch *sketch);
+
+void sketch_add(Sketch *sketch, u64 value);
+
+// Adds all values of `src` to `dst`.
+void sketch_merge(Sketch *dst, Sketch *src);
+
+// Returns the estimated q-quantile, q in [0, 1], or 0 if the sketch is empty.
+u64 sketch_get_quantile(Sketch *sketch, f64 q);
@@ -0,0 +1,112 @@
+#include "src/sketch.h"
+
+#include <gtest/gtest.h>
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+static u64 next_random(u64 *seed) {
+    *seed = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return *seed >> 33;
+}
+
+// Returns values spread evenly over `decades` orders of magnitude.
+static std::vector<u64> generate_values(usize count, u32 decades, u64 seed) {
+    std::vector<u64> values;
+    for (usize i = 0; i < count; ++i) {
+        f64 x = (f64)(next_random(&seed) % 1000000) / 1000000 * decades;
+        values.push_back((u64)pow(10, x));
+    }
+    return values;
+}
+
+static void check_quantiles(Sketch *sketch, std::vector<u64> values) {
+    std::sort(values.begin(), values.end());
+    for (f64 q : {0.0, 0.01, 0.25, 0.5, 0.9, 0.99, 0.999, 1.0}) {
+        u64 expected = values[(usize)(q * (values.size() - 1))];
+        u64 actual = sketch_get_quantile(sketch, q);
+        f64 error = fabs((f64)actual - (f64)expected);
+        ASSERT_LE(error, SKETCH_RELATIVE_ACCURACY * expected + 1)
+            << "q = " << q << ", expected " << expected << ", actual "
+            << actual;
+    }
+}
+
+TEST(SketchTest, Empty) {
+    Sketch sketch = {};
+    ASSERT_EQ(sketch_get_quantile(&sketch, 0.5), 0);
+    Sketch other = {};
+    sketch_merge(&sketch, &other);
+    ASSERT_EQ(sketch.count, 0);
+    sketch_deinit(&sketch);
+}
+
+TEST(SketchTest, Zeros) {
+    Sketch sketch = {};
+    for (u64 i = 0; i < 10; ++i) {
+        sketch_add(&sketch, i < 6 ? 0 : 100);
+    }
+    ASSERT_EQ(sketch.count, 10);
+    ASSERT_EQ(sketch.zero_count, 6);
+    ASSERT_EQ(sketch_get_quantile(&sketch, 0.5), 0);
+    ASSERT_EQ(sketch_get_quantile(&sketch, 0.9), 100);
+    sketch_deinit(&sketch);
+}
+
+TEST(SketchTest, Accuracy) {
+    std::vector<u64> values = generate_values(100000, 9, 1);
+    Sketch sketch = {};
+    for (u64 value : values) {
+        sketch_add(&sketch, value);
+    }
+    ASSERT_EQ(sketch.min, *std::min_element(values.begin(), values.end()));
+    ASSERT_EQ(sketch.max, *std::max_element(values.begin(), values.end()));
+    check_quantiles(&sketch, values);
+    sketch_deinit(&sketch);
+}
+
+TEST(SketchTest, Merge) {
+    std::vector<u64> all;
+    Sketch merged = {};
+    for (u64 part = 0; part < 8; ++part) {
+        // Parts cover different ranges so that merging has to widen the bins
+        // in both directions.
+        std::vector<u64> values = generate_values(5000, 3, part + 2);
+        Sketch sketch = {};
+        for (u64 &value : values) {
+            value = value * (part % 2 ? 1000 : 1) + part;
+            sketch_add(&sketch, value);
+            all.push_back(value);
+        }
+        sketch_merge(&merged, &sketch);
+        sketch_deinit(&sketch);
+    }
+    ASSERT_EQ(merged.count, all.size());
+    check_quantiles(&merged, all);
+    sketch_deinit(&merged);
+}
+
+TEST(SketchTest, BoundedBins) {
+    Sketch sketch = {};
+    std::vector<u64> values;
+    u64 seed = 3;
+    for (usize i = 0; i < 100000; ++i) {
+        u64 value = (next_random(&seed) << (i % 34)) >> (i % 3 * 15);
+        sketch_add(&sketch, value);
+        values.push_back(value);
+    }
+    ASSERT_LE(sketch.num_bins, SKETCH_MAX_BINS);
+
+    // Only the lowest bins are collapsed.
+    std::sort(values.begin(), values.end());
+    for (f64 q : {0.5, 0.9, 0.99, 1.0}) {
+        u64 expected = values[(usize)(q * (values.size() - 1))];
+        u64 actual = sketch_get_quantile(&sketch, q);
+        ASSERT_LE(fabs((f64)actual - (f64)expected),
+                  SKETCH_RELATIVE_ACCURACY * expected + 1)
+            << "q = " << q;
+    }
+    sketch_deinit(&sketch);
+}
@@ -0,0 +1,2464 @@
+#include "src/trace.h"
+
+#include <memory.h>
+
+#include <algorithm>
+
+#include "src/lz.h"
+#include "src/parallel.h"
+
+// Columns are allocated from big blocks to keep the per-block waste of the
+// arena small compared to the size of a chunk.
+static const usize TRACE_ARENA_BLOCK_SIZE = 16 * 1024 * 1024;
+// Thread arenas only hold index data, their blocks grow from this.
+static const usize THREAD_ARENA_BLOCK_SIZE = 1024 * 1024;
+// Event and slice ids are 32-bit.
+static const usize MAX_CHUNKS = (usize)1 << (32 - TRACE_EVENT_CHUNK_SHIFT);
+// Raw blocks are compressed independently, so they need to be big enough for
+// the compressor to find repetitions, but every decode of a compressed block
+// pays for all of it.
+static const usize TRACE_RAW_BLOCK_SIZE = 256 * 1024;
+static const usize INITIAL_RAW_BLOCK_CAPACITY = 64;
+// Slices per leaf of TraceTrack::dur_ranges. Queries scan up to a block on
+// each side of the range.
+static const u32 NAME_BLOCK_SHIFT = 3;
+static const u32 NAME_BLOCK_SIZE = 1 << NAME_BLOCK_SHIFT;
+static const usize INITIAL_TRACK_CAPACITY = 64;
+static const usize INITIAL_STACK_CAPACITY = 16;
+static const usize INITIAL_COUNTER_CAPACITY = 16;
+static const u32 INITIAL_SAMPLE_CAPACITY = 64;
+static const usize INITIAL_LINK_POINT_CAPACITY = 64;
+
+void trace_init(Trace *trace) {
+    *trace = {};
+    memory_arena_init_bump(&trace->arena);
+    trace->arena.min_block_size = TRACE_ARENA_BLOCK_SIZE;
+    memory_reserve_init(&trace->chunk_table,
+                        MAX_CHUNKS * sizeof(TraceEventChunk));
+    memory_reserve_init(&trace->slice_chunk_table,
+                        MAX_CHUNKS * sizeof(TraceSliceChunk));
+    intern_table_init(&trace->strings, &trace->arena);
+}
+
+void trace_deinit(Trace *trace) {
+    for (usize i = 0; i < trace->num_tracks; ++i) {
+        memory_free(trace->tracks[i].open);
+        memory_free(trace->tracks[i].x_ends);
+    }
+    for (usize i = 0; i < trace->num_counters; ++i) {
+        memory_free(trace->counters[i].ts);
+        memory_free(trace->counters[i].values);
+    }
+    for (usize i = 0; i < trace->num_duration_sketches; ++i) {
+        sketch_deinit(&trace->duration_sketches[i]);
+    }
+    memory_free(trace->duration_sketches);
+    trigram_index_deinit(&trace->name_trigrams);
+    memory_free(trace->link_points);
+    memory_free(trace->range_ends);
+    memory_free(trace->slice_carries);
+    memory_reserve_deinit(&trace->slice_chunk_table);
+    memory_reserve_deinit(&trace->chunk_table);
+    memory_arena_deinit(&trace->arena);
+    memory_free(trace->raw.current);
+    mapped_file_close(&trace->file);
+    *trace = {};
+}
+
+void trace_set_file(Trace *trace, MappedFile file) {
+    ASSERT(!trace->file.data.data);
+    trace->file = file;
+    trace->strings.source = file.data;
+}
+
+// Returns a copy of `table` with twice the capacity. The old table is left in
+// the arena instead of being freed so that pointers to it stay valid until the
+// trace is destroyed.
+static void *grow_table(Trace *trace, void *table, usize count,
+                        usize *capacity, usize entry_size,
+                        usize initial_capacity) {
+    usize new_capacity = max(*capacity << 1, initial_capacity);
+    void *new_table =
+        memory_arena_alloc(&trace->arena, new_capacity * entry_size);
+    if (count) {
+        memcpy(new_table, table, count * entry_size);
+    }
+    *capacity = new_capacity;
+    return new_table;
+}
+
+// Builders that run on multiple threads allocate from one arena per thread,
+// which are adopted into the arena of the trace at the end.
+static MemoryArena *init_thread_arenas(usize num_threads) {
+    usize n = max(num_threads, (usize)1);
+    MemoryArena *arenas = (MemoryArena *)memory_alloc(n * sizeof(MemoryArena));
+    ASSERT(arenas);
+    for (usize i = 0; i < n; ++i) {
+        memory_arena_init_bump(&arenas[i]);
+        arenas[i].min_block_size = THREAD_ARENA_BLOCK_SIZE;
+    }
+    return arenas;
+}
+
+static void adopt_thread_arenas(Trace *trace, MemoryArena *arenas,
+                                usize num_threads) {
+    for (usize i = 0; i < max(num_threads, (usize)1); ++i) {
+        memory_arena_adopt(&trace->arena, &arenas[i]);
+        memory_arena_deinit(&arenas[i]);
+    }
+    memory_free(arenas);
+}
+
+static void push_chunk(Trace *trace) {
+    memory_reserve_grow(&trace->chunk_table,
+                        (trace->num_chunks + 1) * sizeof(TraceEventChunk));
+    trace->chunks = (TraceEventChunk *)trace->chunk_table.data;
+
+    // All columns of a chunk share one allocation, widest column first so
+    // that every column is naturally aligned.
+    usize n = TRACE_EVENT_CHUNK_SIZE;
+    usize size = n * (4 * sizeof(u64) + 5 * sizeof(u32) + sizeof(u8));
+    u8 *data = (u8 *)memory_arena_alloc(&trace->arena, size);
+
+    TraceEventChunk *chunk = &trace->chunks[trace->num_chunks++];
+    chunk->ts = (u64 *)data;
+    chunk->dur = chunk->ts + n;
+    chunk->tdur = chunk->dur + n;
+    chunk->raw = chunk->tdur + n;
+    chunk->pid = (u32 *)(chunk->raw + n);
+    chunk->tid = chunk->pid + n;
+    chunk->name = chunk->tid + n;
+    chunk->cat = chunk->name + n;
+    chunk->raw_size = chunk->cat + n;
+    chunk->ph = (u8 *)(chunk->raw_size + n);
+}
+
+// Returns the chunk that the next event goes to, and its offset in the chunk.
+static TraceEventChunk *get_tail_chunk(Trace *trace, usize *offset) {
+    *offset = trace->num_events & TRACE_EVENT_CHUNK_MASK;
+    if (*offset == 0) {
+        push_chunk(trace);
+    }
+    return &trace->chunks[trace->num_chunks - 1];
+}
+
+static void push_slice_chunk(Trace *trace) {
+    memory_reserve_grow(&trace->slice_chunk_table,
+                        (trace->num_slice_chunks + 1) *
+                            sizeof(TraceSliceChunk));
+    trace->slice_chunks = (TraceSliceChunk *)trace->slice_chunk_table.data;
+
+    usize n = TRACE_EVENT_CHUNK_SIZE;
+    usize size = n * (2 * sizeof(u64) + 4 * sizeof(u32));
+    u8 *data = (u8 *)memory_arena_alloc(&trace->arena, size);
+
+    TraceSliceChunk *chunk = &trace->slice_chunks[trace->num_slice_chunks++];
+    chunk->ts = (u64 *)data;
+    chunk->dur = chunk->ts + n;
+    chunk->name = (u32 *)(chunk->dur + n);
+    chunk->track = chunk->name + n;
+    chunk->depth = chunk->track + n;
+    chunk->event = chunk->depth + n;
+}
+
+static void push_slice(Trace *trace, TraceSlice *slice) {
+    usize offset = trace->num_slices & TRACE_EVENT_CHUNK_MASK;
+    if (offset == 0) {
+        push_slice_chunk(trace);
+    }
+    TraceSliceChunk *chunk = &trace->slice_chunks[trace->num_slice_chunks - 1];
+    chunk->ts[offset] = slice->ts;
+    chunk->dur[offset] = slice->dur;
+    chunk->name[offset] = slice->name;
+    chunk->track[offset] = slice->track;
+    chunk->depth[offset] = slice->depth;
+    chunk->event[offset] = slice->event;
+    trace->num_slices++;
+}
+
+TraceSlice trace_get_slice(Trace *trace, usize index) {
+    usize offset;
+    TraceSliceChunk *chunk = trace_get_slice_chunk(trace, index, &offset);
+    return TraceSlice{
+        .ts = chunk->ts[offset],
+        .dur = chunk->dur[offset],
+        .name = chunk->name[offset],
+        .track = chunk->track[offset],
+        .depth = chunk->depth[offset],
+        .event = chunk->event[offset],
+    };
+}
+
+static inline u64 track_hash(u32 pid, u32 tid) {
+    u64 x = ((u64)pid << 32) | tid;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static void insert_slot(u32 *slots, usize mask, u64 hash, u32 id) {
+    usize index = hash & mask;
+    while (slots[index]) {
+        index = (index + 1) & mask;
+    }
+    slots[index] = id + 1;
+}
+
+// Returns a new empty hash table for `capacity` entries. The load factor is
+// kept at or below 50%.
+static u32 *alloc_slots(Trace *trace, usize capacity, usize *mask) {
+    usize num_slots = capacity << 1;
+    *mask = num_slots - 1;
+    return (u32 *)memory_arena_calloc(&trace->arena, num_slots, sizeof(u32));
+}
+
+static void grow_tracks(Trace *trace) {
+    trace->tracks = (TraceTrack *)grow_table(
+        trace, trace->tracks, trace->num_tracks, &trace->track_capacity,
+        sizeof(TraceTrack), INITIAL_TRACK_CAPACITY);
+
+    trace->track_slots =
+        alloc_slots(trace, trace->track_capacity, &trace->track_slot_mask);
+    for (usize id = 0; id < trace->num_tracks; ++id) {
+        TraceTrack *track = &trace->tracks[id];
+        insert_slot(trace->track_slots, trace->track_slot_mask,
+                    track_hash(track->pid, track->tid), (u32)id);
+    }
+}
+
+void trace_index_names(Trace *trace) {
+    for (; trace->num_indexed_names < trace->strings.count;
+         ++trace->num_indexed_names) {
+        u32 id = trace->num_indexed_names;
+        trigram_index_add(&trace->name_trigrams, id,
+                          trace_get_string(trace, id));
+    }
+}
+
+static inline u8 to_lower(u8 ch) {
+    return ch >= 'A' && ch <= 'Z' ? ch | 0x20 : ch;
+}
+
+static bool contains(Buf str, Buf query, bool ignore_case) {
+    for (usize i = 0; i + query.size <= str.size; ++i) {
+        usize j = 0;
+        if (ignore_case) {
+            while (j < query.size &&
+                   to_lower(str.data[i + j]) == to_lower(query.data[j])) {
+                j++;
+            }
+        } else {
+            while (j < query.size && str.data[i + j] == query.data[j]) {
+                j++;
+            }
+        }
+        if (j == query.size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void trace_search_begin(Trace *trace, Buf query, bool ignore_case,
+                        TraceSearch *search) {
+    *search = {};
+    u32 *candidates;
+    u32 num_candidates;
+    if (query.size >= 3) {
+        trace_index_names(trace);
+        num_candidates =
+            trigram_index_query(&trace->name_trigrams, query, &candidates);
+    } else {
+        // Too short for trigrams, check every name.
+        num_candidates = trace->num_sliced_names;
+        candidates = (u32 *)memory_alloc(num_candidates * sizeof(u32));
+        ASSERT(candidates || !num_candidates);
+        for (u32 i = 0; i < num_candidates; ++i) {
+            candidates[i] = i;
+        }
+    }
+
+    // Keep the names that have slices and really contain the query.
+    for (u32 i = 0; i < num_candidates; ++i) {
+        u32 name = candidates[i];
+        if (name < trace->num_sliced_names &&
+            trace->name_slice_offsets[name] !=
+                trace->name_slice_offsets[name + 1] &&
+            contains(trace_get_string(trace, name), query, ignore_case)) {
+            candidates[search->num_names++] = name;
+        }
+    }
+    search->names = candidates;
+}
+
+u32 trace_search_next(Trace *trace, TraceSearch *search, u32 *slices,
+                      u32 max_count) {
+    u32 count = 0;
+    while (count < max_count && search->name_index < search->num_names) {
+        u32 name = search->names[search->name_index];
+        u32 begin = trace->name_slice_offsets[name] + search->offset;
+        u32 end = trace->name_slice_offsets[name + 1];
+        u32 n = min(end - begin, max_count - count);
+        memcpy(slices + count, trace->name_slices + begin, n * sizeof(u32));
+        count += n;
+        search->offset += n;
+        if (begin + n == end) {
+            search->name_index++;
+            search->offset = 0;
+        }
+    }
+    return count;
+}
+
+void trace_search_end(TraceSearch *search) {
+    memory_free(search->names);
+    *search = {};
+}
+
+bool trace_find_track(Trace *trace, u32 pid, u32 tid, u32 *id) {
+    if (!trace->track_slots) {
+        return false;
+    }
+    usize index = track_hash(pid, tid) & trace->track_slot_mask;
+    while (u32 slot = trace->track_slots[index]) {
+        TraceTrack *track = &trace->tracks[slot - 1];
+        if (track->pid == pid && track->tid == tid) {
+            *id = slot - 1;
+            return true;
+        }
+        index = (index + 1) & trace->track_slot_mask;
+    }
+    return false;
+}
+
+static u32 get_or_add_track(Trace *trace, u32 pid, u32 tid) {
+    u32 id;
+    if (trace_find_track(trace, pid, tid, &id)) {
+        return id;
+    }
+
+    if (trace->num_tracks == trace->track_capacity) {
+        grow_tracks(trace);
+    }
+    id = (u32)trace->num_tracks++;
+    trace->tracks[id] = {.pid = pid, .tid = tid};
+    insert_slot(trace->track_slots, trace->track_slot_mask,
+                track_hash(pid, tid), id);
+    return id;
+}
+
+// Makes room for one more entry in a stack of a track.
+template <typename T>
+static void reserve_stack(T **items, u32 count, u32 *capacity) {
+    if (count == *capacity) {
+        *capacity = max(*capacity << 1, (u32)INITIAL_STACK_CAPACITY);
+        *items = (T *)memory_realloc(*items, *capacity * sizeof(T));
+        ASSERT(*items);
+    }
+}
+
+static Sketch *get_duration_sketch(Trace *trace, u32 name) {
+    if (name >= trace->num_duration_sketches) {
+        usize count = max((usize)name + 1, trace->num_duration_sketches * 2);
+        trace->duration_sketches = (Sketch *)memory_realloc(
+            trace->duration_sketches, count * sizeof(Sketch));
+        ASSERT(trace->duration_sketches);
+        memset(trace->duration_sketches + trace->num_duration_sketches, 0,
+               (count - trace->num_duration_sketches) * sizeof(Sketch));
+        trace->num_duration_sketches = count;
+    }
+    return &trace->duration_sketches[name];
+}
+
+static void add_duration(Trace *trace, u32 name, u64 dur) {
+    sketch_add(get_duration_sketch(trace, name), dur);
+}
+
+Sketch *trace_get_duration_sketch(Trace *trace, u32 name) {
+    if (name >= trace->num_duration_sketches ||
+        !trace->duration_sketches[name].count) {
+        return 0;
+    }
+    return &trace->duration_sketches[name];
+}
+
+// Pops the 'X' slices of the track that end before `ts`, and returns the
+// depth of a slice that starts at `ts`.
+static u32 get_depth_at(TraceTrack *track, u64 ts) {
+    while (track->num_x_ends && track->x_ends[track->num_x_ends - 1] <= ts) {
+        track->num_x_ends--;
+    }
+    if (!track->num_x_ends) {
+        track->carry.x_pop_ts =
+            track->carry.x_popped ? max(track->carry.x_pop_ts, ts) : ts;
+        track->carry.x_popped = true;
+    }
+    return track->num_open + track->num_x_ends;
+}
+
+// Records where the last pushed slice of a range trace starts.
+static void push_slice_carry(Trace *trace, TraceRangeCarry carry) {
+    usize index = trace->num_slices - 1;
+    if (index == trace->slice_carry_capacity) {
+        trace->slice_carry_capacity =
+            max(trace->slice_carry_capacity << 1, TRACE_EVENT_CHUNK_SIZE);
+        trace->slice_carries = (TraceRangeCarry *)memory_realloc(
+            trace->slice_carries,
+            trace->slice_carry_capacity * sizeof(TraceRangeCarry));
+        ASSERT(trace->slice_carries);
+    }
+    trace->slice_carries[index] = carry;
+}
+
+// Builds slices incrementally from the event at `index`: 'X' events become
+// slices right away, 'B' events are pushed to the stack of their track and
+// become slices when the matching 'E' pops them. The durations of 'X' events
+// are sketched when they are pushed, those of 'B' events when they are
+// paired.
+static void add_slice(Trace *trace, usize index, u8 ph, u64 ts, u64 dur,
+                      u32 name, u32 pid, u32 tid) {
+    trace->end_ts = max(trace->end_ts, ts + dur);
+    switch (ph) {
+        case 'X': {
+            u32 track_id = get_or_add_track(trace, pid, tid);
+            TraceTrack *track = &trace->tracks[track_id];
+            TraceSlice slice = {
+                .ts = ts,
+                .dur = dur,
+                .name = name,
+                .track = track_id,
+                .depth = get_depth_at(track, ts),
+                .event = (u32)index,
+            };
+            push_slice(trace, &slice);
+            if (trace->is_range) {
+                push_slice_carry(trace, track->carry);
+            }
+            reserve_stack(&track->x_ends, track->num_x_ends,
+                          &track->x_end_capacity);
+            track->x_ends[track->num_x_ends++] = ts + dur;
+        } break;
+
+        case 'B': {
+            u32 track_id = get_or_add_track(trace, pid, tid);
+            TraceTrack *track = &trace->tracks[track_id];
+            u32 depth = get_depth_at(track, ts);
+            reserve_stack(&track->open, track->num_open,
+                          &track->open_capacity);
+            track->open[track->num_open++] = {
+                .ts = ts,
+                .name = name,
+                .event = (u32)index,
+                .depth = depth,
+                .carry = track->carry,
+            };
+        } break;
+
+        case 'E': {
+            u32 track_id = get_or_add_track(trace, pid, tid);
+            TraceTrack *track = &trace->tracks[track_id];
+            if (track->num_open) {
+                TraceOpenSlice *open = &track->open[--track->num_open];
+                TraceSlice slice = {
+                    .ts = open->ts,
+                    .dur = max(ts, open->ts) - open->ts,
+                    .name = open->name,
+                    .track = track_id,
+                    .depth = open->depth,
+                    .event = open->event,
+                };
+                push_slice(trace, &slice);
+                add_duration(trace, slice.name, slice.dur);
+                if (trace->is_range) {
+                    push_slice_carry(trace, open->carry);
+                }
+            } else if (trace->is_range) {
+                // Keeps the place of the slice, its ts is the one of the 'E'.
+                TraceSlice slice = {
+                    .ts = ts,
+                    .track = track_id,
+                    .event = (u32)index,
+                };
+                push_slice(trace, &slice);
+                push_slice_carry(trace, track->carry);
+                reserve_stack(&trace->range_ends, trace->num_range_ends,
+                              &trace->range_end_capacity);
+                trace->range_ends[trace->num_range_ends++] =
+                    (u32)(trace->num_slices - 1);
+                track->carry.num_unmatched_ends++;
+            }
+            // Otherwise an 'E' without a 'B' is dropped.
+        } break;
+
+        default: {
+        } break;
+    }
+}
+
+// A slice of the track being indexed.
+struct IndexItem {
+    u64 start;
+    u64 end;
+    u32 slice;
+    u32 event;
+    u32 depth;
+};
+
+// Parents sort before their children: by start time, then longest first, then
+// in event order for slices with the same span.
+static bool index_item_less(const IndexItem &a, const IndexItem &b) {
+    if (a.start != b.start) {
+        return a.start < b.start;
+    }
+    if (a.end != b.end) {
+        return a.end > b.end;
+    }
+    return a.event < b.event;
+}
+
+static void build_track_index(Trace *trace, TraceTrack *track,
+                              IndexItem *items, u64 *stack) {
+    u32 n = track->num_slices;
+    std::sort(items, items + n, index_item_less);
+
+    // Recompute depths with a sweep, the slices that contain the current one
+    // are on the stack.
+    u32 stack_size = 0;
+    u32 num_depths = 0;
+    for (u32 i = 0; i < n; ++i) {
+        IndexItem *item = &items[i];
+        while (stack_size && stack[stack_size - 1] <= item->start) {
+            stack_size--;
+        }
+        item->depth = stack_size;
+        stack[stack_size++] = item->end;
+        num_depths = max(num_depths, stack_size);
+
+        usize offset;
+        TraceSliceChunk *chunk =
+            trace_get_slice_chunk(trace, item->slice, &offset);
+        chunk->depth[offset] = item->depth;
+    }
+
+    // All columns share one allocation, widest first.
+    usize size = n * (2 * sizeof(u64) + sizeof(u32)) +
+                 (num_depths + 1) * sizeof(u32);
+    u8 *data = (u8 *)memory_arena_alloc(&trace->arena, size);
+    track->starts = (u64 *)data;
+    track->ends = track->starts + n;
+    track->slices = (u32 *)(track->ends + n);
+    track->depth_offsets = track->slices + n;
+    track->num_depths = num_depths;
+    memset(track->depth_offsets, 0, (num_depths + 1) * sizeof(u32));
+
+    // Counting sort by depth keeps the order of start times within a depth.
+    for (u32 i = 0; i < n; ++i) {
+        track->depth_offsets[items[i].depth + 1]++;
+    }
+    for (u32 d = 0; d < num_depths; ++d) {
+        track->depth_offsets[d + 1] += track->depth_offsets[d];
+    }
+
+    // Use the stack as the write cursor of each depth.
+    u32 *cursors = (u32 *)stack;
+    memcpy(cursors, track->depth_offsets, num_depths * sizeof(u32));
+    for (u32 i = 0; i < n; ++i) {
+        u32 pos = cursors[items[i].depth]++;
+        track->slices[pos] = items[i].slice;
+        track->starts[pos] = items[i].start;
+        track->ends[pos] = items[i].end;
+    }
+}
+
+static void build_slice_index(Trace *trace) {
+    if (!trace->num_slices) {
+        return;
+    }
+
+    for (usize i = 0; i < trace->num_slices; ++i) {
+        usize offset;
+        TraceSliceChunk *chunk = trace_get_slice_chunk(trace, i, &offset);
+        trace->tracks[chunk->track[offset]].num_slices++;
+    }
+
+    // Group the slices by track, then index one track at a time so that only
+    // the largest track needs temporary space for its slices.
+    u32 *cursors = (u32 *)memory_alloc(trace->num_tracks * sizeof(u32));
+    u32 *slices = (u32 *)memory_alloc(trace->num_slices * sizeof(u32));
+    ASSERT(cursors && slices);
+    u32 max_slices = 0;
+    u32 start = 0;
+    for (usize i = 0; i < trace->num_tracks; ++i) {
+        cursors[i] = start;
+        start += trace->tracks[i].num_slices;
+        max_slices = max(max_slices, trace->tracks[i].num_slices);
+    }
+    for (usize i = 0; i < trace->num_slices; ++i) {
+        usize offset;
+        TraceSliceChunk *chunk = trace_get_slice_chunk(trace, i, &offset);
+        slices[cursors[chunk->track[offset]]++] = (u32)i;
+    }
+
+    IndexItem *items =
+        (IndexItem *)memory_alloc(max_slices * sizeof(IndexItem));
+    u64 *stack = (u64 *)memory_alloc(max_slices * sizeof(u64));
+    ASSERT(items && stack);
+    start = 0;
+    for (usize i = 0; i < trace->num_tracks; ++i) {
+        TraceTrack *track = &trace->tracks[i];
+        if (!track->num_slices) {
+            continue;
+        }
+        for (u32 j = 0; j < track->num_slices; ++j) {
+            usize offset;
+            u32 slice = slices[start + j];
+            TraceSliceChunk *chunk =
+                trace_get_slice_chunk(trace, slice, &offset);
+            items[j] = {
+                .start = chunk->ts[offset],
+                .end = chunk->ts[offset] + chunk->dur[offset],
+                .slice = slice,
+                .event = chunk->event[offset],
+            };
+        }
+        build_track_index(trace, track, items, stack);
+        start += track->num_slices;
+    }
+
+    memory_free(stack);
+    memory_free(items);
+    memory_free(slices);
+    memory_free(cursors);
+}
+
+TraceRange trace_track_query(TraceTrack *track, u32 depth, u64 t0, u64 t1) {
+    if (depth >= track->num_depths) {
+        return {};
+    }
+    u32 first = track->depth_offsets[depth];
+    u32 last = track->depth_offsets[depth + 1];
+    // The first slice that ends at or after t0 and the first one that starts
+    // after t1.
+    u64 *end = std::lower_bound(track->ends + first, track->ends + last, t0);
+    u64 *start =
+        std::upper_bound(track->starts + first, track->starts + last, t1);
+    TraceRange range = {
+        .begin = (u32)(end - track->ends),
+        .end = (u32)(start - track->starts),
+    };
+    range.end = max(range.begin, range.end);
+    return range;
+}
+
+// The finest level has about this many slices per bucket. Below that, walking
+// the slices is as cheap as walking the buckets.
+static const u32 LOD_SLICES_PER_BUCKET = 4;
+
+// Returns the index of the last bucket that slice [start, end) overlaps.
+static inline u64 get_last_bucket(u64 start, u64 end, u32 shift) {
+    return (end > start ? end - 1 : start) >> shift;
+}
+
+static inline u64 get_overlap(u64 start, u64 end, u64 bucket_start,
+                              u64 bucket_end) {
+    u64 overlap_start = max(start, bucket_start);
+    u64 overlap_end = min(end, bucket_end);
+    return overlap_end > overlap_start ? overlap_end - overlap_start : 0;
+}
+
+// Allocates the levels of the pyramid of slices [first, last) of the track.
+static void alloc_lod(MemoryArena *arena, TraceTrack *track, TraceLod *lod,
+                      u32 first, u32 last) {
+    u64 start = track->starts[first];
+    u64 end = track->ends[last - 1];
+    u64 max_buckets = max((last - first) / LOD_SLICES_PER_BUCKET, 1u);
+    u32 shift = 0;
+    while (shift < 63 &&
+           get_last_bucket(start, end, shift) - (start >> shift) >=
+               max_buckets) {
+        shift++;
+    }
+    u32 num_levels = 1;
+    for (u32 s = shift; s < 63; ++s) {
+        if ((start >> s) == get_last_bucket(start, end, s)) {
+            break;
+        }
+        num_levels++;
+    }
+
+    lod->num_levels = num_levels;
+    lod->levels = (TraceLodLevel *)memory_arena_alloc(
+        arena, num_levels * sizeof(TraceLodLevel));
+    for (u32 i = 0; i < num_levels; ++i) {
+        TraceLodLevel *level = &lod->levels[i];
+        level->shift = shift + i;
+        level->first_bucket = start >> level->shift;
+        level->num_buckets =
+            (u32)(get_last_bucket(start, end, level->shift) -
+                  level->first_bucket + 1);
+        level->buckets = (TraceLodBucket *)memory_arena_calloc(
+            arena, level->num_buckets, sizeof(TraceLodBucket));
+    }
+}
+
+static u64 get_bucket_overlap(TraceTrack *track, TraceLodLevel *level,
+                              usize bucket, u32 pos) {
+    u64 bucket_start = (level->first_bucket + bucket) << level->shift;
+    u64 bucket_end = bucket_start + (1ULL << level->shift);
+    return get_overlap(track->starts[pos], track->ends[pos], bucket_start,
+                       bucket_end);
+}
+
+static void fill_lod(TraceTrack *track, TraceLod *lod, u32 first, u32 last) {
+    TraceLodLevel *level = &lod->levels[0];
+    for (u32 pos = first; pos < last; ++pos) {
+        u64 start = track->starts[pos];
+        u64 end = track->ends[pos];
+        usize begin = (start >> level->shift) - level->first_bucket;
+        usize stop =
+            get_last_bucket(start, end, level->shift) - level->first_bucket;
+        for (usize i = begin; i <= stop; ++i) {
+            TraceLodBucket *bucket = &level->buckets[i];
+            u64 overlap = get_bucket_overlap(track, level, i, pos);
+            if (!bucket->count) {
+                bucket->first = pos;
+                bucket->busiest = pos;
+            } else if (overlap >
+                       get_bucket_overlap(track, level, i, bucket->busiest)) {
+                bucket->busiest = pos;
+            }
+            bucket->count++;
+            bucket->coverage += overlap;
+        }
+    }
+
+    // Slices at a depth don't overlap, so at most one slice is in both
+    // children of a bucket: the last one of the left child if it is also the
+    // first one of the right child.
+    for (u32 l = 1; l < lod->num_levels; ++l) {
+        TraceLodLevel *child = &lod->levels[l - 1];
+        TraceLodLevel *parent = &lod->levels[l];
+        for (usize i = 0; i < parent->num_buckets; ++i) {
+            TraceLodBucket *bucket = &parent->buckets[i];
+            u64 left = ((parent->first_bucket + i) << 1) - child->first_bucket;
+            for (u64 k = 0; k < 2; ++k) {
+                // The first child may be before the first bucket (and wrap
+                // around), and the second one after the last.
+                u64 c = left + k;
+                if (c < child->num_buckets) {
+                    TraceLodBucket *from = &child->buckets[c];
+                    if (!from->count) {
+                        continue;
+                    }
+                    if (!bucket->count) {
+                        *bucket = *from;
+                        continue;
+                    }
+                    u32 shared =
+                        bucket->first + bucket->count == from->first + 1;
+                    bucket->count += from->count - shared;
+                    bucket->coverage += from->coverage;
+                    u32 candidates[] = {from->busiest, from->first};
+                    for (u32 pos : candidates) {
+                        if (get_bucket_overlap(track, parent, i, pos) >
+                            get_bucket_overlap(track, parent, i,
+                                               bucket->busiest)) {
+                            bucket->busiest = pos;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+struct LodWork {
+    Trace *trace;
+    MemoryArena *arenas;
+};
+
+static void build_track_lod(void *ctx, usize thread, usize index) {
+    LodWork *work = (LodWork *)ctx;
+    MemoryArena *arena = &work->arenas[thread];
+    TraceTrack *track = &work->trace->tracks[index];
+    if (!track->num_depths) {
+        return;
+    }
+    track->lods = (TraceLod *)memory_arena_alloc(
+        arena, track->num_depths * sizeof(TraceLod));
+    for (u32 depth = 0; depth < track->num_depths; ++depth) {
+        TraceLod *lod = &track->lods[depth];
+        u32 first = track->depth_offsets[depth];
+        u32 last = track->depth_offsets[depth + 1];
+        alloc_lod(arena, track, lod, first, last);
+        fill_lod(track, lod, first, last);
+    }
+}
+
+void trace_build_lod(Trace *trace, usize num_threads) {
+    LodWork work = {
+        .trace = trace,
+        .arenas = init_thread_arenas(num_threads),
+    };
+    parallel_for_thread(trace->num_tracks, num_threads, build_track_lod,
+                        &work);
+    adopt_thread_arenas(trace, work.arenas, num_threads);
+}
+
+TraceLodLevel *trace_lod_get_level(TraceLod *lod, u64 width) {
+    TraceLodLevel *result = 0;
+    for (u32 i = 0; i < lod->num_levels; ++i) {
+        if ((1ULL << lod->levels[i].shift) > width) {
+            break;
+        }
+        result = &lod->levels[i];
+    }
+    return result;
+}
+
+static void merge_dur_range(TraceDurRange *dst, u64 min_dur, u64 max_dur) {
+    dst->min = min(dst->min, min_dur);
+    dst->max = max(dst->max, max_dur);
+}
+
+static void merge_name_stats(TraceNameStats *dst, TraceNameStats *src) {
+    if (!src->count) {
+        return;
+    }
+    if (!dst->count) {
+        *dst = *src;
+        return;
+    }
+    dst->count += src->count;
+    dst->total_dur += src->total_dur;
+    dst->self_dur += src->self_dur;
+    dst->min_dur = min(dst->min_dur, src->min_dur);
+    dst->max_dur = max(dst->max_dur, src->max_dur);
+}
+
+struct NameItem {
+    u32 name;
+    u32 index;
+    u64 start;
+};
+
+static bool name_item_less(const NameItem &a, const NameItem &b) {
+    if (a.name != b.name) {
+        return a.name < b.name;
+    }
+    if (a.start != b.start) {
+        return a.start < b.start;
+    }
+    return a.index < b.index;
+}
+
+// Sorts items by name with a stable LSD radix sort, one byte per pass. Returns
+// either `items` or `temp`, whichever holds the result.
+static NameItem *radix_sort_by_name(NameItem *items, NameItem *temp, u32 n,
+                                    u32 max_name) {
+    for (u32 shift = 0; shift < 32 && (max_name >> shift); shift += 8) {
+        u32 offsets[257] = {};
+        for (u32 i = 0; i < n; ++i) {
+            offsets[((items[i].name >> shift) & 0xFF) + 1]++;
+        }
+        for (u32 i = 1; i <= 256; ++i) {
+            offsets[i] += offsets[i - 1];
+        }
+        for (u32 i = 0; i < n; ++i) {
+            temp[offsets[(items[i].name >> shift) & 0xFF]++] = items[i];
+        }
+        NameItem *sorted = temp;
+        temp = items;
+        items = sorted;
+    }
+    return items;
+}
+
+struct NameStatsWork {
+    Trace *trace;
+    MemoryArena *arenas;
+    u32 max_name;
+};
+
+static void build_track_name_stats(void *ctx, usize thread, usize index) {
+    NameStatsWork *work = (NameStatsWork *)ctx;
+    MemoryArena *arena = &work->arenas[thread];
+    TraceTrack *track = &work->trace->tracks[index];
+    u32 n = track->num_slices;
+    if (!n) {
+        return;
+    }
+    track->name_starts = (u64 *)memory_arena_alloc(arena, n * sizeof(u64));
+    track->total_prefix =
+        (u64 *)memory_arena_alloc(arena, (n + 1) * sizeof(u64));
+    track->self_prefix =
+        (u64 *)memory_arena_alloc(arena, (n + 1) * sizeof(u64));
+
+    // Self time, in timeline index order. The parent of a slice is the last
+    // slice one level up that starts before it, children are clipped to it.
+    u64 *self = (u64 *)memory_alloc(n * sizeof(u64));
+    NameItem *buffer = (NameItem *)memory_alloc(2 * n * sizeof(NameItem));
+    ASSERT(self && buffer);
+    for (u32 i = 0; i < n; ++i) {
+        self[i] = track->ends[i] - track->starts[i];
+    }
+    for (u32 depth = 1; depth < track->num_depths; ++depth) {
+        u32 parent = track->depth_offsets[depth - 1];
+        u32 last_parent = track->depth_offsets[depth] - 1;
+        for (u32 i = track->depth_offsets[depth];
+             i < track->depth_offsets[depth + 1]; ++i) {
+            while (parent < last_parent &&
+                   track->starts[parent + 1] <= track->starts[i]) {
+                parent++;
+            }
+            if (track->starts[parent] <= track->starts[i] &&
+                track->ends[parent] > track->starts[i]) {
+                self[parent] -=
+                    min(track->ends[i], track->ends[parent]) - track->starts[i];
+            }
+        }
+    }
+
+    // Sorting by name keeps the timeline order within a name, which is only
+    // sorted by start time if all the slices are at the same depth.
+    for (u32 i = 0; i < n; ++i) {
+        usize offset;
+        TraceSliceChunk *chunk =
+            trace_get_slice_chunk(work->trace, track->slices[i], &offset);
+        buffer[i] = {
+            .name = chunk->name[offset],
+            .index = i,
+            .start = track->starts[i],
+        };
+    }
+    NameItem *items =
+        radix_sort_by_name(buffer, buffer + n, n, work->max_name);
+    for (u32 begin = 0, end; begin < n; begin = end) {
+        end = begin + 1;
+        bool sorted = true;
+        for (; end < n && items[end].name == items[begin].name; ++end) {
+            sorted &= items[end - 1].start <= items[end].start;
+        }
+        if (!sorted) {
+            std::sort(items + begin, items + end, name_item_less);
+        }
+    }
+
+    u32 num_runs = 1;
+    for (u32 i = 1; i < n; ++i) {
+        num_runs += items[i].name != items[i - 1].name;
+    }
+    track->name_runs = (TraceNameRun *)memory_arena_alloc(
+        arena, num_runs * sizeof(TraceNameRun));
+    track->num_name_runs = 0;
+    track->total_prefix[0] = 0;
+    track->self_prefix[0] = 0;
+    TraceNameRun *run = 0;
+    for (u32 i = 0; i < n; ++i) {
+        NameItem *item = &items[i];
+        u64 dur = track->ends[item->index] - track->starts[item->index];
+        track->name_starts[i] = item->start;
+        track->total_prefix[i + 1] = track->total_prefix[i] + dur;
+        track->self_prefix[i + 1] = track->self_prefix[i] + self[item->index];
+        if (!run || run->name != item->name) {
+            run = &track->name_runs[track->num_name_runs++];
+            *run = {.name = item->name, .begin = i};
+        }
+        run->end = i + 1;
+        TraceNameStats stats = {
+            .count = 1,
+            .total_dur = dur,
+            .self_dur = self[item->index],
+            .min_dur = dur,
+            .max_dur = dur,
+        };
+        merge_name_stats(&run->stats, &stats);
+    }
+
+    u32 num_blocks = (n + NAME_BLOCK_SIZE - 1) >> NAME_BLOCK_SHIFT;
+    TraceDurRange *ranges = (TraceDurRange *)memory_arena_alloc(
+        arena, 2 * num_blocks * sizeof(TraceDurRange));
+    for (u32 b = 0; b < num_blocks; ++b) {
+        TraceDurRange range = {.min = UINT64_MAX};
+        u32 end = min((b + 1) << NAME_BLOCK_SHIFT, n);
+        for (u32 i = b << NAME_BLOCK_SHIFT; i < end; ++i) {
+            u64 dur = track->total_prefix[i + 1] - track->total_prefix[i];
+            merge_dur_range(&range, dur, dur);
+        }
+        ranges[num_blocks + b] = range;
+    }
+    for (u32 i = num_blocks - 1; i > 0; --i) {
+        ranges[i] = ranges[2 * i];
+        merge_dur_range(&ranges[i], ranges[2 * i + 1].min,
+                        ranges[2 * i + 1].max);
+    }
+    track->dur_ranges = ranges;
+    track->num_name_blocks = num_blocks;
+
+    memory_free(buffer);
+    memory_free(self);
+}
+
+// Returns the duration range of slices [begin, end) in the name order of the
+// track. Slices outside of whole blocks are scanned, whole blocks take
+// O(log n) nodes of the tree.
+static TraceDurRange query_dur_range(TraceTrack *track, u32 begin, u32 end) {
+    u64 *total = track->total_prefix;
+    TraceDurRange range = {.min = UINT64_MAX};
+    while (begin < end && (begin & (NAME_BLOCK_SIZE - 1))) {
+        u64 dur = total[begin + 1] - total[begin];
+        merge_dur_range(&range, dur, dur);
+        begin++;
+    }
+    // The last block may be partial, it is whole if the range ends with it.
+    while (end > begin && (end & (NAME_BLOCK_SIZE - 1)) &&
+           end < track->num_slices) {
+        end--;
+        u64 dur = total[end + 1] - total[end];
+        merge_dur_range(&range, dur, dur);
+    }
+    if (begin == end) {
+        return range;
+    }
+
+    TraceDurRange *nodes = track->dur_ranges;
+    u32 l = (begin >> NAME_BLOCK_SHIFT) + track->num_name_blocks;
+    u32 r = ((end + NAME_BLOCK_SIZE - 1) >> NAME_BLOCK_SHIFT) +
+            track->num_name_blocks;
+    for (; l < r; l >>= 1, r >>= 1) {
+        if (l & 1) {
+            merge_dur_range(&range, nodes[l].min, nodes[l].max);
+            l++;
+        }
+        if (r & 1) {
+            r--;
+            merge_dur_range(&range, nodes[r].min, nodes[r].max);
+        }
+    }
+    return range;
+}
+
+void trace_build_name_stats(Trace *trace, usize num_threads) {
+    NameStatsWork work = {
+        .trace = trace,
+        .arenas = init_thread_arenas(num_threads),
+        .max_name = (u32)max(trace->strings.count, (usize)1) - 1,
+    };
+    parallel_for_thread(trace->num_tracks, num_threads,
+                        build_track_name_stats, &work);
+    adopt_thread_arenas(trace, work.arenas, num_threads);
+
+    trace->num_name_stats = trace->strings.count;
+    trace->name_stats = (TraceNameStats *)memory_arena_alloc(
+        &trace->arena, trace->num_name_stats * sizeof(TraceNameStats));
+    memset(trace->name_stats, 0,
+           trace->num_name_stats * sizeof(TraceNameStats));
+    for (usize i = 0; i < trace->num_tracks; ++i) {
+        TraceTrack *track = &trace->tracks[i];
+        for (u32 r = 0; r < track->num_name_runs; ++r) {
+            TraceNameRun *run = &track->name_runs[r];
+            merge_name_stats(&trace->name_stats[run->name], &run->stats);
+        }
+    }
+}
+
+void trace_query_name_stats(Trace *trace, u64 t0, u64 t1,
+                            TraceNameStats *stats) {
+    memset(stats, 0, trace->num_name_stats * sizeof(TraceNameStats));
+    for (usize i = 0; i < trace->num_tracks; ++i) {
+        TraceTrack *track = &trace->tracks[i];
+        u64 *total = track->total_prefix;
+        u64 *self = track->self_prefix;
+        for (u32 r = 0; r < track->num_name_runs; ++r) {
+            TraceNameRun *run = &track->name_runs[r];
+            u64 *starts = track->name_starts;
+            u32 begin = (u32)(std::lower_bound(starts + run->begin,
+                                               starts + run->end, t0) -
+                              starts);
+            u32 end = (u32)(std::upper_bound(starts + begin,
+                                             starts + run->end, t1) -
+                            starts);
+            if (begin == end) {
+                continue;
+            }
+            if (begin == run->begin && end == run->end) {
+                merge_name_stats(&stats[run->name], &run->stats);
+                continue;
+            }
+            TraceDurRange durs = query_dur_range(track, begin, end);
+            TraceNameStats range = {
+                .count = end - begin,
+                .total_dur = total[end] - total[begin],
+                .self_dur = self[end] - self[begin],
+                .min_dur = durs.min,
+                .max_dur = durs.max,
+            };
+            merge_name_stats(&stats[run->name], &range);
+        }
+    }
+}
+
+static inline u64 counter_hash(u32 pid, u32 name, u32 series) {
+    return track_hash(pid, name) ^ track_hash(series, 0x9e3779b9);
+}
+
+bool trace_find_counter(Trace *trace, u32 pid, u32 name, u32 series,
+                        u32 *id) {
+    if (!trace->counter_slots) {
+        return false;
+    }
+    usize index = counter_hash(pid, name, series) & trace->counter_slot_mask;
+    while (u32 slot = trace->counter_slots[index]) {
+        TraceCounterSeries *counter = &trace->counters[slot - 1];
+        if (counter->pid == pid && counter->name == name &&
+            counter->series == series) {
+            *id = slot - 1;
+            return true;
+        }
+        index = (index + 1) & trace->counter_slot_mask;
+    }
+    return false;
+}
+
+static u32 get_or_add_counter(Trace *trace, u32 pid, u32 name, u32 series) {
+    u32 id;
+    if (trace_find_counter(trace, pid, name, series, &id)) {
+        return id;
+    }
+
+    if (trace->num_counters == trace->counter_capacity) {
+        trace->counters = (TraceCounterSeries *)grow_table(
+            trace, trace->counters, trace->num_counters,
+            &trace->counter_capacity, sizeof(TraceCounterSeries),
+            INITIAL_COUNTER_CAPACITY);
+        trace->counter_slots = alloc_slots(trace, trace->counter_capacity,
+                                           &trace->counter_slot_mask);
+        for (usize i = 0; i < trace->num_counters; ++i) {
+            TraceCounterSeries *counter = &trace->counters[i];
+            insert_slot(trace->counter_slots, trace->counter_slot_mask,
+                        counter_hash(counter->pid, counter->name,
+                                     counter->series),
+                        (u32)i);
+        }
+    }
+    id = (u32)trace->num_counters++;
+    trace->counters[id] = {.pid = pid, .name = name, .series = series};
+    insert_slot(trace->counter_slots, trace->counter_slot_mask,
+                counter_hash(pid, name, series), id);
+    return id;
+}
+
+static void reserve_samples(TraceCounterSeries *counter, u32 count) {
+    if (counter->num_samples + count <= counter->sample_capacity) {
+        return;
+    }
+    u32 capacity = max(counter->sample_capacity, INITIAL_SAMPLE_CAPACITY);
+    while (capacity < counter->num_samples + count) {
+        capacity <<= 1;
+    }
+    counter->ts = (u64 *)memory_realloc(counter->ts, capacity * sizeof(u64));
+    counter->values =
+        (f64 *)memory_realloc(counter->values, capacity * sizeof(f64));
+    ASSERT(counter->ts && counter->values);
+    counter->sample_capacity = capacity;
+}
+
+void trace_push_counter_sample(Trace *trace, u32 pid, u32 name, u32 series,
+                               u64 ts, f64 value) {
+    u32 id = get_or_add_counter(trace, pid, name, series);
+    TraceCounterSeries *counter = &trace->counters[id];
+    reserve_samples(counter, 1);
+    counter->ts[counter->num_samples] = ts;
+    counter->values[counter->num_samples] = value;
+    counter->num_samples++;
+}
+
+// The finest level has this many samples per bucket (as a shift).
+static const u32 COUNTER_LOD_SHIFT = 3;
+
+static void sort_samples(TraceCounterSeries *counter) {
+    u32 n = counter->num_samples;
+    if (std::is_sorted(counter->ts, counter->ts + n)) {
+        return;
+    }
+
+    u32 *order = (u32 *)memory_alloc(n * sizeof(u32));
+    u64 *ts = (u64 *)memory_alloc(n * sizeof(u64));
+    f64 *values = (f64 *)memory_alloc(n * sizeof(f64));
+    ASSERT(order && ts && values);
+    for (u32 i = 0; i < n; ++i) {
+        order[i] = i;
+    }
+    // Samples at the same time keep their order in the file.
+    std::stable_sort(order, order + n, [counter](u32 a, u32 b) {
+        return counter->ts[a] < counter->ts[b];
+    });
+    for (u32 i = 0; i < n; ++i) {
+        ts[i] = counter->ts[order[i]];
+        values[i] = counter->values[order[i]];
+    }
+    memory_free(counter->ts);
+    memory_free(counter->values);
+    counter->ts = ts;
+    counter->values = values;
+    counter->sample_capacity = n;
+    memory_free(order);
+}
+
+static void build_counter_lod(Trace *trace, TraceCounterSeries *counter) {
+    u32 n = counter->num_samples;
+    u32 num_levels = 1;
+    while (((n - 1) >> (COUNTER_LOD_SHIFT + num_levels - 1)) > 0) {
+        num_levels++;
+    }
+    counter->num_levels = num_levels;
+    counter->levels = (TraceCounterLevel *)memory_arena_alloc(
+        &trace->arena, num_levels * sizeof(TraceCounterLevel));
+
+    for (u32 l = 0; l < num_levels; ++l) {
+        TraceCounterLevel *level = &counter->levels[l];
+        level->shift = COUNTER_LOD_SHIFT + l;
+        level->num_buckets = ((n - 1) >> level->shift) + 1;
+        f64 *data = (f64 *)memory_arena_alloc(
+            &trace->arena, 2 * level->num_buckets * sizeof(f64));
+        level->min = data;
+        level->max = data + level->num_buckets;
+
+        if (l == 0) {
+            for (u32 b = 0; b < level->num_buckets; ++b) {
+                u32 begin = b << level->shift;
+                u32 end = min(begin + (1u << level->shift), n);
+                f64 lo = counter->values[begin];
+                f64 hi = lo;
+                for (u32 i = begin + 1; i < end; ++i) {
+                    lo = min(lo, counter->values[i]);
+                    hi = max(hi, counter->values[i]);
+                }
+                level->min[b] = lo;
+                level->max[b] = hi;
+            }
+        } else {
+            TraceCounterLevel *child = &counter->levels[l - 1];
+            for (u32 b = 0; b < level->num_buckets; ++b) {
+                u32 left = b << 1;
+                u32 right = min(left + 1, child->num_buckets - 1);
+                level->min[b] = min(child->min[left], child->min[right]);
+                level->max[b] = max(child->max[left], child->max[right]);
+            }
+        }
+    }
+}
+
+static void build_counter_index(Trace *trace) {
+    for (usize i = 0; i < trace->num_counters; ++i) {
+        TraceCounterSeries *counter = &trace->counters[i];
+        sort_samples(counter);
+        build_counter_lod(trace, counter);
+    }
+}
+
+TraceTrackInfo *trace_find_track_info(Trace *trace, u32 pid, u32 tid) {
+    if (!trace->track_info_slots) {
+        return 0;
+    }
+    usize index = track_hash(pid, tid) & trace->track_info_slot_mask;
+    while (u32 slot = trace->track_info_slots[index]) {
+        TraceTrackInfo *info = &trace->track_infos[slot - 1];
+        if (info->pid == pid && info->tid == tid) {
+            return info;
+        }
+        index = (index + 1) & trace->track_info_slot_mask;
+    }
+    return 0;
+}
+
+TraceTrackInfo *trace_get_track_info(Trace *trace, u32 pid, u32 tid) {
+    TraceTrackInfo *info = trace_find_track_info(trace, pid, tid);
+    if (info) {
+        return info;
+    }
+
+    if (trace->num_track_infos == trace->track_info_capacity) {
+        trace->track_infos = (TraceTrackInfo *)grow_table(
+            trace, trace->track_infos, trace->num_track_infos,
+            &trace->track_info_capacity, sizeof(TraceTrackInfo),
+            INITIAL_TRACK_CAPACITY);
+        trace->track_info_slots =
+            alloc_slots(trace, trace->track_info_capacity,
+                        &trace->track_info_slot_mask);
+        for (usize i = 0; i < trace->num_track_infos; ++i) {
+            info = &trace->track_infos[i];
+            insert_slot(trace->track_info_slots, trace->track_info_slot_mask,
+                        track_hash(info->pid, info->tid), (u32)i);
+        }
+    }
+    u32 id = (u32)trace->num_track_infos++;
+    info = &trace->track_infos[id];
+    *info = {.pid = pid, .tid = tid};
+    insert_slot(trace->track_info_slots, trace->track_info_slot_mask,
+                track_hash(pid, tid), id);
+    return info;
+}
+
+static i32 get_sort_index(Trace *trace, u32 pid, u32 tid) {
+    TraceTrackInfo *info = trace_find_track_info(trace, pid, tid);
+    return info ? info->sort_index : 0;
+}
+
+static void build_track_order(Trace *trace) {
+    u32 n = (u32)trace->num_tracks;
+    if (!n) {
+        return;
+    }
+    trace->track_order =
+        (u32 *)memory_arena_alloc(&trace->arena, n * sizeof(u32));
+    i32 *process_sort_index = (i32 *)memory_alloc(n * sizeof(i32));
+    i32 *thread_sort_index = (i32 *)memory_alloc(n * sizeof(i32));
+    ASSERT(process_sort_index && thread_sort_index);
+    for (u32 i = 0; i < n; ++i) {
+        TraceTrack *track = &trace->tracks[i];
+        trace->track_order[i] = i;
+        process_sort_index[i] =
+            get_sort_index(trace, track->pid, TRACE_PROCESS_TID);
+        thread_sort_index[i] = get_sort_index(trace, track->pid, track->tid);
+    }
+    std::sort(trace->track_order, trace->track_order + n,
+              [&](u32 a, u32 b) {
+                  TraceTrack *x = &trace->tracks[a];
+                  TraceTrack *y = &trace->tracks[b];
+                  if (process_sort_index[a] != process_sort_index[b]) {
+                      return process_sort_index[a] < process_sort_index[b];
+                  }
+                  if (x->pid != y->pid) {
+                      return x->pid < y->pid;
+                  }
+                  if (thread_sort_index[a] != thread_sort_index[b]) {
+                      return thread_sort_index[a] < thread_sort_index[b];
+                  }
+                  return x->tid < y->tid;
+              });
+    memory_free(thread_sort_index);
+    memory_free(process_sort_index);
+}
+
+void trace_push_link_point(Trace *trace, TraceLinkPoint *point) {
+    if (trace->num_link_points == trace->link_point_capacity) {
+        trace->link_point_capacity =
+            max(trace->link_point_capacity << 1, INITIAL_LINK_POINT_CAPACITY);
+        trace->link_points = (TraceLinkPoint *)memory_realloc(
+            trace->link_points,
+            trace->link_point_capacity * sizeof(TraceLinkPoint));
+        ASSERT(trace->link_points);
+    }
+    trace->link_points[trace->num_link_points++] = *point;
+}
+
+// Returns the deepest slice on the track of (pid, tid) that contains `ts`.
+static bool find_enclosing_slice(Trace *trace, u32 pid, u32 tid, u64 ts,
+                                 u32 *slice) {
+    u32 track_id;
+    if (!trace_find_track(trace, pid, tid, &track_id)) {
+        return false;
+    }
+    TraceTrack *track = &trace->tracks[track_id];
+    for (u32 depth = track->num_depths; depth-- > 0;) {
+        TraceRange range = trace_track_query(track, depth, ts, ts);
+        if (range.begin != range.end) {
+            *slice = track->slices[range.begin];
+            return true;
+        }
+    }
+    return false;
+}
+
+// Sets `slice` of the points that are slices themselves ("flow_in" and
+// "flow_out"), which are sorted by event.
+static void find_point_slices(Trace *trace, TraceLinkPoint *points,
+                              u32 *point_order, u32 num_points, u32 *slices) {
+    for (usize i = 0; i < trace->num_slices; ++i) {
+        usize offset;
+        TraceSliceChunk *chunk = trace_get_slice_chunk(trace, i, &offset);
+        u32 event = chunk->event[offset];
+        u32 *end = point_order + num_points;
+        u32 *found = std::lower_bound(
+            point_order, end, event,
+            [points](u32 p, u32 e) { return points[p].event < e; });
+        for (; found < end && points[*found].event == event; ++found) {
+            slices[*found] = (u32)i;
+        }
+    }
+}
+
+static inline bool is_flow_point(u8 kind) {
+    return kind <= TraceLink_FlowIn;
+}
+
+static inline bool is_bound_flow_point(u8 kind) {
+    return kind == TraceLink_FlowOut || kind == TraceLink_FlowIn;
+}
+
+static u64 link_key_hash(TraceLinkPoint *p) {
+    u32 pid = p->local ? p->pid : ~0u;
+    return track_hash((u32)(p->id >> 32), (u32)p->id) ^
+           track_hash(p->cat, p->scope) * 31 ^ track_hash(pid, 0) * 17;
+}
+
+static bool link_key_equal(TraceLinkPoint *a, TraceLinkPoint *b) {
+    return a->id == b->id && a->cat == b->cat && a->scope == b->scope &&
+           a->local == b->local && (!a->local || a->pid == b->pid) &&
+           is_flow_point(a->kind) == is_flow_point(b->kind);
+}
+
+// Joins the points by key, and returns the number of groups. Points of group g
+// are [group_offsets[g], group_offsets[g + 1]) in `order`, in file order.
+static u32 group_link_points(Trace *trace, u32 **order, u32 **group_offsets) {
+    TraceLinkPoint *points = trace->link_points;
+    u32 n = (u32)trace->num_link_points;
+    // Keep the load factor at or below 50%.
+    usize num_slots = 16;
+    while (num_slots < (usize)n * 2) {
+        num_slots <<= 1;
+    }
+    usize mask = num_slots - 1;
+    u32 *slots = (u32 *)memory_calloc(num_slots, sizeof(u32));
+    u32 *groups = (u32 *)memory_alloc(n * sizeof(u32));
+    // The first point of each group.
+    u32 *group_points = (u32 *)memory_alloc(n * sizeof(u32));
+    ASSERT(slots && groups && group_points);
+
+    u32 num_groups = 0;
+    for (u32 i = 0; i < n; ++i) {
+        usize index = link_key_hash(&points[i]) & mask;
+        while (true) {
+            u32 slot = slots[index];
+            if (!slot) {
+                group_points[num_groups] = i;
+                slots[index] = ++num_groups;
+                groups[i] = num_groups - 1;
+                break;
+            }
+            if (link_key_equal(&points[group_points[slot - 1]], &points[i])) {
+                groups[i] = slot - 1;
+                break;
+            }
+            index = (index + 1) & mask;
+        }
+    }
+
+    // Counting sort by group keeps the file order within a group.
+    u32 *offsets = (u32 *)memory_calloc(num_groups + 1, sizeof(u32));
+    u32 *sorted = (u32 *)memory_alloc(n * sizeof(u32));
+    ASSERT(offsets && sorted);
+    for (u32 i = 0; i < n; ++i) {
+        offsets[groups[i] + 1]++;
+    }
+    for (u32 g = 0; g < num_groups; ++g) {
+        offsets[g + 1] += offsets[g];
+    }
+    for (u32 i = 0; i < n; ++i) {
+        sorted[offsets[groups[i]]++] = i;
+    }
+    for (u32 g = num_groups; g > 0; --g) {
+        offsets[g] = offsets[g - 1];
+    }
+    offsets[0] = 0;
+
+    memory_free(group_points);
+    memory_free(groups);
+    memory_free(slots);
+    *order = sorted;
+    *group_offsets = offsets;
+    return num_groups;
+}
+
+static const u32 NO_SLICE = ~0u;
+
+// Growable array of T, in temporary memory.
+template <typename T>
+struct TempArray {
+    T *items;
+    u32 count;
+    u32 capacity;
+};
+
+template <typename T>
+static void temp_array_push(TempArray<T> *array, T item) {
+    reserve_stack(&array->items, array->count, &array->capacity);
+    array->items[array->count++] = item;
+}
+
+static void build_flows(Trace *trace, TempArray<TraceFlow> *flows) {
+    std::sort(flows->items, flows->items + flows->count,
+              [](const TraceFlow &a, const TraceFlow &b) {
+                  return a.from != b.from ? a.from < b.from : a.to < b.to;
+              });
+    u32 n = flows->count;
+    usize num_offsets = trace->num_slices + 1;
+    usize size = n * (sizeof(TraceFlow) + sizeof(u32)) +
+                 2 * num_offsets * sizeof(u32);
+    u8 *data = (u8 *)memory_arena_alloc(&trace->arena, size);
+    trace->flows = (TraceFlow *)data;
+    trace->flow_in = (u32 *)(trace->flows + n);
+    trace->flow_out_offsets = trace->flow_in + n;
+    trace->flow_in_offsets = trace->flow_out_offsets + num_offsets;
+    trace->num_flows = n;
+    memcpy(trace->flows, flows->items, n * sizeof(TraceFlow));
+
+    u32 *out = trace->flow_out_offsets;
+    u32 *in = trace->flow_in_offsets;
+    memset(out, 0, 2 * num_offsets * sizeof(u32));
+    for (u32 i = 0; i < n; ++i) {
+        out[trace->flows[i].from + 1]++;
+        in[trace->flows[i].to + 1]++;
+    }
+    for (usize i = 1; i < num_offsets; ++i) {
+        out[i] += out[i - 1];
+        in[i] += in[i - 1];
+    }
+    // Scatter by `to`, then shift the offsets back.
+    for (u32 i = 0; i < n; ++i) {
+        trace->flow_in[in[trace->flows[i].to]++] = i;
+    }
+    for (usize i = num_offsets - 1; i > 0; --i) {
+        in[i] = in[i - 1];
+    }
+    in[0] = 0;
+}
+
+// Connects the points of one flow group in order of time.
+static void link_flow_group(TraceLinkPoint *points, u32 *order, u32 count,
+                            u32 *slices, TempArray<TraceFlow> *flows) {
+    u32 prev = NO_SLICE;
+    for (u32 i = 0; i < count; ++i) {
+        u32 p = order[i];
+        u32 slice = slices[p];
+        u8 kind = points[p].kind;
+        bool is_target = kind == TraceLink_FlowStep ||
+                         kind == TraceLink_FlowEnd || kind == TraceLink_FlowIn;
+        if (is_target && prev != NO_SLICE && slice != NO_SLICE &&
+            prev != slice) {
+            temp_array_push(flows, TraceFlow{.from = prev, .to = slice});
+        }
+        if (kind == TraceLink_FlowEnd) {
+            prev = NO_SLICE;
+        } else if (kind != TraceLink_FlowIn && slice != NO_SLICE) {
+            prev = slice;
+        }
+    }
+}
+
+// Pairs the begin and end points of one async group in order of time.
+static void link_async_group(Trace *trace, u32 *order, u32 count, u64 *ts,
+                             u32 group, TempArray<u32> *stack,
+                             TempArray<TraceAsyncSlice> *slices) {
+    TraceLinkPoint *points = trace->link_points;
+    u32 first = slices->count;
+    stack->count = 0;
+    for (u32 i = 0; i < count; ++i) {
+        u32 p = order[i];
+        TraceAsyncSlice slice = {
+            .ts = ts[p],
+            .name = trace_get_event(trace, points[p].event).name,
+            .group = group,
+            .depth = stack->count,
+            .event = points[p].event,
+        };
+        switch (points[p].kind) {
+            case TraceLink_AsyncBegin: {
+                temp_array_push(stack, p);
+            } break;
+
+            case TraceLink_AsyncEnd: {
+                // An end without a begin is dropped.
+                if (stack->count) {
+                    u32 begin = stack->items[--stack->count];
+                    slice.ts = ts[begin];
+                    slice.dur = ts[p] - min(ts[begin], ts[p]);
+                    slice.name =
+                        trace_get_event(trace, points[begin].event).name;
+                    slice.depth = stack->count;
+                    slice.event = points[begin].event;
+                    temp_array_push(slices, slice);
+                }
+            } break;
+
+            case TraceLink_AsyncInstant: {
+                temp_array_push(slices, slice);
+            } break;
+        }
+    }
+    while (stack->count) {
+        u32 begin = stack->items[--stack->count];
+        TraceAsyncSlice slice = {
+            .ts = ts[begin],
+            .dur = trace->end_ts - min(ts[begin], trace->end_ts),
+            .name = trace_get_event(trace, points[begin].event).name,
+            .group = group,
+            .depth = stack->count,
+            .event = points[begin].event,
+        };
+        temp_array_push(slices, slice);
+    }
+    std::sort(slices->items + first, slices->items + slices->count,
+              [](const TraceAsyncSlice &a, const TraceAsyncSlice &b) {
+                  return a.ts != b.ts ? a.ts < b.ts : a.depth < b.depth;
+              });
+}
+
+// A lane that is in use until `end`.
+struct BusyLane {
+    u64 end;
+    u32 lane;
+};
+
+// Assigns lanes to the slices of one track, sorted by start time, with a sweep
+// line: a slice takes the lowest lane that is free at its start.
+static u32 pack_lanes(TraceAsyncSlice *slices, u32 *order, u32 count,
+                      BusyLane *busy, u32 *free_lanes) {
+    auto busy_greater = [](const BusyLane &a, const BusyLane &b) {
+        return a.end > b.end;
+    };
+    auto lane_greater = [](u32 a, u32 b) { return a > b; };
+    u32 num_busy = 0;
+    u32 num_free = 0;
+    u32 num_lanes = 0;
+    for (u32 i = 0; i < count; ++i) {
+        TraceAsyncSlice *slice = &slices[order[i]];
+        while (num_busy && busy[0].end <= slice->ts) {
+            std::pop_heap(busy, busy + num_busy, busy_greater);
+            free_lanes[num_free++] = busy[--num_busy].lane;
+            std::push_heap(free_lanes, free_lanes + num_free, lane_greater);
+        }
+        if (num_free) {
+            std::pop_heap(free_lanes, free_lanes + num_free, lane_greater);
+            slice->lane = free_lanes[--num_free];
+        } else {
+            slice->lane = num_lanes++;
+        }
+        // Instants occupy their lane at their start time.
+        u64 end = slice->ts + max(slice->dur, (u64)1);
+        busy[num_busy++] = {.end = end, .lane = slice->lane};
+        std::push_heap(busy, busy + num_busy, busy_greater);
+    }
+    return num_lanes;
+}
+
+static void build_async_tracks(Trace *trace) {
+    u32 n = (u32)trace->num_async_slices;
+    TraceAsyncSlice *slices = trace->async_slices;
+    TraceAsyncGroup *groups = trace->async_groups;
+    u32 *order = (u32 *)memory_arena_alloc(&trace->arena, n * sizeof(u32));
+    for (u32 i = 0; i < n; ++i) {
+        order[i] = i;
+    }
+    // Parents before children, so that they get the lower lanes.
+    std::sort(order, order + n, [slices, groups](u32 a, u32 b) {
+        TraceAsyncSlice *x = &slices[a];
+        TraceAsyncSlice *y = &slices[b];
+        u32 x_pid = groups[x->group].pid;
+        u32 y_pid = groups[y->group].pid;
+        if (x_pid != y_pid) {
+            return x_pid < y_pid;
+        }
+        if (x->ts != y->ts) {
+            return x->ts < y->ts;
+        }
+        return x->depth != y->depth ? x->depth < y->depth : a < b;
+    });
+
+    u32 num_tracks = 0;
+    for (u32 i = 0; i < n; ++i) {
+        num_tracks += i == 0 || groups[slices[order[i]].group].pid !=
+                                    groups[slices[order[i - 1]].group].pid;
+    }
+    trace->num_async_tracks = num_tracks;
+    trace->async_tracks = (TraceAsyncTrack *)memory_arena_alloc(
+        &trace->arena, num_tracks * sizeof(TraceAsyncTrack));
+
+    BusyLane *busy = (BusyLane *)memory_alloc(n * sizeof(BusyLane));
+    u32 *free_lanes = (u32 *)memory_alloc(n * sizeof(u32));
+    ASSERT(busy && free_lanes);
+    u32 start = 0;
+    for (u32 t = 0; t < num_tracks; ++t) {
+        u32 pid = groups[slices[order[start]].group].pid;
+        u32 end = start;
+        while (end < n && groups[slices[order[end]].group].pid == pid) {
+            end++;
+        }
+        TraceAsyncTrack *track = &trace->async_tracks[t];
+        track->pid = pid;
+        track->slices = order + start;
+        track->num_slices = end - start;
+        track->num_lanes = pack_lanes(slices, track->slices,
+                                      track->num_slices, busy, free_lanes);
+        start = end;
+    }
+    memory_free(free_lanes);
+    memory_free(busy);
+}
+
+static void build_links(Trace *trace) {
+    u32 n = (u32)trace->num_link_points;
+    if (!n) {
+        return;
+    }
+    TraceLinkPoint *points = trace->link_points;
+
+    u32 *order;
+    u32 *group_offsets;
+    u32 num_groups = group_link_points(trace, &order, &group_offsets);
+
+    u64 *ts = (u64 *)memory_alloc(n * sizeof(u64));
+    u32 *slices = (u32 *)memory_alloc(n * sizeof(u32));
+    u32 *bound = (u32 *)memory_alloc(n * sizeof(u32));
+    ASSERT(ts && slices && bound);
+    u32 num_bound = 0;
+    for (u32 i = 0; i < n; ++i) {
+        TraceEvent event = trace_get_event(trace, points[i].event);
+        ts[i] = event.ts;
+        slices[i] = NO_SLICE;
+        if (is_bound_flow_point(points[i].kind)) {
+            bound[num_bound++] = i;
+        } else if (is_flow_point(points[i].kind)) {
+            find_enclosing_slice(trace, event.pid, event.tid, event.ts,
+                                 &slices[i]);
+        }
+    }
+    if (num_bound) {
+        // Points are pushed in event order, so `bound` is sorted by event.
+        find_point_slices(trace, points, bound, num_bound, slices);
+    }
+
+    TempArray<TraceFlow> flows = {};
+    TempArray<TraceAsyncSlice> async_slices = {};
+    TempArray<TraceAsyncGroup> async_groups = {};
+    TempArray<u32> stack = {};
+    for (u32 g = 0; g < num_groups; ++g) {
+        u32 *group = order + group_offsets[g];
+        u32 count = group_offsets[g + 1] - group_offsets[g];
+        std::stable_sort(group, group + count,
+                         [ts](u32 a, u32 b) { return ts[a] < ts[b]; });
+        TraceLinkPoint *key = &points[group[0]];
+        if (is_flow_point(key->kind)) {
+            link_flow_group(points, group, count, slices, &flows);
+        } else {
+            u32 first = async_slices.count;
+            link_async_group(trace, group, count, ts, async_groups.count,
+                             &stack, &async_slices);
+            if (async_slices.count != first) {
+                TraceAsyncGroup async_group = {
+                    .id = key->id,
+                    .cat = key->cat,
+                    .pid = key->pid,
+                    .first = first,
+                    .count = async_slices.count - first,
+                };
+                temp_array_push(&async_groups, async_group);
+            }
+        }
+    }
+
+    if (flows.count) {
+        build_flows(trace, &flows);
+    }
+    if (async_slices.count) {
+        trace->num_async_slices = async_slices.count;
+        trace->async_slices = (TraceAsyncSlice *)memory_arena_alloc(
+            &trace->arena, async_slices.count * sizeof(TraceAsyncSlice));
+        memcpy(trace->async_slices, async_slices.items,
+               async_slices.count * sizeof(TraceAsyncSlice));
+        trace->num_async_groups = async_groups.count;
+        trace->async_groups = (TraceAsyncGroup *)memory_arena_alloc(
+            &trace->arena, async_groups.count * sizeof(TraceAsyncGroup));
+        memcpy(trace->async_groups, async_groups.items,
+               async_groups.count * sizeof(TraceAsyncGroup));
+        build_async_tracks(trace);
+    }
+
+    memory_free(stack.items);
+    memory_free(async_groups.items);
+    memory_free(async_slices.items);
+    memory_free(flows.items);
+    memory_free(bound);
+    memory_free(slices);
+    memory_free(ts);
+    memory_free(group_offsets);
+    memory_free(order);
+}
+
+// Counting sort of slice ids by name.
+static void build_name_slices(Trace *trace) {
+    if (!trace->num_slices) {
+        return;
+    }
+    u32 num_names = (u32)trace->strings.count;
+    trace->num_sliced_names = num_names;
+    trace->name_slice_offsets = (u32 *)memory_arena_alloc(
+        &trace->arena, (num_names + 1) * sizeof(u32));
+    trace->name_slices = (u32 *)memory_arena_alloc(
+        &trace->arena, trace->num_slices * sizeof(u32));
+    u32 *offsets = trace->name_slice_offsets;
+    memset(offsets, 0, (num_names + 1) * sizeof(u32));
+    for (usize c = 0; c < trace->num_slice_chunks; ++c) {
+        TraceSliceChunk *chunk = &trace->slice_chunks[c];
+        usize count = min(trace->num_slices - c * TRACE_EVENT_CHUNK_SIZE,
+                          TRACE_EVENT_CHUNK_SIZE);
+        for (usize i = 0; i < count; ++i) {
+            offsets[chunk->name[i] + 1]++;
+        }
+    }
+    for (u32 n = 0; n < num_names; ++n) {
+        offsets[n + 1] += offsets[n];
+    }
+    for (usize c = 0; c < trace->num_slice_chunks; ++c) {
+        TraceSliceChunk *chunk = &trace->slice_chunks[c];
+        usize count = min(trace->num_slices - c * TRACE_EVENT_CHUNK_SIZE,
+                          TRACE_EVENT_CHUNK_SIZE);
+        for (usize i = 0; i < count; ++i) {
+            trace->name_slices[offsets[chunk->name[i]]++] =
+                (u32)(c * TRACE_EVENT_CHUNK_SIZE + i);
+        }
+    }
+    // Shift the ends back to starts.
+    memmove(offsets + 1, offsets, num_names * sizeof(u32));
+    offsets[0] = 0;
+}
+
+void trace_build_index(Trace *trace) {
+    build_slice_index(trace);
+    build_track_order(trace);
+    build_name_slices(trace);
+    build_counter_index(trace);
+    build_links(trace);
+}
+
+TraceRange trace_counter_query(TraceCounterSeries *counter, u64 t0, u64 t1) {
+    u64 *ts = counter->ts;
+    u64 *begin = std::upper_bound(ts, ts + counter->num_samples, t0);
+    u64 *end = std::upper_bound(begin, ts + counter->num_samples, t1);
+    if (begin != ts) {
+        begin--;
+    }
+    return TraceRange{.begin = (u32)(begin - ts), .end = (u32)(end - ts)};
+}
+
+TraceCounterLevel *trace_counter_get_level(TraceCounterSeries *counter,
+                                           u32 num_samples) {
+    TraceCounterLevel *result = 0;
+    for (u32 i = 0; i < counter->num_levels; ++i) {
+        if ((1u << counter->levels[i].shift) > num_samples) {
+            break;
+        }
+        result = &counter->levels[i];
+    }
+    return result;
+}
+
+void trace_finish(Trace *trace) {
+    // The slices of a range may still be closed by the next ranges.
+    if (trace->is_range) {
+        return;
+    }
+    for (usize track_id = 0; track_id < trace->num_tracks; ++track_id) {
+        TraceTrack *track = &trace->tracks[track_id];
+        while (track->num_open) {
+            TraceOpenSlice *open = &track->open[--track->num_open];
+            TraceSlice slice = {
+                .ts = open->ts,
+                .dur = max(trace->end_ts, open->ts) - open->ts,
+                .name = open->name,
+                .track = (u32)track_id,
+                .depth = open->depth,
+                .event = open->event,
+            };
+            push_slice(trace, &slice);
+            add_duration(trace, slice.name, slice.dur);
+        }
+        track->num_x_ends = 0;
+    }
+}
+
+void trace_push_event(Trace *trace, TraceEvent *event) {
+    usize offset;
+    TraceEventChunk *chunk = get_tail_chunk(trace, &offset);
+    chunk->ts[offset] = event->ts;
+    chunk->dur[offset] = event->dur;
+    chunk->tdur[offset] = event->tdur;
+    chunk->pid[offset] = event->pid;
+    chunk->tid[offset] = event->tid;
+    chunk->name[offset] = event->name;
+    chunk->cat[offset] = event->cat;
+    chunk->ph[offset] = event->ph;
+    chunk->raw[offset] = event->raw;
+    chunk->raw_size[offset] = event->raw_size;
+
+    add_slice(trace, trace->num_events, event->ph, event->ts, event->dur,
+              event->name, event->pid, event->tid);
+    if (event->ph == 'X') {
+        add_duration(trace, event->name, event->dur);
+    }
+    trace->num_events++;
+}
+
+TraceEvent trace_get_event(Trace *trace, usize index) {
+    usize offset;
+    TraceEventChunk *chunk = trace_get_event_chunk(trace, index, &offset);
+    return TraceEvent{
+        .name = chunk->name[offset],
+        .cat = chunk->cat[offset],
+        .ph = chunk->ph[offset],
+        .ts = chunk->ts[offset],
+        .dur = chunk->dur[offset],
+        .tdur = chunk->tdur[offset],
+        .pid = chunk->pid[offset],
+        .tid = chunk->tid[offset],
+        .raw = chunk->raw[offset],
+        .raw_size = chunk->raw_size[offset],
+    };
+}
+
+void trace_publish_snapshot(Trace *trace) {
+    trace->snapshot = {
+        .version = trace->snapshot.version + 1,
+        .num_events = trace->num_events,
+        .chunks = trace->chunks,
+        .num_slices = trace->num_slices,
+        .slice_chunks = trace->slice_chunks,
+        .num_tracks = trace->num_tracks,
+        .tracks = trace->tracks,
+        .num_strings = trace->strings.count,
+        .strings = trace->strings.strings,
+        .end_ts = trace->end_ts,
+    };
+    // Only the previous snapshot could point to older chunk tables.
+    memory_reserve_trim(&trace->chunk_table);
+    memory_reserve_trim(&trace->slice_chunk_table);
+}
+
+static void push_raw_block(Trace *trace, TraceRawBlock block) {
+    TraceRawStore *store = &trace->raw;
+    if (store->num_blocks == store->block_capacity) {
+        store->blocks = (TraceRawBlock *)grow_table(
+            trace, store->blocks, store->num_blocks, &store->block_capacity,
+            sizeof(TraceRawBlock), INITIAL_RAW_BLOCK_CAPACITY);
+    }
+    store->blocks[store->num_blocks++] = block;
+}
+
+// Moves the committed bytes of the current block to a new block in the arena,
+// compressed if enabled. Pending bytes stay in the current block.
+static void seal_raw_block(Trace *trace) {
+    TraceRawStore *store = &trace->raw;
+    usize size = store->pending_start;
+    if (size == 0) {
+        return;
+    }
+
+    TraceRawBlock block = {.size = (u32)size};
+    if (store->compress) {
+        u8 *compressed = (u8 *)memory_alloc(lz_compress_bound(size));
+        ASSERT(compressed);
+        usize compressed_size = lz_compress({store->current, size}, compressed);
+        if (compressed_size < size) {
+            block.data =
+                (u8 *)memory_arena_alloc(&trace->arena, compressed_size);
+            memcpy(block.data, compressed, compressed_size);
+            block.compressed_size = (u32)compressed_size;
+        }
+        memory_free(compressed);
+    }
+    if (!block.data) {
+        block.data = (u8 *)memory_arena_alloc(&trace->arena, size);
+        memcpy(block.data, store->current, size);
+    }
+    push_raw_block(trace, block);
+
+    memmove(store->current, store->current + size,
+            store->current_size - size);
+    store->current_size -= size;
+    store->pending_start = 0;
+}
+
+void trace_append_pending_raw(Trace *trace, Buf bytes) {
+    TraceRawStore *store = &trace->raw;
+    if (store->current_size + bytes.size > TRACE_RAW_BLOCK_SIZE) {
+        seal_raw_block(trace);
+    }
+
+    usize size = store->current_size + bytes.size;
+    if (size > store->current_capacity) {
+        usize new_capacity = max(store->current_capacity, TRACE_RAW_BLOCK_SIZE);
+        while (new_capacity < size) {
+            new_capacity <<= 1;
+        }
+        store->current =
+            (u8 *)memory_realloc(store->current, new_capacity);
+        ASSERT(store->current);
+        store->current_capacity = new_capacity;
+    }
+    memcpy(store->current + store->current_size, bytes.data, bytes.size);
+    store->current_size = size;
+}
+
+u64 trace_commit_pending_raw(Trace *trace, u32 *size) {
+    TraceRawStore *store = &trace->raw;
+    u64 raw = TRACE_RAW_IN_STORE | (u64)store->num_blocks << 32 |
+              store->pending_start;
+    *size = (u32)(store->current_size - store->pending_start);
+    store->pending_start = store->current_size;
+    if (store->current_size >= TRACE_RAW_BLOCK_SIZE) {
+        seal_raw_block(trace);
+    }
+    return raw;
+}
+
+void trace_discard_pending_raw(Trace *trace) {
+    trace->raw.current_size = trace->raw.pending_start;
+}
+
+Buf trace_get_event_raw(Trace *trace, usize index, MemoryArena *arena) {
+    usize offset;
+    TraceEventChunk *chunk = trace_get_event_chunk(trace, index, &offset);
+    u64 raw = chunk->raw[offset];
+    usize size = chunk->raw_size[offset];
+    if (!size) {
+        return {};
+    }
+    if (!(raw & TRACE_RAW_IN_STORE)) {
+        return buf_slice(trace->strings.source, raw, raw + size);
+    }
+
+    TraceRawStore *store = &trace->raw;
+    usize block_index = (raw & ~TRACE_RAW_IN_STORE) >> 32;
+    usize block_offset = (u32)raw;
+    if (block_index == store->num_blocks) {
+        return {store->current + block_offset, size};
+    }
+    TraceRawBlock *block = &store->blocks[block_index];
+    if (!block->compressed_size) {
+        return {block->data + block_offset, size};
+    }
+    u8 *data = (u8 *)memory_arena_alloc(arena, block->size);
+    bool ok = lz_decompress({block->data, block->compressed_size},
+                            {data, block->size});
+    ASSERT(ok);
+    return {data + block_offset, size};
+}
+
+// Track of a placeholder slice whose 'E' turned out to close nothing.
+static const u32 DROPPED_SLICE_TRACK = UINT32_MAX;
+
+static usize get_num_chunks(usize count) {
+    return (count + TRACE_EVENT_CHUNK_MASK) >> TRACE_EVENT_CHUNK_SHIFT;
+}
+
+template <typename Fn>
+static void for_each_column(TraceEventChunk *, Fn fn) {
+    fn(&TraceEventChunk::ts);
+    fn(&TraceEventChunk::dur);
+    fn(&TraceEventChunk::tdur);
+    fn(&TraceEventChunk::raw);
+    fn(&TraceEventChunk::pid);
+    fn(&TraceEventChunk::tid);
+    fn(&TraceEventChunk::name);
+    fn(&TraceEventChunk::cat);
+    fn(&TraceEventChunk::raw_size);
+    fn(&TraceEventChunk::ph);
+}
+
+template <typename Fn>
+static void for_each_column(TraceSliceChunk *, Fn fn) {
+    fn(&TraceSliceChunk::ts);
+    fn(&TraceSliceChunk::dur);
+    fn(&TraceSliceChunk::name);
+    fn(&TraceSliceChunk::track);
+    fn(&TraceSliceChunk::depth);
+    fn(&TraceSliceChunk::event);
+}
+
+// Moves elements [0, count) of the chunks to [shift, shift + count) in place,
+// back to front. The chunks must have room for shift + count elements.
+template <typename Chunk>
+static void shift_chunks(Chunk *chunks, usize count, usize shift) {
+    if (!count || !shift) {
+        return;
+    }
+    for_each_column(chunks, [&](auto column) {
+        usize n = TRACE_EVENT_CHUNK_SIZE;
+        for (usize c = get_num_chunks(count); c-- > 0;) {
+            auto data = chunks[c].*column;
+            usize size = min(count - c * n, n);
+            if (size + shift > n) {
+                usize tail = size + shift - n;
+                memcpy(chunks[c + 1].*column, data + size - tail,
+                       tail * sizeof(*data));
+                size -= tail;
+            }
+            memmove(data + shift, data, size * sizeof(*data));
+        }
+    });
+}
+
+// Copies the first `count` elements of every column of `from` to `to`.
+template <typename Chunk>
+static void copy_chunk_head(Chunk *to, Chunk *from, usize count) {
+    for_each_column(to, [&](auto column) {
+        memcpy(to->*column, from->*column, count * sizeof(*(to->*column)));
+    });
+}
+
+// State of appending one range trace, see trace_append_ranges().
+struct RangeAppend {
+    Trace *src;
+    u32 *string_map;
+    // Indexed by the tracks of src, as are the states of the tracks in dst
+    // before src: the number of open 'B' slices, and the ends of the 'X'
+    // slices in x_ends[x_end_offsets[i], x_end_offsets[i + 1]), whose suffix
+    // maxima are in x_end_maxes.
+    u32 *track_map;
+    u32 *carry_opens;
+    u32 *x_end_offsets;
+    u64 *x_ends;
+    u64 *x_end_maxes;
+    u64 raw_block_base;
+    usize event_base;
+    usize slice_base;
+    // Slices of src that are kept.
+    usize num_slices;
+};
+
+// Returns how much deeper a slice of a track of src is in dst, from the
+// slices of the previous ranges that are still open where it starts.
+static u32 get_carry_depth(RangeAppend *append, u32 track,
+                           TraceRangeCarry *carry) {
+    u32 opens = append->carry_opens[track];
+    u32 depth = opens - min(opens, carry->num_unmatched_ends);
+    u64 *begin = append->x_end_maxes + append->x_end_offsets[track];
+    u64 *end = append->x_end_maxes + append->x_end_offsets[track + 1];
+    if (!carry->x_popped) {
+        return depth + (u32)(end - begin);
+    }
+    // Popping from the top stops at the last 'X' slice that ends after
+    // x_pop_ts.
+    u64 *popped = std::partition_point(
+        begin, end, [&](u64 max_end) { return max_end > carry->x_pop_ts; });
+    return depth + (u32)(popped - begin);
+}
+
+// Merges everything of `append->src` that depends on the previous ranges,
+// in range order, and reserves the ids of its events and slices.
+static void begin_append(Trace *dst, RangeAppend *append) {
+    Trace *src = append->src;
+    ASSERT(src->is_range);
+
+    u32 *string_map =
+        (u32 *)memory_alloc(src->strings.count * sizeof(u32));
+    ASSERT(string_map);
+    // Id 0 is the empty string in every trace.
+    string_map[0] = 0;
+    for (usize id = 1; id < src->strings.count; ++id) {
+        string_map[id] = trace_intern(dst, trace_get_string(src, (u32)id));
+    }
+    append->string_map = string_map;
+
+    usize num_tracks = src->num_tracks;
+    append->track_map = (u32 *)memory_alloc(max(num_tracks, (usize)1) *
+                                            sizeof(u32));
+    append->carry_opens = (u32 *)memory_alloc(max(num_tracks, (usize)1) *
+                                              sizeof(u32));
+    append->x_end_offsets =
+        (u32 *)memory_alloc((num_tracks + 1) * sizeof(u32));
+    ASSERT(append->track_map && append->carry_opens &&
+           append->x_end_offsets);
+    u32 num_x_ends = 0;
+    for (usize i = 0; i < num_tracks; ++i) {
+        TraceTrack *from = &src->tracks[i];
+        u32 id = get_or_add_track(dst, from->pid, from->tid);
+        append->track_map[i] = id;
+        append->carry_opens[i] = dst->tracks[id].num_open;
+        append->x_end_offsets[i] = num_x_ends;
+        num_x_ends += dst->tracks[id].num_x_ends;
+    }
+    append->x_end_offsets[num_tracks] = num_x_ends;
+    append->x_ends = (u64 *)memory_alloc(max(num_x_ends, 1u) * sizeof(u64));
+    append->x_end_maxes =
+        (u64 *)memory_alloc(max(num_x_ends, 1u) * sizeof(u64));
+    ASSERT(append->x_ends && append->x_end_maxes);
+    for (usize i = 0; i < num_tracks; ++i) {
+        TraceTrack *to = &dst->tracks[append->track_map[i]];
+        u32 begin = append->x_end_offsets[i];
+        memcpy(append->x_ends + begin, to->x_ends,
+               to->num_x_ends * sizeof(u64));
+        u64 max_end = 0;
+        for (u32 j = begin + to->num_x_ends; j-- > begin;) {
+            max_end = max(max_end, append->x_ends[j]);
+            append->x_end_maxes[j] = max_end;
+        }
+    }
+
+    // Raw blocks stay in the arena of src, which dst adopts.
+    seal_raw_block(dst);
+    seal_raw_block(src);
+    append->raw_block_base = (u64)dst->raw.num_blocks << 32;
+    for (usize i = 0; i < src->raw.num_blocks; ++i) {
+        push_raw_block(dst, src->raw.blocks[i]);
+    }
+
+    // 'E' events without a 'B' in src close the 'B' events that the previous
+    // ranges left open.
+    usize num_dropped = 0;
+    for (u32 i = 0; i < src->num_range_ends; ++i) {
+        usize offset;
+        TraceSliceChunk *chunk =
+            trace_get_slice_chunk(src, src->range_ends[i], &offset);
+        u32 track_id = append->track_map[chunk->track[offset]];
+        TraceTrack *track = &dst->tracks[track_id];
+        if (!track->num_open) {
+            chunk->track[offset] = DROPPED_SLICE_TRACK;
+            num_dropped++;
+            continue;
+        }
+        TraceOpenSlice *open = &track->open[--track->num_open];
+        u64 ts = chunk->ts[offset];
+        chunk->ts[offset] = open->ts;
+        chunk->dur[offset] = max(ts, open->ts) - open->ts;
+        chunk->name[offset] = open->name;
+        chunk->track[offset] = track_id;
+        chunk->depth[offset] = open->depth;
+        chunk->event[offset] = open->event;
+        add_duration(dst, open->name, chunk->dur[offset]);
+    }
+
+    // What src leaves open goes on top of what the previous ranges left.
+    append->event_base = dst->num_events;
+    for (usize i = 0; i < num_tracks; ++i) {
+        TraceTrack *from = &src->tracks[i];
+        TraceTrack *to = &dst->tracks[append->track_map[i]];
+        while (from->carry.x_popped && to->num_x_ends &&
+               to->x_ends[to->num_x_ends - 1] <= from->carry.x_pop_ts) {
+            to->num_x_ends--;
+        }
+        for (u32 j = 0; j < from->num_x_ends; ++j) {
+            reserve_stack(&to->x_ends, to->num_x_ends, &to->x_end_capacity);
+            to->x_ends[to->num_x_ends++] = from->x_ends[j];
+        }
+        for (u32 j = 0; j < from->num_open; ++j) {
+            TraceOpenSlice open = from->open[j];
+            open.name = string_map[open.name];
+            open.event += (u32)append->event_base;
+            open.depth += get_carry_depth(append, (u32)i, &open.carry);
+            reserve_stack(&to->open, to->num_open, &to->open_capacity);
+            to->open[to->num_open++] = open;
+        }
+    }
+
+    // Make room for the events and slices to move to their offsets in the
+    // chunks of dst, before the arena of src is adopted.
+    usize event_shift = dst->num_events & TRACE_EVENT_CHUNK_MASK;
+    if (get_num_chunks(event_shift + src->num_events) > src->num_chunks) {
+        push_chunk(src);
+    }
+    append->slice_base = dst->num_slices;
+    append->num_slices = src->num_slices - num_dropped;
+    usize slice_shift = dst->num_slices & TRACE_EVENT_CHUNK_MASK;
+    if (get_num_chunks(slice_shift + append->num_slices) >
+        src->num_slice_chunks) {
+        push_slice_chunk(src);
+    }
+    dst->num_events += src->num_events;
+    dst->num_slices += append->num_slices;
+    dst->end_ts = max(dst->end_ts, src->end_ts);
+    memory_arena_adopt(&dst->arena, &src->arena);
+
+    for (usize i = 0; i < src->num_track_infos; ++i) {
+        TraceTrackInfo *from = &src->track_infos[i];
+        TraceTrackInfo *to = trace_get_track_info(dst, from->pid, from->tid);
+        if (from->name) {
+            to->name = string_map[from->name];
+        }
+        if (from->has_sort_index) {
+            to->has_sort_index = true;
+            to->sort_index = from->sort_index;
+        }
+    }
+
+    for (usize i = 0; i < src->num_duration_sketches; ++i) {
+        Sketch *sketch = &src->duration_sketches[i];
+        if (sketch->count) {
+            sketch_merge(get_duration_sketch(dst, string_map[i]), sketch);
+        }
+    }
+
+    for (usize i = 0; i < src->num_counters; ++i) {
+        TraceCounterSeries *from = &src->counters[i];
+        u32 id = get_or_add_counter(dst, from->pid, string_map[from->name],
+                                    string_map[from->series]);
+        TraceCounterSeries *to = &dst->counters[id];
+        reserve_samples(to, from->num_samples);
+        memcpy(to->ts + to->num_samples, from->ts,
+               from->num_samples * sizeof(u64));
+        memcpy(to->values + to->num_samples, from->values,
+               from->num_samples * sizeof(f64));
+        to->num_samples += from->num_samples;
+    }
+}
+
+// Removes the placeholder slices whose 'E' closed nothing, which only
+// malformed traces have.
+static void remove_dropped_slices(Trace *trace) {
+    usize count = 0;
+    for (usize i = 0; i < trace->num_slices; ++i) {
+        TraceSlice slice = trace_get_slice(trace, i);
+        if (slice.track == DROPPED_SLICE_TRACK) {
+            continue;
+        }
+        usize offset;
+        TraceSliceChunk *chunk = trace_get_slice_chunk(trace, count++, &offset);
+        chunk->ts[offset] = slice.ts;
+        chunk->dur[offset] = slice.dur;
+        chunk->name[offset] = slice.name;
+        chunk->track[offset] = slice.track;
+        chunk->depth[offset] = slice.depth;
+        chunk->event[offset] = slice.event;
+    }
+    trace->num_slices = count;
+}
+
+// Rebases the ids in the events, slices and link points of one range to the
+// ones of dst, and moves its events and slices to their offsets in the chunks
+// of dst. Ranges don't share any state here, so they run in parallel.
+static void rebase_range(void *ctx, usize index) {
+    RangeAppend *append = &((RangeAppend *)ctx)[index];
+    Trace *src = append->src;
+    u32 *string_map = append->string_map;
+
+    for (usize c = 0; c < get_num_chunks(src->num_events); ++c) {
+        TraceEventChunk *chunk = &src->chunks[c];
+        usize count = trace_get_chunk_event_count(src, c);
+        for (usize i = 0; i < count; ++i) {
+            chunk->name[i] = string_map[chunk->name[i]];
+            chunk->cat[i] = string_map[chunk->cat[i]];
+            if (chunk->raw[i] & TRACE_RAW_IN_STORE) {
+                chunk->raw[i] += append->raw_block_base;
+            }
+        }
+    }
+    shift_chunks(src->chunks, src->num_events,
+                 append->event_base & TRACE_EVENT_CHUNK_MASK);
+
+    // Placeholders already have the ids of dst.
+    u32 next_end = 0;
+    for (usize c = 0; c < get_num_chunks(src->num_slices); ++c) {
+        TraceSliceChunk *chunk = &src->slice_chunks[c];
+        usize base = c << TRACE_EVENT_CHUNK_SHIFT;
+        usize count = min(src->num_slices - base, TRACE_EVENT_CHUNK_SIZE);
+        for (usize i = 0; i < count; ++i) {
+            if (next_end < src->num_range_ends &&
+                src->range_ends[next_end] == base + i) {
+                next_end++;
+                continue;
+            }
+            u32 track = chunk->track[i];
+            chunk->name[i] = string_map[chunk->name[i]];
+            chunk->track[i] = append->track_map[track];
+            chunk->event[i] += (u32)append->event_base;
+            chunk->depth[i] +=
+                get_carry_depth(append, track, &src->slice_carries[base + i]);
+        }
+    }
+    if (append->num_slices < src->num_slices) {
+        remove_dropped_slices(src);
+    }
+    shift_chunks(src->slice_chunks, append->num_slices,
+                 append->slice_base & TRACE_EVENT_CHUNK_MASK);
+
+    for (usize i = 0; i < src->num_link_points; ++i) {
+        TraceLinkPoint *point = &src->link_points[i];
+        point->cat = string_map[point->cat];
+        point->scope = string_map[point->scope];
+        point->event += (u32)append->event_base;
+        if (point->id & TRACE_LINK_STRING_ID) {
+            point->id = TRACE_LINK_STRING_ID | string_map[(u32)point->id];
+        }
+    }
+}
+
+// Splices the chunks of `append->src` into dst, in range order. The partial
+// last chunk of dst is replaced by the first chunk of src, which has room for
+// its events in front.
+static void end_append(Trace *dst, RangeAppend *append) {
+    Trace *src = append->src;
+    usize event_shift = append->event_base & TRACE_EVENT_CHUNK_MASK;
+    if (src->num_events) {
+        if (event_shift) {
+            copy_chunk_head(&src->chunks[0], &dst->chunks[--dst->num_chunks],
+                            event_shift);
+        }
+        usize n = get_num_chunks(event_shift + src->num_events);
+        memory_reserve_grow(&dst->chunk_table, (dst->num_chunks + n) *
+                                                   sizeof(TraceEventChunk));
+        dst->chunks = (TraceEventChunk *)dst->chunk_table.data;
+        memcpy(dst->chunks + dst->num_chunks, src->chunks,
+               n * sizeof(TraceEventChunk));
+        dst->num_chunks += n;
+    }
+
+    usize slice_shift = append->slice_base & TRACE_EVENT_CHUNK_MASK;
+    if (append->num_slices) {
+        if (slice_shift) {
+            copy_chunk_head(&src->slice_chunks[0],
+                            &dst->slice_chunks[--dst->num_slice_chunks],
+                            slice_shift);
+        }
+        usize n = get_num_chunks(slice_shift + append->num_slices);
+        memory_reserve_grow(&dst->slice_chunk_table,
+                            (dst->num_slice_chunks + n) *
+                                sizeof(TraceSliceChunk));
+        dst->slice_chunks = (TraceSliceChunk *)dst->slice_chunk_table.data;
+        memcpy(dst->slice_chunks + dst->num_slice_chunks, src->slice_chunks,
+               n * sizeof(TraceSliceChunk));
+        dst->num_slice_chunks += n;
+    }
+
+    usize num_link_points = dst->num_link_points + src->num_link_points;
+    if (num_link_points > dst->link_point_capacity) {
+        dst->link_point_capacity =
+            max(dst->link_point_capacity, INITIAL_LINK_POINT_CAPACITY);
+        while (dst->link_point_capacity < num_link_points) {
+            dst->link_point_capacity <<= 1;
+        }
+        dst->link_points = (TraceLinkPoint *)memory_realloc(
+            dst->link_points,
+            dst->link_point_capacity * sizeof(TraceLinkPoint));
+        ASSERT(dst->link_points);
+    }
+    if (src->num_link_points) {
+        memcpy(dst->link_points + dst->num_link_points, src->link_points,
+               src->num_link_points * sizeof(TraceLinkPoint));
+    }
+    dst->num_link_points = num_link_points;
+
+    memory_free(append->x_end_maxes);
+    memory_free(append->x_ends);
+    memory_free(append->x_end_offsets);
+    memory_free(append->carry_opens);
+    memory_free(append->track_map);
+    memory_free(append->string_map);
+}
+
+void trace_append_ranges(Trace *dst, Trace **ranges, usize num_ranges,
+                         usize num_threads) {
+    RangeAppend *appends = (RangeAppend *)memory_alloc(
+        max(num_ranges, (usize)1) * sizeof(RangeAppend));
+    ASSERT(appends);
+    for (usize i = 0; i < num_ranges; ++i) {
+        appends[i] = {.src = ranges[i]};
+        begin_append(dst, &appends[i]);
+    }
+    parallel_for(num_ranges, num_threads, rebase_range, appends);
+    for (usize i = 0; i < num_ranges; ++i) {
+        end_append(dst, &appends[i]);
+    }
+    memory_free(appends);
+}
\ No newline at end of file
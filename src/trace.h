@@ -1,17 +1,690 @@
 #pragma once
 
 #include "src/buf.h"
+#include "src/intern.h"
+#include "src/mapped_file.h"
 #include "src/memory.h"
+#include "src/sketch.h"
+#include "src/trigram.h"
 
 struct TraceEvent {
-    Buf name;
-    Buf cat;
+    // Ids into Trace::strings
+    u32 name;
+    u32 cat;
     u8 ph;
+    // Nanoseconds
     u64 ts;
+    u64 dur;
+    // Thread duration in nanoseconds
+    u64 tdur;
     u32 pid;
     u32 tid;
+    // Span of the event in its source, see TraceRawStore. raw_size is 0 if
+    // the event has no fields other than the ones above.
+    u64 raw;
+    u32 raw_size;
+};
+
+// Events are stored column by column. Each column is split into fixed-size
+// chunks so that appending never moves (or copies) existing events, and a scan
+// over one column only touches the bytes of that column.
+static const usize TRACE_EVENT_CHUNK_SHIFT = 14;
+static const usize TRACE_EVENT_CHUNK_SIZE = (usize)1 << TRACE_EVENT_CHUNK_SHIFT;
+static const usize TRACE_EVENT_CHUNK_MASK = TRACE_EVENT_CHUNK_SIZE - 1;
+
+struct TraceEventChunk {
+    u64 *ts;
+    u64 *dur;
+    u64 *tdur;
+    u64 *raw;
+    u32 *pid;
+    u32 *tid;
+    u32 *name;
+    u32 *cat;
+    u32 *raw_size;
+    u8 *ph;
+};
+
+// Fields that don't have a column (mostly args) are kept as the raw bytes of
+// the event and decoded on demand. If the event lies in the source of the
+// trace (e.g. a mapped file), TraceEvent::raw is its offset there. Otherwise
+// the bytes are copied to the store and raw is TRACE_RAW_IN_STORE | block <<
+// 32 | offset in block.
+//
+// The store is filled block by block. Full blocks are optionally compressed.
+static const u64 TRACE_RAW_IN_STORE = (u64)1 << 63;
+
+struct TraceRawBlock {
+    u8 *data;
+    u32 size;
+    // 0 if the block is not compressed.
+    u32 compressed_size;
+};
+
+struct TraceRawStore {
+    bool compress;
+    TraceRawBlock *blocks;
+    usize num_blocks;
+    usize block_capacity;
+
+    // The block being filled. Bytes from pending_start belong to the event
+    // being parsed.
+    u8 *current;
+    usize current_size;
+    usize current_capacity;
+    usize pending_start;
+};
+
+// A span of time on a track, either an 'X' event or a matched pair of 'B' and
+// 'E' events. Slices are stored in the order they are completed.
+struct TraceSlice {
+    u64 ts;
+    u64 dur;
+    u32 name;
+    // Index into Trace::tracks
+    u32 track;
+    // Nesting level in the track, 0 for top level slices.
+    u32 depth;
+    // Index of the 'X' or 'B' event
+    u32 event;
+};
+
+struct TraceSliceChunk {
+    u64 *ts;
+    u64 *dur;
+    u32 *name;
+    u32 *track;
+    u32 *depth;
+    u32 *event;
+};
+
+// Where a slice of a range trace (see Trace::is_range) starts, relative to
+// the state of its track at the start of the range. That state is only known
+// once the range is appended to the trace of the previous ranges.
+struct TraceRangeCarry {
+    // 'E' events of the track so far that had no 'B' in the range. Each one
+    // closes a 'B' of the previous ranges, if any is left.
+    u32 num_unmatched_ends;
+    // Set if all the 'X' slices of the track in the range had ended at some
+    // event, the latest one at x_pop_ts. 'X' slices of the previous ranges
+    // that end at or before it have ended too.
+    bool x_popped;
+    u64 x_pop_ts;
+};
+
+// A 'B' event waiting for its 'E'.
+struct TraceOpenSlice {
+    u64 ts;
+    u32 name;
+    u32 event;
+    u32 depth;
+    TraceRangeCarry carry;
+};
+
+// Summary of the slices of one depth that overlap a span of time. The
+// overlapping slices are contiguous in TraceTrack::slices.
+struct TraceLodBucket {
+    // Sum of the overlaps with the bucket.
+    u64 coverage;
+    // Position in TraceTrack::slices of the first overlapping slice.
+    u32 first;
+    u32 count;
+    // Position in TraceTrack::slices of the slice that covers the most of the
+    // bucket.
+    u32 busiest;
+};
+
+// Buckets [first_bucket, first_bucket + num_buckets) of one width. Bucket i
+// covers [i << shift, (i + 1) << shift).
+struct TraceLodLevel {
+    u32 shift;
+    u32 num_buckets;
+    u64 first_bucket;
+    TraceLodBucket *buckets;
+};
+
+// Level of detail pyramid of one depth of a track. Bucket width doubles from
+// one level to the next, the last level has a single bucket.
+struct TraceLod {
+    TraceLodLevel *levels;
+    u32 num_levels;
+};
+
+// Aggregates of slices that share a name. Durations are in ns.
+struct TraceNameStats {
+    u32 count;
+    u64 total_dur;
+    // Total minus the time covered by direct children.
+    u64 self_dur;
+    u64 min_dur;
+    u64 max_dur;
+};
+
+// Shortest and longest duration of a range of slices.
+struct TraceDurRange {
+    u64 min;
+    u64 max;
+};
+
+// Slices of a track with one name, at [begin, end) in the name order of the
+// track.
+struct TraceNameRun {
+    u32 name;
+    u32 begin;
+    u32 end;
+    TraceNameStats stats;
+};
+
+// Slices of one (pid, tid).
+struct TraceTrack {
+    u32 pid;
+    u32 tid;
+
+    TraceOpenSlice *open;
+    u32 num_open;
+    u32 open_capacity;
+
+    // End times of the 'X' slices that contain the last one. Depth of 'X'
+    // slices assumes that they arrive in order of start time within a track,
+    // trace_build_index() recomputes it from sorted slices.
+    u64 *x_ends;
+    u32 num_x_ends;
+    u32 x_end_capacity;
+    // Only used by range traces.
+    TraceRangeCarry carry;
+
+    // Timeline index built by trace_build_index(). Slices of the track sorted
+    // by depth and then by start time. Slices at the same depth never
+    // overlap, so their ends are sorted too and double as the running max
+    // end.
+    u32 num_slices;
+    u32 num_depths;
+    // Slices at depth d are in [depth_offsets[d], depth_offsets[d + 1]).
+    u32 *depth_offsets;
+    // Index into the slices of the trace.
+    u32 *slices;
+    u64 *starts;
+    u64 *ends;
+
+    // Built by trace_build_lod(), one per depth.
+    TraceLod *lods;
+
+    // Built by trace_build_name_stats(). Slices of the track sorted by name
+    // and then by start time, grouped into runs of one name. The prefix sums
+    // have num_slices + 1 entries, e.g. total_prefix[i] is the total duration
+    // of the first i slices.
+    TraceNameRun *name_runs;
+    u32 num_name_runs;
+    u64 *name_starts;
+    u64 *total_prefix;
+    u64 *self_prefix;
+    // Duration ranges of blocks of slices in name order, as a segment tree:
+    // block i is node num_name_blocks + i, and node i covers nodes 2i and
+    // 2i + 1.
+    TraceDurRange *dur_ranges;
+    u32 num_name_blocks;
+};
+
+// Positions [begin, end) in a sorted column, e.g. TraceTrack::slices.
+struct TraceRange {
+    u32 begin;
+    u32 end;
+};
+
+// Min and max of the values of consecutive samples. Bucket i covers samples
+// [i << shift, (i + 1) << shift).
+struct TraceCounterLevel {
+    u32 shift;
+    u32 num_buckets;
+    f64 *min;
+    f64 *max;
+};
+
+// Values of one key in the args of the 'C' events with the same pid and name.
+struct TraceCounterSeries {
+    u32 pid;
+    u32 name;
+    // The key in args
+    u32 series;
+
+    // Sorted by time by trace_build_index().
+    u64 *ts;
+    f64 *values;
+    u32 num_samples;
+    u32 sample_capacity;
+
+    // Built by trace_build_index(). Bucket size doubles from one level to the
+    // next, the last level has a single bucket.
+    TraceCounterLevel *levels;
+    u32 num_levels;
+};
+
+enum TraceLinkKind {
+    // Flow events 's', 't' and 'f'.
+    TraceLink_FlowStart,
+    TraceLink_FlowStep,
+    TraceLink_FlowEnd,
+    // Slices with "flow_out" or "flow_in" set, bound by "bind_id".
+    TraceLink_FlowOut,
+    TraceLink_FlowIn,
+    // Async events 'b', 'e' and 'n', and the legacy 'S', 'F', 'T' and 'p'.
+    TraceLink_AsyncBegin,
+    TraceLink_AsyncEnd,
+    TraceLink_AsyncInstant,
+};
+
+// Set in TraceLinkPoint::id if the id is a string, the low 32 bits are its
+// string id.
+static const u64 TRACE_LINK_STRING_ID = 1ULL << 63;
+
+// An event that is part of a flow or an async operation. Points with the same
+// (cat, id, scope), and pid if local, are joined by trace_build_index().
+struct TraceLinkPoint {
+    u64 id;
+    u32 cat;
+    u32 scope;
+    u32 pid;
+    u32 event;
+    u8 kind;
+    // The id is scoped to the process ("id2": {"local": ...}).
+    bool local;
+};
+
+// An arrow between two slices.
+struct TraceFlow {
+    u32 from;
+    u32 to;
+};
+
+// A matched pair of async begin and end events, or an async instant.
+struct TraceAsyncSlice {
+    u64 ts;
+    u64 dur;
+    u32 name;
+    // Index into Trace::async_groups
+    u32 group;
+    // Nesting level among the slices of the group.
+    u32 depth;
+    // Index of the begin event
+    u32 event;
+    // Row in the async track of the process, so that slices in the same lane
+    // never overlap.
+    u32 lane;
+};
+
+// Async slices that share an id, in order of start time.
+struct TraceAsyncGroup {
+    u64 id;
+    u32 cat;
+    u32 pid;
+    // Slices [first, first + count) in Trace::async_slices.
+    u32 first;
+    u32 count;
+};
+
+// TraceTrackInfo::tid of the info of a whole process.
+static const u32 TRACE_PROCESS_TID = ~0u;
+
+// Decoded metadata ('M') events of a process or a thread.
+struct TraceTrackInfo {
+    u32 pid;
+    u32 tid;
+    // From "process_name" or "thread_name", 0 if not set.
+    u32 name;
+    bool has_sort_index;
+    // From "process_sort_index" or "thread_sort_index".
+    i32 sort_index;
+};
+
+// Async slices of one process.
+struct TraceAsyncTrack {
+    u32 pid;
+    u32 num_lanes;
+    // Indices into Trace::async_slices, sorted by start time.
+    u32 *slices;
+    u32 num_slices;
+};
+
+// A consistent read-only view of the events, slices, tracks and strings pushed
+// up to a watermark, for readers that run while the trace is still loading.
+// Publishing one is O(1) and copies no columns: columns are appended in chunks
+// that never move, and tables either grow in place or leave their old copy
+// alive when they grow, so the view stays valid while more events are pushed,
+// until the next snapshot is published. Slices are as built while loading: 'B'
+// slices appear once they end, and depths are only final after
+// trace_build_index().
+struct TraceSnapshot {
+    // Incremented by every publication, 0 if nothing was published.
+    u64 version;
+    usize num_events;
+    TraceEventChunk *chunks;
+    usize num_slices;
+    TraceSliceChunk *slice_chunks;
+    usize num_tracks;
+    TraceTrack *tracks;
+    usize num_strings;
+    Buf *strings;
+    // The largest end time of the events.
+    u64 end_ts;
 };
 
 struct Trace {
     MemoryArena arena;
+    // Event names and categories
+    InternTable strings;
+    // The file the trace was parsed from in place, if any. Strings may point
+    // into it.
+    MappedFile file;
+    TraceRawStore raw;
+
+    // If set, the trace holds a range of the events of another trace, which
+    // it is appended to with trace_append(). Slices are built within the
+    // range, and 'E' events that may close a 'B' of the previous ranges get
+    // a placeholder slice, listed in range_ends, which is filled or dropped
+    // when the range is appended. Depths are relative to the range and
+    // rebased from slice_carries, indexed by slice.
+    bool is_range;
+    u32 *range_ends;
+    u32 num_range_ends;
+    u32 range_end_capacity;
+    TraceRangeCarry *slice_carries;
+    usize slice_carry_capacity;
+    TraceTrack *tracks;
+    usize num_tracks;
+    usize track_capacity;
+    // Open addressing hash table of track id + 1 (0 means empty).
+    u32 *track_slots;
+    usize track_slot_mask;
+
+    // Points into slice_chunk_table, which grows in place.
+    TraceSliceChunk *slice_chunks;
+    MemoryReserve slice_chunk_table;
+    usize num_slice_chunks;
+    usize num_slices;
+    // The largest end time of all events, slices that are still open at the
+    // end of the trace end here.
+    u64 end_ts;
+
+    TraceCounterSeries *counters;
+    usize num_counters;
+    usize counter_capacity;
+    // Open addressing hash table of counter id + 1 (0 means empty).
+    u32 *counter_slots;
+    usize counter_slot_mask;
+
+    // Durations of the slices of each name, indexed by name. Updated as events
+    // are pushed, 'X' slices right away even if slices are deferred.
+    Sketch *duration_sketches;
+    usize num_duration_sketches;
+
+    // Trigrams of the strings [0, num_indexed_names), see trace_index_names().
+    TrigramIndex name_trigrams;
+    u32 num_indexed_names;
+    // Built by trace_build_index(). The slices named n, in order of id, are
+    // name_slices[name_slice_offsets[n], name_slice_offsets[n + 1]) for n
+    // below num_sliced_names.
+    u32 *name_slice_offsets;
+    u32 *name_slices;
+    u32 num_sliced_names;
+
+    // Built by trace_build_name_stats(), indexed by name.
+    TraceNameStats *name_stats;
+    usize num_name_stats;
+
+    TraceTrackInfo *track_infos;
+    usize num_track_infos;
+    usize track_info_capacity;
+    // Open addressing hash table of track info id + 1 (0 means empty).
+    u32 *track_info_slots;
+    usize track_info_slot_mask;
+    // Built by trace_build_index(). Track ids in display order: by process
+    // sort index and pid, then by thread sort index and tid.
+    u32 *track_order;
+
+    TraceLinkPoint *link_points;
+    usize num_link_points;
+    usize link_point_capacity;
+
+    // Built by trace_build_index(). Flows are sorted by `from`, and the flows
+    // out of slice i are [flow_out_offsets[i], flow_out_offsets[i + 1]).
+    // flow_in holds the indices of the flows sorted by `to`, with
+    // flow_in_offsets in the same way.
+    TraceFlow *flows;
+    usize num_flows;
+    u32 *flow_out_offsets;
+    u32 *flow_in_offsets;
+    u32 *flow_in;
+
+    // Built by trace_build_index(), grouped by TraceAsyncGroup.
+    TraceAsyncSlice *async_slices;
+    usize num_async_slices;
+    TraceAsyncGroup *async_groups;
+    usize num_async_groups;
+    TraceAsyncTrack *async_tracks;
+    usize num_async_tracks;
+
+    // Points into chunk_table, which grows in place.
+    TraceEventChunk *chunks;
+    MemoryReserve chunk_table;
+    usize num_chunks;
+    usize num_events;
+
+    // The last published snapshot.
+    TraceSnapshot snapshot;
+};
+
+void trace_init(Trace *trace);
+void trace_deinit(Trace *trace);
+
+// Takes ownership of `file`. Strings interned from it are not copied.
+void trace_set_file(Trace *trace, MappedFile file);
+
+void trace_push_event(Trace *trace, TraceEvent *event);
+
+// Appends the events of the range traces to `dst` in order, as if they were
+// pushed to it, and moves their memory to it: the arena of each range is
+// adopted and its chunks are spliced into `dst`. Only state that crosses
+// ranges, such as 'B' events that are still open, is merged one range after
+// another. Ids in the ranges are rebased on up to `num_threads` threads. The
+// ranges must share the source of `dst`, and can only be deinitialized
+// afterwards.
+void trace_append_ranges(Trace *dst, Trace **ranges, usize num_ranges,
+                         usize num_threads);
+
+inline void trace_append(Trace *dst, Trace *src) {
+    trace_append_ranges(dst, &src, 1, 1);
+}
+
+// Ends the slices that are still open at the end of the trace. Range traces
+// leave them to the trace that they are appended to.
+void trace_finish(Trace *trace);
+
+// Builds the timeline index of every track and recomputes the depths of
+// slices from it, sorts and downsamples counters, and resolves flows and async
+// slices. Must be called once after trace_finish().
+void trace_build_index(Trace *trace);
+
+// Returns the sketch of the durations of slices named `name`, or null if there
+// are none.
+Sketch *trace_get_duration_sketch(Trace *trace, u32 name);
+
+// Adds the strings interned since the last call to the trigram index of names.
+// Searches catch up by themselves, loaders can call this as they go to spread
+// the cost.
+void trace_index_names(Trace *trace);
+
+// A search of slices by name. Matching names are found up front, slices are
+// paged in lazily.
+struct TraceSearch {
+    u32 *names;
+    u32 num_names;
+    u32 name_index;
+    u32 offset;
 };
+
+// Starts a search of the slices whose name contains `query`, after
+// trace_build_index(). ASCII letters match regardless of case if
+// `ignore_case`.
+void trace_search_begin(Trace *trace, Buf query, bool ignore_case,
+                        TraceSearch *search);
+
+// Writes the ids of up to `max_count` more matching slices to `slices`,
+// grouped by name. Returns how many were written, 0 at the end.
+u32 trace_search_next(Trace *trace, TraceSearch *search, u32 *slices,
+                      u32 max_count);
+
+void trace_search_end(TraceSearch *search);
+
+bool trace_find_track(Trace *trace, u32 pid, u32 tid, u32 *id);
+
+// Returns the slices at `depth` of an indexed track that overlap [t0, t1], in
+// O(log n).
+TraceRange trace_track_query(TraceTrack *track, u32 depth, u64 t0, u64 t1);
+
+// Returns the info of (pid, tid), or of the process if tid is
+// TRACE_PROCESS_TID. Null if there is none.
+TraceTrackInfo *trace_find_track_info(Trace *trace, u32 pid, u32 tid);
+// Like trace_find_track_info(), but adds an empty info if there is none.
+TraceTrackInfo *trace_get_track_info(Trace *trace, u32 pid, u32 tid);
+
+void trace_push_link_point(Trace *trace, TraceLinkPoint *point);
+
+// Returns the flows out of `slice` as positions in Trace::flows, in O(1).
+inline TraceRange trace_get_flows_out(Trace *trace, u32 slice) {
+    if (!trace->num_flows) {
+        return {};
+    }
+    return {trace->flow_out_offsets[slice], trace->flow_out_offsets[slice + 1]};
+}
+
+// Returns the flows into `slice` as positions in Trace::flow_in, in O(1).
+inline TraceRange trace_get_flows_in(Trace *trace, u32 slice) {
+    if (!trace->num_flows) {
+        return {};
+    }
+    return {trace->flow_in_offsets[slice], trace->flow_in_offsets[slice + 1]};
+}
+
+// Adds a sample to the series of a counter, creating the series if needed.
+void trace_push_counter_sample(Trace *trace, u32 pid, u32 name, u32 series,
+                               u64 ts, f64 value);
+
+bool trace_find_counter(Trace *trace, u32 pid, u32 name, u32 series,
+                        u32 *id);
+
+// Returns the samples of an indexed series that are visible in [t0, t1]: the
+// ones inside, and the last one before t0 whose value holds at t0.
+TraceRange trace_counter_query(TraceCounterSeries *counter, u64 t0, u64 t1);
+
+// Returns the coarsest level whose buckets have at most `num_samples`
+// samples, or null if samples should be drawn directly.
+TraceCounterLevel *trace_counter_get_level(TraceCounterSeries *counter,
+                                           u32 num_samples);
+
+// Builds the level of detail pyramids of every track from the timeline index,
+// using up to `num_threads` threads.
+void trace_build_lod(Trace *trace, usize num_threads);
+
+// Returns the coarsest level whose buckets are at most `width` wide, or null if
+// even the finest level is too coarse, in which case slices should be queried
+// directly.
+TraceLodLevel *trace_lod_get_level(TraceLod *lod, u64 width);
+
+// Aggregates the slices of every track by name after trace_build_index(),
+// using up to `num_threads` threads.
+void trace_build_name_stats(Trace *trace, usize num_threads);
+
+// Writes the aggregates of the slices that start in [t0, t1] into `stats`,
+// indexed by name, which must have room for trace->num_name_stats entries.
+// Counts and totals come from the prefix sums, and min and max of runs that
+// are cut by the range from TraceTrack::dur_ranges, in O(log n) per name run.
+void trace_query_name_stats(Trace *trace, u64 t0, u64 t1,
+                            TraceNameStats *stats);
+
+inline f64 trace_name_stats_get_mean(TraceNameStats *stats) {
+    return stats->count ? (f64)stats->total_dur / stats->count : 0;
+}
+
+// Appends bytes of the event being parsed to the raw store.
+void trace_append_pending_raw(Trace *trace, Buf bytes);
+// Ends the pending bytes and returns their span for TraceEvent::raw.
+u64 trace_commit_pending_raw(Trace *trace, u32 *size);
+void trace_discard_pending_raw(Trace *trace);
+
+// Returns true if `bytes` lies in the source of the trace, in which case
+// `offset` is set to its offset there.
+inline bool trace_get_source_offset(Trace *trace, Buf bytes, u64 *offset) {
+    if (!intern_table_is_in_source(&trace->strings, bytes)) {
+        return false;
+    }
+    *offset = bytes.data - trace->strings.source.data;
+    return true;
+}
+
+// Returns the raw bytes of the event at `index`, or an empty Buf if it has
+// none. Compressed blocks are decompressed into `arena`.
+Buf trace_get_event_raw(Trace *trace, usize index, MemoryArena *arena);
+
+inline u32 trace_intern(Trace *trace, Buf str) {
+    return intern_table_intern(&trace->strings, str);
+}
+
+inline Buf trace_get_string(Trace *trace, u32 id) {
+    return intern_table_get(&trace->strings, id);
+}
+
+inline usize trace_get_event_count(Trace *trace) { return trace->num_events; }
+
+// Returns the chunk that contains the event at `index`, and the offset of the
+// event inside that chunk.
+inline TraceEventChunk *trace_get_event_chunk(Trace *trace, usize index,
+                                              usize *offset) {
+    ASSERT(index < trace->num_events);
+    *offset = index & TRACE_EVENT_CHUNK_MASK;
+    return &trace->chunks[index >> TRACE_EVENT_CHUNK_SHIFT];
+}
+
+// Returns the number of valid events in the given chunk.
+inline usize trace_get_chunk_event_count(Trace *trace, usize chunk_index) {
+    ASSERT(chunk_index < trace->num_chunks);
+    usize start = chunk_index << TRACE_EVENT_CHUNK_SHIFT;
+    return min(trace->num_events - start, TRACE_EVENT_CHUNK_SIZE);
+}
+
+TraceEvent trace_get_event(Trace *trace, usize index);
+
+inline usize trace_get_slice_count(Trace *trace) { return trace->num_slices; }
+
+inline TraceSliceChunk *trace_get_slice_chunk(Trace *trace, usize index,
+                                              usize *offset) {
+    ASSERT(index < trace->num_slices);
+    *offset = index & TRACE_EVENT_CHUNK_MASK;
+    return &trace->slice_chunks[index >> TRACE_EVENT_CHUNK_SHIFT];
+}
+
+TraceSlice trace_get_slice(Trace *trace, usize index);
+
+// Publishes a snapshot of everything pushed so far to trace->snapshot. The
+// previous snapshot is no longer valid.
+void trace_publish_snapshot(Trace *trace);
+
+inline TraceEventChunk *trace_snapshot_get_event_chunk(TraceSnapshot *snapshot,
+                                                       usize index,
+                                                       usize *offset) {
+    ASSERT(index < snapshot->num_events);
+    *offset = index & TRACE_EVENT_CHUNK_MASK;
+    return &snapshot->chunks[index >> TRACE_EVENT_CHUNK_SHIFT];
+}
+
+inline TraceSliceChunk *trace_snapshot_get_slice_chunk(TraceSnapshot *snapshot,
+                                                       usize index,
+                                                       usize *offset) {
+    ASSERT(index < snapshot->num_slices);
+    *offset = index & TRACE_EVENT_CHUNK_MASK;
+    return &snapshot->slice_chunks[index >> TRACE_EVENT_CHUNK_SHIFT];
+}
+
+inline Buf trace_snapshot_get_string(TraceSnapshot *snapshot, u32 id) {
+    ASSERT(id < snapshot->num_strings);
+    return snapshot->strings[id];
+}
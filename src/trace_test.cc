@@ -0,0 +1,786 @@
+#include "src/trace.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <vector>
+
+TEST(TraceTest, Empty) {
+    Trace trace;
+    trace_init(&trace);
+    ASSERT_EQ(trace_get_event_count(&trace), 0);
+    ASSERT_EQ(trace.num_chunks, 0);
+    trace_deinit(&trace);
+}
+
+TEST(TraceTest, PushAndGetEvents) {
+    Trace trace;
+    trace_init(&trace);
+
+    usize count = TRACE_EVENT_CHUNK_SIZE * 2 + 3;
+    for (usize i = 0; i < count; ++i) {
+        TraceEvent event = {
+            .name = (u32)(i % 7),
+            .cat = (u32)(i % 3),
+            .ph = 'X',
+            .ts = i * 10,
+            .dur = i,
+            .pid = 1,
+            .tid = (u32)(i % 5),
+        };
+        trace_push_event(&trace, &event);
+    }
+
+    ASSERT_EQ(trace_get_event_count(&trace), count);
+    ASSERT_EQ(trace.num_chunks, 3);
+    ASSERT_EQ(trace_get_chunk_event_count(&trace, 0), TRACE_EVENT_CHUNK_SIZE);
+    ASSERT_EQ(trace_get_chunk_event_count(&trace, 2), 3);
+
+    for (usize i = 0; i < count; ++i) {
+        TraceEvent event = trace_get_event(&trace, i);
+        ASSERT_EQ(event.name, i % 7);
+        ASSERT_EQ(event.cat, i % 3);
+        ASSERT_EQ(event.ph, 'X');
+        ASSERT_EQ(event.ts, i * 10);
+        ASSERT_EQ(event.dur, i);
+        ASSERT_EQ(event.pid, 1);
+        ASSERT_EQ(event.tid, i % 5);
+    }
+
+    usize offset;
+    TraceEventChunk *chunk =
+        trace_get_event_chunk(&trace, TRACE_EVENT_CHUNK_SIZE + 1, &offset);
+    ASSERT_EQ(chunk, &trace.chunks[1]);
+    ASSERT_EQ(offset, 1);
+    ASSERT_EQ(chunk->ts[offset], (TRACE_EVENT_CHUNK_SIZE + 1) * 10);
+
+    trace_deinit(&trace);
+}
+
+TEST(TraceTest, Append) {
+    Trace a;
+    trace_init(&a);
+    Trace b;
+    trace_init(&b);
+    b.is_range = true;
+
+    u32 x = trace_intern(&a, STR_LITERAL("x"));
+    TraceEvent event = {.name = x, .ph = 'i', .ts = 1};
+    trace_push_event(&a, &event);
+
+    // Unaligned with the chunks of `a`, so the chunks of `b` are shifted.
+    u32 y = trace_intern(&b, STR_LITERAL("y"));
+    u32 bx = trace_intern(&b, STR_LITERAL("x"));
+    usize count = TRACE_EVENT_CHUNK_SIZE + 5;
+    for (usize i = 0; i < count; ++i) {
+        TraceEvent event = {
+            .name = i % 2 ? y : bx,
+            .cat = y,
+            .ph = 'X',
+            .ts = i + 2,
+            .tid = (u32)i,
+        };
+        trace_push_event(&b, &event);
+    }
+
+    trace_append(&a, &b);
+    trace_deinit(&b);
+
+    ASSERT_EQ(trace_get_event_count(&a), count + 1);
+    u32 ay = trace_intern(&a, STR_LITERAL("y"));
+    ASSERT_EQ(ay, x + 1);
+    for (usize i = 0; i < count; ++i) {
+        TraceEvent event = trace_get_event(&a, i + 1);
+        ASSERT_EQ(event.name, i % 2 ? ay : x);
+        ASSERT_EQ(event.cat, ay);
+        ASSERT_EQ(event.ts, i + 2);
+        ASSERT_EQ(event.tid, i);
+        TraceSlice slice = trace_get_slice(&a, i);
+        ASSERT_EQ(slice.ts, i + 2);
+        ASSERT_EQ(slice.name, i % 2 ? ay : x);
+        ASSERT_EQ(slice.event, i + 1);
+    }
+
+    trace_deinit(&a);
+}
+
+static void push_event(Trace *trace, u8 ph, u64 ts, u64 dur, u32 name,
+                       u32 tid = 1) {
+    TraceEvent event = {
+        .name = name, .ph = ph, .ts = ts, .dur = dur, .pid = 1, .tid = tid};
+    trace_push_event(trace, &event);
+}
+
+TEST(TraceTest, Slices) {
+    Trace trace;
+    trace_init(&trace);
+
+    push_event(&trace, 'B', 10, 0, 1);
+    push_event(&trace, 'X', 12, 3, 2);
+    push_event(&trace, 'B', 20, 0, 3, 2);
+    push_event(&trace, 'B', 30, 0, 4);
+    push_event(&trace, 'X', 31, 2, 5);
+    push_event(&trace, 'E', 40, 0, 0);
+    push_event(&trace, 'E', 50, 0, 0);
+    // Ignored because there is no open slice.
+    push_event(&trace, 'E', 55, 0, 0);
+    push_event(&trace, 'X', 60, 5, 6);
+
+    // The 'B' on track 2 is still open.
+    ASSERT_EQ(trace_get_slice_count(&trace), 5);
+    trace_finish(&trace);
+    trace_finish(&trace);
+    ASSERT_EQ(trace_get_slice_count(&trace), 6);
+    ASSERT_EQ(trace.num_tracks, 2);
+
+    u32 track1, track2, track3;
+    ASSERT_TRUE(trace_find_track(&trace, 1, 1, &track1));
+    ASSERT_TRUE(trace_find_track(&trace, 1, 2, &track2));
+    ASSERT_FALSE(trace_find_track(&trace, 1, 3, &track3));
+
+    struct {
+        u64 ts, dur;
+        u32 name, track, depth, event;
+    } expected[] = {
+        {12, 3, 2, track1, 1, 1},  {31, 2, 5, track1, 2, 4},
+        {30, 10, 4, track1, 1, 3}, {10, 40, 1, track1, 0, 0},
+        {60, 5, 6, track1, 0, 8},  {20, 45, 3, track2, 0, 2},
+    };
+    // The open slice ends at the end of the trace.
+    for (usize i = 0; i < 6; ++i) {
+        TraceSlice slice = trace_get_slice(&trace, i);
+        ASSERT_EQ(slice.ts, expected[i].ts) << i;
+        ASSERT_EQ(slice.dur, expected[i].dur) << i;
+        ASSERT_EQ(slice.name, expected[i].name) << i;
+        ASSERT_EQ(slice.track, expected[i].track) << i;
+        ASSERT_EQ(slice.depth, expected[i].depth) << i;
+        ASSERT_EQ(slice.event, expected[i].event) << i;
+    }
+
+    trace_deinit(&trace);
+}
+
+TEST(TraceTest, AppendSlices) {
+    Trace a;
+    trace_init(&a);
+    Trace b;
+    trace_init(&b);
+    b.is_range = true;
+
+    u32 x = trace_intern(&a, STR_LITERAL("x"));
+    push_event(&a, 'B', 1, 0, x);
+    push_event(&b, 'X', 2, 1, 0);
+    // Keeps a placeholder for the slice that it may close.
+    push_event(&b, 'E', 5, 0, 0);
+    ASSERT_EQ(trace_get_slice_count(&b), 2);
+
+    trace_append(&a, &b);
+    trace_deinit(&b);
+
+    ASSERT_EQ(trace_get_slice_count(&a), 2);
+    TraceSlice slice = trace_get_slice(&a, 0);
+    ASSERT_EQ(slice.depth, 1);
+    ASSERT_EQ(slice.event, 1);
+    slice = trace_get_slice(&a, 1);
+    ASSERT_EQ(slice.ts, 1);
+    ASSERT_EQ(slice.dur, 4);
+    ASSERT_EQ(slice.name, x);
+    ASSERT_EQ(slice.depth, 0);
+
+    trace_deinit(&a);
+}
+
+TEST(TraceTest, AppendRangeDepths) {
+    Trace a;
+    trace_init(&a);
+    Trace b;
+    trace_init(&b);
+    b.is_range = true;
+
+    // The same ids in both traces.
+    Buf names[] = {STR_LITERAL("1"), STR_LITERAL("2"), STR_LITERAL("3"),
+                   STR_LITERAL("4"), STR_LITERAL("5"), STR_LITERAL("6"),
+                   STR_LITERAL("7")};
+    for (usize i = 0; i < 7; ++i) {
+        ASSERT_EQ(trace_intern(&a, names[i]), i + 1);
+        ASSERT_EQ(trace_intern(&b, names[i]), i + 1);
+    }
+
+    push_event(&a, 'X', 0, 100, 1);
+    push_event(&a, 'X', 10, 20, 2);
+    push_event(&a, 'B', 15, 0, 3);
+    // Inside both 'X' slices of `a` and the 'B'.
+    push_event(&b, 'X', 16, 1, 4);
+    // Closes the 'B' of `a`.
+    push_event(&b, 'E', 18, 0, 0);
+    // Only inside the first 'X' of `a`.
+    push_event(&b, 'X', 40, 5, 5);
+    push_event(&b, 'B', 50, 0, 6);
+    // Closes nothing, so its placeholder is dropped.
+    push_event(&b, 'E', 51, 0, 0);
+    push_event(&b, 'E', 52, 0, 0);
+    // After every slice of `a`.
+    push_event(&b, 'X', 200, 1, 7);
+
+    trace_append(&a, &b);
+    trace_deinit(&b);
+
+    struct {
+        u64 ts, dur;
+        u32 name, depth, event;
+    } expected[] = {
+        {0, 100, 1, 0, 0},  {10, 20, 2, 1, 1}, {16, 1, 4, 3, 3},
+        {15, 3, 3, 2, 2},   {40, 5, 5, 1, 5},  {50, 1, 6, 1, 6},
+        {200, 1, 7, 0, 9},
+    };
+    ASSERT_EQ(trace_get_slice_count(&a), 7);
+    for (usize i = 0; i < 7; ++i) {
+        TraceSlice slice = trace_get_slice(&a, i);
+        ASSERT_EQ(slice.ts, expected[i].ts) << i;
+        ASSERT_EQ(slice.dur, expected[i].dur) << i;
+        ASSERT_EQ(slice.name, expected[i].name) << i;
+        ASSERT_EQ(slice.depth, expected[i].depth) << i;
+        ASSERT_EQ(slice.event, expected[i].event) << i;
+    }
+
+    trace_deinit(&a);
+}
+
+TEST(TraceTest, DurationSketches) {
+    Trace a;
+    trace_init(&a);
+    Trace b;
+    trace_init(&b);
+    b.is_range = true;
+    Trace c;
+    trace_init(&c);
+    c.is_range = true;
+
+    u32 x = trace_intern(&a, STR_LITERAL("x"));
+    u32 y = trace_intern(&a, STR_LITERAL("y"));
+    push_event(&a, 'B', 0, 0, x);
+    push_event(&a, 'X', 1, 100, y);
+    // The last 'E' closes the 'B' of `a`, so it is only sketched when
+    // appending.
+    u32 by = trace_intern(&b, STR_LITERAL("y"));
+    u32 bx = trace_intern(&b, STR_LITERAL("x"));
+    push_event(&b, 'X', 200, 300, by);
+    push_event(&b, 'B', 600, 0, bx);
+    push_event(&b, 'E', 610, 0, 0);
+    push_event(&b, 'E', 1000, 0, 0);
+    ASSERT_EQ(trace_get_duration_sketch(&b, bx)->count, 1);
+    ASSERT_EQ(trace_get_duration_sketch(&b, by)->count, 1);
+    // The pair is sketched in c and not again after the append.
+    u32 cx = trace_intern(&c, STR_LITERAL("x"));
+    push_event(&c, 'B', 2000, 0, cx);
+    push_event(&c, 'E', 2020, 0, 0);
+    ASSERT_EQ(trace_get_duration_sketch(&c, cx)->count, 1);
+
+    trace_append(&a, &b);
+    trace_append(&a, &c);
+    push_event(&a, 'B', 3000, 0, x);
+    push_event(&a, 'X', 3000, 0, x);
+    trace_finish(&a);
+
+    // x: 1000, 10, 20, 0 and the open slice that ends at 3000.
+    Sketch *sketch = trace_get_duration_sketch(&a, x);
+    ASSERT_EQ(sketch->count, 5);
+    ASSERT_EQ(sketch->zero_count, 2);
+    ASSERT_EQ(sketch->min, 0);
+    ASSERT_EQ(sketch->max, 1000);
+    ASSERT_EQ(sketch_get_quantile(sketch, 1), 1000);
+    u64 median = sketch_get_quantile(sketch, 0.5);
+    ASSERT_GE(median, 9);
+    ASSERT_LE(median, 11);
+    sketch = trace_get_duration_sketch(&a, y);
+    ASSERT_EQ(sketch->count, 2);
+    ASSERT_EQ(sketch_get_quantile(sketch, 0), 100);
+    ASSERT_EQ(sketch_get_quantile(sketch, 1), 300);
+    ASSERT_EQ(trace_get_duration_sketch(&a, trace_intern(&a, {})), nullptr);
+
+    trace_deinit(&c);
+    trace_deinit(&b);
+    trace_deinit(&a);
+}
+
+TEST(TraceTest, TimelineIndex) {
+    Trace trace;
+    trace_init(&trace);
+
+    // Out of start order, so the depths are only right after the index is
+    // built.
+    push_event(&trace, 'X', 10, 10, 1);
+    push_event(&trace, 'X', 60, 5, 2);
+    push_event(&trace, 'X', 0, 100, 3);
+    push_event(&trace, 'X', 50, 20, 4);
+    push_event(&trace, 'X', 200, 10, 5);
+    trace_finish(&trace);
+    trace_build_index(&trace);
+
+    u32 depths[] = {1, 2, 0, 1, 0};
+    for (usize i = 0; i < 5; ++i) {
+        ASSERT_EQ(trace_get_slice(&trace, i).depth, depths[i]) << i;
+    }
+
+    TraceTrack *track = &trace.tracks[0];
+    ASSERT_EQ(track->num_depths, 3);
+    TraceRange range = trace_track_query(track, 0, 100, 150);
+    ASSERT_EQ(range.end - range.begin, 1);
+    ASSERT_EQ(track->slices[range.begin], 2);
+    range = trace_track_query(track, 0, 101, 199);
+    ASSERT_EQ(range.end - range.begin, 0);
+    range = trace_track_query(track, 1, 15, 55);
+    ASSERT_EQ(range.end - range.begin, 2);
+    ASSERT_EQ(track->slices[range.begin], 0);
+    ASSERT_EQ(track->slices[range.begin + 1], 3);
+    range = trace_track_query(track, 3, 0, 1000);
+    ASSERT_EQ(range.end - range.begin, 0);
+
+    trace_deinit(&trace);
+}
+
+TEST(TraceTest, TimelineIndexMatchesScan) {
+    Trace trace;
+    trace_init(&trace);
+
+    // Nested slices from a deterministic pseudo random sequence.
+    u64 seed = 1;
+    u64 ts = 0;
+    for (usize i = 0; i < 20000; ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        u32 r = (u32)(seed >> 33);
+        if (r % 3 == 0) {
+            push_event(&trace, 'B', ts, 0, 0, r % 4);
+        } else if (r % 3 == 1) {
+            push_event(&trace, 'E', ts, 0, 0, r % 4);
+        } else {
+            push_event(&trace, 'X', ts, r % 50, 0, r % 4);
+        }
+        ts += r % 7;
+    }
+    trace_finish(&trace);
+    trace_build_index(&trace);
+
+    for (u64 t0 = 0; t0 < ts; t0 += ts / 37) {
+        u64 t1 = t0 + ts / 53;
+        usize expected = 0;
+        for (usize i = 0; i < trace_get_slice_count(&trace); ++i) {
+            TraceSlice slice = trace_get_slice(&trace, i);
+            expected += slice.ts <= t1 && slice.ts + slice.dur >= t0;
+        }
+
+        usize count = 0;
+        for (usize i = 0; i < trace.num_tracks; ++i) {
+            TraceTrack *track = &trace.tracks[i];
+            for (u32 depth = 0; depth < track->num_depths; ++depth) {
+                TraceRange range =
+                    trace_track_query(track, depth, t0, t1);
+                for (u32 j = range.begin; j < range.end; ++j) {
+                    TraceSlice slice =
+                        trace_get_slice(&trace, track->slices[j]);
+                    ASSERT_EQ(slice.track, i);
+                    ASSERT_EQ(slice.depth, depth);
+                    ASSERT_TRUE(slice.ts <= t1 && slice.ts + slice.dur >= t0);
+                }
+                count += range.end - range.begin;
+            }
+        }
+        ASSERT_EQ(count, expected) << t0;
+    }
+
+    trace_deinit(&trace);
+}
+
+TEST(TraceTest, LodMatchesScan) {
+    Trace trace;
+    trace_init(&trace);
+
+    u64 seed = 7;
+    u64 ts = 1000;
+    for (usize i = 0; i < 5000; ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        u32 r = (u32)(seed >> 33);
+        push_event(&trace, r % 2 ? 'X' : r % 4 ? 'B' : 'E', ts, r % 300, 0,
+                   r % 3);
+        ts += r % 100;
+    }
+    trace_finish(&trace);
+    trace_build_index(&trace);
+    trace_build_lod(&trace, 4);
+
+    for (usize t = 0; t < trace.num_tracks; ++t) {
+        TraceTrack *track = &trace.tracks[t];
+        for (u32 depth = 0; depth < track->num_depths; ++depth) {
+            TraceLod *lod = &track->lods[depth];
+            ASSERT_GT(lod->num_levels, 0);
+            ASSERT_EQ(lod->levels[lod->num_levels - 1].num_buckets, 1);
+            for (u32 l = 0; l < lod->num_levels; ++l) {
+                TraceLodLevel *level = &lod->levels[l];
+                for (usize b = 0; b < level->num_buckets; ++b) {
+                    // Slices overlap [start, end), a slice without duration
+                    // overlaps the bucket it starts in.
+                    u64 start = (level->first_bucket + b) << level->shift;
+                    u64 end = start + (1ULL << level->shift);
+                    TraceLodBucket *bucket = &level->buckets[b];
+                    u32 count = 0;
+                    u64 coverage = 0;
+                    u64 busiest = 0;
+                    for (u32 i = track->depth_offsets[depth];
+                         i < track->depth_offsets[depth + 1]; ++i) {
+                        u64 ts = track->starts[i];
+                        u64 te = track->ends[i];
+                        bool overlaps = ts < end && (te > start ||
+                                                     (te == ts && ts >= start));
+                        if (!overlaps) {
+                            continue;
+                        }
+                        if (!count++) {
+                            ASSERT_EQ(bucket->first, i);
+                        }
+                        u64 overlap = min(te, end) - max(ts, start);
+                        if (te == ts) {
+                            overlap = 0;
+                        }
+                        coverage += overlap;
+                        busiest = max(busiest, overlap);
+                    }
+                    ASSERT_EQ(bucket->count, count);
+                    if (!count) {
+                        continue;
+                    }
+                    ASSERT_EQ(bucket->coverage, coverage);
+                    u64 s = max(track->starts[bucket->busiest], start);
+                    u64 e = min(track->ends[bucket->busiest], end);
+                    ASSERT_EQ(e > s ? e - s : 0, busiest);
+                }
+            }
+
+            TraceLodLevel *level = trace_lod_get_level(lod, ~0ULL);
+            ASSERT_EQ(level, &lod->levels[lod->num_levels - 1]);
+            u64 finest = 1ULL << lod->levels[0].shift;
+            ASSERT_EQ(trace_lod_get_level(lod, finest), &lod->levels[0]);
+            if (finest > 1) {
+                ASSERT_EQ(trace_lod_get_level(lod, finest - 1), nullptr);
+            }
+        }
+    }
+
+    trace_deinit(&trace);
+}
+
+TEST(TraceTest, CounterLodMatchesScan) {
+    Trace trace;
+    trace_init(&trace);
+
+    // Out of order, sorted by trace_build_index().
+    u64 seed = 3;
+    for (usize i = 0; i < 1000; ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        u32 r = (u32)(seed >> 33);
+        trace_push_counter_sample(&trace, 1, 2, 3, r % 5000, (f64)(r % 777));
+    }
+    trace_push_counter_sample(&trace, 1, 2, 4, 10, 1.0);
+    ASSERT_EQ(trace.num_counters, 2);
+    trace_finish(&trace);
+    trace_build_index(&trace);
+
+    TraceCounterSeries *counter = &trace.counters[0];
+    ASSERT_EQ(counter->num_samples, 1000);
+    ASSERT_TRUE(std::is_sorted(counter->ts, counter->ts + 1000));
+    ASSERT_EQ(counter->levels[counter->num_levels - 1].num_buckets, 1);
+    for (u32 l = 0; l < counter->num_levels; ++l) {
+        TraceCounterLevel *level = &counter->levels[l];
+        for (u32 b = 0; b < level->num_buckets; ++b) {
+            u32 begin = b << level->shift;
+            u32 end = min(begin + (1u << level->shift), 1000u);
+            f64 lo = *std::min_element(counter->values + begin,
+                                       counter->values + end);
+            f64 hi = *std::max_element(counter->values + begin,
+                                       counter->values + end);
+            ASSERT_EQ(level->min[b], lo);
+            ASSERT_EQ(level->max[b], hi);
+        }
+    }
+    ASSERT_EQ(trace_counter_get_level(counter, 7), nullptr);
+    ASSERT_EQ(trace_counter_get_level(counter, 8), &counter->levels[0]);
+    ASSERT_EQ(trace_counter_get_level(counter, 1 << 20),
+              &counter->levels[counter->num_levels - 1]);
+
+    // The sample before the range is included, its value holds at t0.
+    TraceRange range = trace_counter_query(counter, 1000, 2000);
+    ASSERT_LT(counter->ts[range.begin], 1000);
+    ASSERT_GE(counter->ts[range.begin + 1], 1000);
+    ASSERT_LE(counter->ts[range.end - 1], 2000);
+    ASSERT_GT(counter->ts[range.end], 2000);
+
+    trace_deinit(&trace);
+}
+
+TEST(TraceTest, AsyncLanes) {
+    Trace trace;
+    trace_init(&trace);
+
+    // Begin and end pairs with random ids, which overlap arbitrarily.
+    u64 seed = 5;
+    u64 ts = 0;
+    for (u32 i = 0; i < 4000; ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        u32 r = (u32)(seed >> 33);
+        push_event(&trace, 'n', ts, 0, 0);
+        TraceLinkPoint point = {
+            .id = r % 50,
+            .pid = 1,
+            .event = i,
+            .kind = (u8)(r % 3 ? TraceLink_AsyncBegin : TraceLink_AsyncEnd),
+        };
+        trace_push_link_point(&trace, &point);
+        ts += r % 10;
+    }
+    trace_finish(&trace);
+    trace_build_index(&trace);
+
+    ASSERT_EQ(trace.num_async_tracks, 1);
+    TraceAsyncTrack *track = &trace.async_tracks[0];
+    ASSERT_EQ(track->num_slices, trace.num_async_slices);
+
+    // Lanes don't overlap, and the number of lanes is the largest number of
+    // slices that overlap at any time.
+    std::vector<u64> lane_ends(track->num_lanes);
+    u32 max_overlap = 0;
+    for (u32 i = 0; i < track->num_slices; ++i) {
+        TraceAsyncSlice *slice = &trace.async_slices[track->slices[i]];
+        ASSERT_LT(slice->lane, track->num_lanes);
+        ASSERT_LE(lane_ends[slice->lane], slice->ts) << i;
+        lane_ends[slice->lane] = slice->ts + max(slice->dur, (u64)1);
+        u32 overlap = 0;
+        for (u64 end : lane_ends) {
+            overlap += end > slice->ts;
+        }
+        max_overlap = max(max_overlap, overlap);
+    }
+    ASSERT_EQ(track->num_lanes, max_overlap);
+
+    trace_deinit(&trace);
+}
+
+struct NestedSlice {
+    u64 ts;
+    u64 end;
+    u32 name;
+    u32 tid;
+    u32 depth;
+};
+
+// Pushes nested 'X' slices into [ts, end) of track `tid`.
+static void push_nested(Trace *trace, std::vector<NestedSlice> *slices,
+                        u32 *names, u64 *seed, u64 ts, u64 end, u32 tid,
+                        u32 depth) {
+    while (ts < end) {
+        *seed = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        u32 r = (u32)(*seed >> 33);
+        u64 start = ts + r % 50;
+        u64 stop = min(end, start + r % 400);
+        if (start >= end) {
+            break;
+        }
+        u32 name = names[r % 5];
+        push_event(trace, 'X', start, stop - start, name, tid);
+        slices->push_back({start, stop, name, tid, depth});
+        if (depth < 4 && stop - start > 20) {
+            push_nested(trace, slices, names, seed, start + 1, stop - 1, tid,
+                        depth + 1);
+        }
+        ts = stop;
+    }
+}
+
+static TraceNameStats get_name_stats(std::vector<NestedSlice> &slices,
+                                     u32 name, u64 t0, u64 t1) {
+    TraceNameStats stats = {.min_dur = UINT64_MAX};
+    for (NestedSlice &s : slices) {
+        if (s.name != name || s.ts < t0 || s.ts > t1) {
+            continue;
+        }
+        u64 dur = s.end - s.ts;
+        u64 self = dur;
+        for (NestedSlice &c : slices) {
+            if (c.tid == s.tid && c.depth == s.depth + 1 && c.ts >= s.ts &&
+                c.ts < s.end) {
+                self -= c.end - c.ts;
+            }
+        }
+        stats.count++;
+        stats.total_dur += dur;
+        stats.self_dur += self;
+        stats.min_dur = min(stats.min_dur, dur);
+        stats.max_dur = max(stats.max_dur, dur);
+    }
+    if (!stats.count) {
+        stats.min_dur = 0;
+    }
+    return stats;
+}
+
+TEST(TraceTest, NameStatsMatchScan) {
+    Trace trace;
+    trace_init(&trace);
+    u32 names[5];
+    for (u32 i = 0; i < 5; ++i) {
+        char name[2] = {(char)('a' + i), 0};
+        names[i] = trace_intern(&trace, {(u8 *)name, 1});
+    }
+
+    std::vector<NestedSlice> slices;
+    u64 seed = 11;
+    for (u32 tid = 1; tid <= 3; ++tid) {
+        push_nested(&trace, &slices, names, &seed, 0, 20000, tid, 0);
+    }
+    trace_finish(&trace);
+    trace_build_index(&trace);
+    trace_build_name_stats(&trace, 4);
+    ASSERT_EQ(trace_get_slice_count(&trace), slices.size());
+
+    for (u32 name : names) {
+        TraceNameStats expected = get_name_stats(slices, name, 0, UINT64_MAX);
+        TraceNameStats *stats = &trace.name_stats[name];
+        ASSERT_GT(stats->count, 0);
+        ASSERT_EQ(stats->count, expected.count);
+        ASSERT_EQ(stats->total_dur, expected.total_dur);
+        ASSERT_EQ(stats->self_dur, expected.self_dur);
+        ASSERT_EQ(stats->min_dur, expected.min_dur);
+        ASSERT_EQ(stats->max_dur, expected.max_dur);
+    }
+
+    std::vector<TraceNameStats> stats(trace.num_name_stats);
+    for (u64 t0 = 0; t0 < 21000; t0 += 1700) {
+        for (u64 t1 : {t0, t0 + 30, t0 + 300, t0 + 5000, (u64)UINT64_MAX}) {
+            trace_query_name_stats(&trace, t0, t1, stats.data());
+            for (u32 name : names) {
+                TraceNameStats expected =
+                    get_name_stats(slices, name, t0, t1);
+                TraceNameStats *s = &stats[name];
+                ASSERT_TRUE(s->count == expected.count &&
+                            s->total_dur == expected.total_dur &&
+                            s->self_dur == expected.self_dur &&
+                            s->min_dur == expected.min_dur &&
+                            s->max_dur == expected.max_dur)
+                    << t0 << " " << t1 << " " << name;
+            }
+        }
+    }
+
+    trace_deinit(&trace);
+}
+
+TEST(TraceTest, Search) {
+    Trace trace;
+    trace_init(&trace);
+    u32 names[] = {
+        trace_intern(&trace, STR_LITERAL("RunTask")),
+        trace_intern(&trace, STR_LITERAL("MessageLoop::Run")),
+        trace_intern(&trace, STR_LITERAL("Layout")),
+        trace_intern(&trace, STR_LITERAL("runner")),
+    };
+    // Not a slice name.
+    trace_intern(&trace, STR_LITERAL("Running"));
+    for (u32 i = 0; i < 1000; ++i) {
+        push_event(&trace, 'X', i * 10, 5, names[i % 4], i % 3);
+    }
+    trace_finish(&trace);
+    trace_build_index(&trace);
+
+    struct {
+        const char *query;
+        bool ignore_case;
+        std::vector<u32> names;
+    } cases[] = {
+        {"Run", false, {names[0], names[1]}},
+        {"run", true, {names[0], names[1], names[3]}},
+        {"RUN", false, {}},
+        {"ru", false, {names[3]}},
+        {"", false, {names[0], names[1], names[2], names[3]}},
+        {"oop::r", true, {names[1]}},
+        {"nurse", true, {}},
+    };
+    for (auto &c : cases) {
+        TraceSearch search;
+        trace_search_begin(&trace, {(u8 *)c.query, strlen(c.query)},
+                           c.ignore_case, &search);
+        // Page through with an odd page size.
+        std::vector<u32> slices;
+        u32 page[7];
+        while (u32 n = trace_search_next(&trace, &search, page, 7)) {
+            slices.insert(slices.end(), page, page + n);
+        }
+        trace_search_end(&search);
+
+        std::vector<u32> expected;
+        for (u32 name : c.names) {
+            for (u32 i = 0; i < trace_get_slice_count(&trace); ++i) {
+                if (trace_get_slice(&trace, i).name == name) {
+                    expected.push_back(i);
+                }
+            }
+        }
+        ASSERT_EQ(slices, expected) << c.query;
+    }
+
+    trace_deinit(&trace);
+}
+
+TEST(TraceTest, Snapshot) {
+    Trace trace;
+    trace_init(&trace);
+    ASSERT_EQ(trace.snapshot.version, 0);
+    ASSERT_EQ(trace.snapshot.num_events, 0);
+
+    u32 name = trace_intern(&trace, STR_LITERAL("a"));
+    for (u32 i = 0; i < 100; ++i) {
+        push_event(&trace, 'X', i * 10, 5, name, i % 2);
+    }
+    trace_publish_snapshot(&trace);
+    TraceSnapshot snapshot = trace.snapshot;
+    ASSERT_EQ(snapshot.version, 1);
+    ASSERT_EQ(snapshot.num_events, 100);
+    ASSERT_EQ(snapshot.num_slices, 100);
+    ASSERT_EQ(snapshot.num_tracks, 2);
+    ASSERT_EQ(snapshot.num_strings, trace.strings.count);
+    ASSERT_EQ(snapshot.end_ts, 995);
+
+    // Add chunks, and grow the string and track tables.
+    char str[16];
+    for (u32 i = 0; i < 5 * TRACE_EVENT_CHUNK_SIZE; ++i) {
+        snprintf(str, sizeof(str), "n%u", i % 5000);
+        u32 id = trace_intern(&trace, {(u8 *)str, strlen(str)});
+        push_event(&trace, 'X', 1000 + i, 1, id, 2 + i % 100);
+    }
+    ASSERT_EQ(trace.snapshot.version, 1);
+
+    // The snapshot still sees the old watermark and old contents.
+    for (usize i = 0; i < snapshot.num_events; ++i) {
+        usize offset;
+        TraceEventChunk *chunk =
+            trace_snapshot_get_event_chunk(&snapshot, i, &offset);
+        ASSERT_EQ(chunk->ts[offset], i * 10);
+        ASSERT_EQ(chunk->tid[offset], i % 2);
+    }
+    for (usize i = 0; i < snapshot.num_slices; ++i) {
+        usize offset;
+        TraceSliceChunk *chunk =
+            trace_snapshot_get_slice_chunk(&snapshot, i, &offset);
+        ASSERT_EQ(chunk->ts[offset], i * 10);
+        ASSERT_EQ(chunk->name[offset], name);
+    }
+    for (usize i = 0; i < snapshot.num_tracks; ++i) {
+        ASSERT_EQ(snapshot.tracks[i].tid, i);
+    }
+    ASSERT_TRUE(buf_equal(trace_snapshot_get_string(&snapshot, name),
+                          STR_LITERAL("a")));
+
+    trace_publish_snapshot(&trace);
+    ASSERT_EQ(trace.snapshot.version, 2);
+    ASSERT_EQ(trace.snapshot.num_events, 100 + 5 * TRACE_EVENT_CHUNK_SIZE);
+    ASSERT_EQ(trace.snapshot.num_tracks, 102);
+
+    trace_deinit(&trace);
+}
@@ -0,0 +1,147 @@
+#include "src/trigram.h"
+
+#include <memory.h>
+
+#include <algorithm>
+
+#include "src/memory.h"
+
+static const u32 INITIAL_LIST_CAPACITY = 256;
+static const u32 INITIAL_ID_CAPACITY = 4;
+
+static inline u8 to_lower(u8 ch) {
+    return ch >= 'A' && ch <= 'Z' ? ch | 0x20 : ch;
+}
+
+static inline u32 get_trigram(u8 *data) {
+    return (u32)to_lower(data[0]) | ((u32)to_lower(data[1]) << 8) |
+           ((u32)to_lower(data[2]) << 16);
+}
+
+static inline u32 trigram_hash(u32 trigram) {
+    u32 x = trigram * 0x9E3779B1u;
+    return x ^ (x >> 16);
+}
+
+void trigram_index_deinit(TrigramIndex *index) {
+    for (u32 i = 0; i < index->num_lists; ++i) {
+        memory_free(index->lists[i].ids);
+    }
+    memory_free(index->lists);
+    memory_free(index->slots);
+    *index = {};
+}
+
+static TrigramList *find_list(TrigramIndex *index, u32 trigram) {
+    if (!index->slots) {
+        return 0;
+    }
+    u32 slot_index = trigram_hash(trigram) & index->slot_mask;
+    while (u32 slot = index->slots[slot_index]) {
+        TrigramList *list = &index->lists[slot - 1];
+        if (list->trigram == trigram) {
+            return list;
+        }
+        slot_index = (slot_index + 1) & index->slot_mask;
+    }
+    return 0;
+}
+
+static void insert_slot(TrigramIndex *index, u32 trigram, u32 list) {
+    u32 slot_index = trigram_hash(trigram) & index->slot_mask;
+    while (index->slots[slot_index]) {
+        slot_index = (slot_index + 1) & index->slot_mask;
+    }
+    index->slots[slot_index] = list + 1;
+}
+
+static TrigramList *get_or_add_list(TrigramIndex *index, u32 trigram) {
+    TrigramList *list = find_list(index, trigram);
+    if (list) {
+        return list;
+    }
+
+    if (index->num_lists == index->list_capacity) {
+        index->list_capacity =
+            max(index->list_capacity << 1, INITIAL_LIST_CAPACITY);
+        index->lists = (TrigramList *)memory_realloc(
+            index->lists, index->list_capacity * sizeof(TrigramList));
+        ASSERT(index->lists);
+
+        // Keep the load factor at most 50%.
+        memory_free(index->slots);
+        u32 num_slots = index->list_capacity * 2;
+        index->slots = (u32 *)memory_calloc(num_slots, sizeof(u32));
+        ASSERT(index->slots);
+        index->slot_mask = num_slots - 1;
+        for (u32 i = 0; i < index->num_lists; ++i) {
+            insert_slot(index, index->lists[i].trigram, i);
+        }
+    }
+    u32 id = index->num_lists++;
+    list = &index->lists[id];
+    *list = {.trigram = trigram};
+    insert_slot(index, trigram, id);
+    return list;
+}
+
+void trigram_index_add(TrigramIndex *index, u32 id, Buf str) {
+    for (usize i = 0; i + 3 <= str.size; ++i) {
+        TrigramList *list = get_or_add_list(index, get_trigram(str.data + i));
+        if (list->count) {
+            ASSERT(list->ids[list->count - 1] <= id);
+            // The trigram occurs more than once in the string.
+            if (list->ids[list->count - 1] == id) {
+                continue;
+            }
+        }
+        if (list->count == list->capacity) {
+            list->capacity = max(list->capacity << 1, INITIAL_ID_CAPACITY);
+            list->ids = (u32 *)memory_realloc(list->ids,
+                                              list->capacity * sizeof(u32));
+            ASSERT(list->ids);
+        }
+        list->ids[list->count++] = id;
+    }
+}
+
+u32 trigram_index_query(TrigramIndex *index, Buf query, u32 **ids) {
+    ASSERT(query.size >= 3);
+    usize num_trigrams = query.size - 2;
+    TrigramList **lists =
+        (TrigramList **)memory_alloc(num_trigrams * sizeof(TrigramList *));
+    ASSERT(lists);
+    *ids = 0;
+    for (usize i = 0; i < num_trigrams; ++i) {
+        lists[i] = find_list(index, get_trigram(query.data + i));
+        if (!lists[i]) {
+            memory_free(lists);
+            return 0;
+        }
+    }
+
+    // Intersect starting from the shortest list, the result only shrinks.
+    std::sort(lists, lists + num_trigrams, [](TrigramList *a, TrigramList *b) {
+        return a->count < b->count;
+    });
+    u32 count = lists[0]->count;
+    *ids = (u32 *)memory_alloc(count * sizeof(u32));
+    ASSERT(*ids);
+    memcpy(*ids, lists[0]->ids, count * sizeof(u32));
+    for (usize i = 1; i < num_trigrams && count; ++i) {
+        TrigramList *list = lists[i];
+        u32 *cursor = list->ids;
+        u32 *end = list->ids + list->count;
+        u32 num_kept = 0;
+        for (u32 j = 0; j < count && cursor != end; ++j) {
+            cursor = std::lower_bound(cursor, end, (*ids)[j]);
+            if (cursor != end && *cursor == (*ids)[j]) {
+                (*ids)[num_kept++] = (*ids)[j];
+            }
+        }
+        count = num_kept;
+    }
+
+    memory_free(lists);
+    return count;
+}
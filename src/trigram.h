@@ -0,0 +1,37 @@
+#pragma once
+
+#include "src/buf.h"
+#include "src/defs.h"
+
+// Maps each trigram (3 consecutive bytes, ASCII letters lowercased) to the
+// sorted ids of the strings that contain it, so that substring searches only
+// need to look at strings that contain every trigram of the query. Strings are
+// added one at a time in increasing order of id.
+
+struct TrigramList {
+    u32 trigram;
+    u32 count;
+    u32 capacity;
+    u32 *ids;
+};
+
+struct TrigramIndex {
+    TrigramList *lists;
+    u32 num_lists;
+    u32 list_capacity;
+    // Open addressing hash table of list index + 1 (0 means empty).
+    u32 *slots;
+    u32 slot_mask;
+};
+
+// A zero-initialized TrigramIndex is empty.
+void trigram_index_deinit(TrigramIndex *index);
+
+// `id` must be greater than the ids of all strings added before.
+void trigram_index_add(TrigramIndex *index, u32 id, Buf str);
+
+// Writes the sorted ids of the strings that contain all trigrams of `query`,
+// ignoring ASCII case, to `*ids`, which must be freed with memory_free(), and
+// returns their count. Candidates still need to be checked because trigrams
+// don't keep their order. `query` must be at least 3 bytes long.
+u32 trigram_index_query(TrigramIndex *index, Buf query, u32 **ids);
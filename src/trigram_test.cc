@@ -0,0 +1,66 @@
+#include "src/trigram.h"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <vector>
+
+#include "src/memory.h"
+
+static Buf to_buf(const char *str) { return {(u8 *)str, strlen(str)}; }
+
+static std::vector<u32> query(TrigramIndex *index, const char *str) {
+    u32 *ids;
+    u32 count = trigram_index_query(index, to_buf(str), &ids);
+    std::vector<u32> result(ids, ids + count);
+    memory_free(ids);
+    return result;
+}
+
+TEST(TrigramTest, Empty) {
+    TrigramIndex index = {};
+    ASSERT_EQ(query(&index, "abz"), std::vector<u32>{});
+    trigram_index_deinit(&index);
+}
+
+TEST(TrigramTest, Query) {
+    TrigramIndex index = {};
+    const char *strings[] = {
+        "",          "ab",     "MessageLoop::Run", "RunTask",
+        "runrunrun", "Layout", "nur",              "abc_bcd",
+    };
+    for (u32 i = 0; i < sizeof(strings) / sizeof(strings[0]); ++i) {
+        trigram_index_add(&index, i, to_buf(strings[i]));
+    }
+
+    ASSERT_EQ(query(&index, "run"), (std::vector<u32>{2, 3, 4}));
+    ASSERT_EQ(query(&index, "RUN"), (std::vector<u32>{2, 3, 4}));
+    ASSERT_EQ(query(&index, "runt"), (std::vector<u32>{3}));
+    ASSERT_EQ(query(&index, "loop::"), (std::vector<u32>{2}));
+    ASSERT_EQ(query(&index, "lay"), (std::vector<u32>{5}));
+    // Candidates contain every trigram, but not necessarily in order.
+    ASSERT_EQ(query(&index, "abcd"), (std::vector<u32>{7}));
+    ASSERT_EQ(query(&index, "xyz"), std::vector<u32>{});
+    ASSERT_EQ(query(&index, "abz"), std::vector<u32>{});
+
+    trigram_index_deinit(&index);
+}
+
+TEST(TrigramTest, ManyStrings) {
+    TrigramIndex index = {};
+    char str[32];
+    for (u32 i = 0; i < 10000; ++i) {
+        snprintf(str, sizeof(str), "name_%u_%s", i, i % 7 ? "x" : "Seven");
+        trigram_index_add(&index, i, to_buf(str));
+    }
+
+    std::vector<u32> ids = query(&index, "seven");
+    ASSERT_EQ(ids.size(), 1429);
+    for (usize i = 0; i < ids.size(); ++i) {
+        ASSERT_EQ(ids[i], i * 7);
+    }
+    ASSERT_EQ(query(&index, "_1234_"), (std::vector<u32>{1234}));
+
+    trigram_index_deinit(&index);
+}
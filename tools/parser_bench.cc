@@ -1,4 +1,5 @@
 #include <errno.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,6 +7,7 @@
 #include <chrono>
 
 #include "src/json_trace.h"
+#include "src/parallel.h"
 #include "src/trace.h"
 #include "tools/common.h"
 
@@ -18,6 +20,10 @@ USAGE:
 
 OPTIONS:
     -h, --help                  Print help information.
+    --threads=<INT>             Read the whole file into memory and parse it
+                                with <INT> threads, 0 for all cores.
+    --mmap                      Map the file and parse it in place, with the
+                                threads given by --threads.
 )";
 
 static void print_usage() { fprintf(stderr, "%s", USAGE); }
@@ -26,12 +32,26 @@ struct Args {
     bool valid;
     bool help;
     Buf file;
+    bool parallel;
+    bool mmap;
+    usize num_threads;
 };
 
 static void parse_arg(Args *args, Buf key, Buf value) {
     if (buf_equal(key, STR_LITERAL("-h")) ||
         buf_equal(key, STR_LITERAL("--help"))) {
         args->help = true;
+    } else if (buf_equal(key, STR_LITERAL("--threads"))) {
+        u64 num_threads;
+        if (value.data &&
+            sscanf((const char *)value.data, "%" SCNu64, &num_threads) == 1) {
+            args->parallel = true;
+            args->num_threads = num_threads;
+        } else {
+            args->valid = false;
+        }
+    } else if (buf_equal(key, STR_LITERAL("--mmap"))) {
+        args->mmap = true;
     } else if (!value.data) {
         // Arg without value, treat it as <FILE> argument.
         if (!args->file.data) {
@@ -77,9 +97,95 @@ static Args parse_args(int argc, char *argv[]) {
 //     return true;
 // }
 
+static void print_result(usize total,
+                         std::chrono::high_resolution_clock::time_point start,
+                         Trace *trace) {
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration =
+        std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    f64 speed =
+        (f64)total / (f64)duration.count() * 1024.0 * 1024.0 / 1'000'000;
+    fprintf(stdout, "Speed: %.2f MB/s\n", speed);
+    fprintf(stdout, "Events: %zu\n", trace_get_event_count(trace));
+}
+
+static int run_parallel(Args args, FILE *file) {
+    fseek(file, 0, SEEK_END);
+    usize size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    Buf input = {.data = (u8 *)memory_alloc(size), .size = size};
+    ASSERT(input.data);
+    if (fread(input.data, 1, size, file) != size) {
+        fprintf(stderr, "Failed to read file %.*s\n", (int)args.file.size,
+                args.file.data);
+        return 1;
+    }
+
+    usize num_threads =
+        args.num_threads ? args.num_threads : parallel_get_num_threads();
+
+    MemoryArena arena;
+    memory_arena_init(&arena);
+
+    JsonTraceParser parser;
+    json_trace_parser_init(&parser, &arena);
+
+    Trace trace;
+    trace_init(&trace);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    JsonTraceResult result =
+        json_trace_parser_parse_parallel(&parser, &trace, input, num_threads);
+    if (result == JsonTraceResult_Error) {
+        fprintf(stderr, "Error: %s\n", json_trace_parser_get_error(&parser));
+        return 1;
+    }
+    print_result(size, start, &trace);
+
+    trace_deinit(&trace);
+    memory_arena_deinit(&arena);
+    memory_free(input.data);
+
+    return 0;
+}
+
+static int run_mapped(Args args) {
+    usize num_threads = args.parallel ? args.num_threads : 1;
+    if (!num_threads) {
+        num_threads = parallel_get_num_threads();
+    }
+
+    MemoryArena arena;
+    memory_arena_init(&arena);
+
+    JsonTraceParser parser;
+    json_trace_parser_init(&parser, &arena);
+
+    Trace trace;
+    trace_init(&trace);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    JsonTraceResult result = json_trace_parser_parse_file(
+        &parser, &trace, (const char *)args.file.data, num_threads);
+    if (result == JsonTraceResult_Error) {
+        fprintf(stderr, "Error: %s\n", json_trace_parser_get_error(&parser));
+        return 1;
+    }
+    print_result(trace.file.data.size, start, &trace);
+
+    trace_deinit(&trace);
+    memory_arena_deinit(&arena);
+
+    return 0;
+}
+
 static int run(Args args) {
     ASSERT(args.file.data);
 
+    if (args.mmap) {
+        return run_mapped(args);
+    }
+
     FILE *file = fopen((const char *)args.file.data, "rb");
     if (!file) {
         fprintf(stderr, "Failed to open file %.*s: %s\n", (int)args.file.size,
@@ -87,6 +193,10 @@ static int run(Args args) {
         return 1;
     }
 
+    if (args.parallel) {
+        return run_parallel(args, file);
+    }
+
     u8 buf[4 * 1024 * 1024];
 
     MemoryArena arena;
@@ -96,7 +206,7 @@ static int run(Args args) {
     json_trace_parser_init(&parser, &arena);
 
     Trace trace;
-    // TODO: init trace
+    trace_init(&trace);
 
     auto start = std::chrono::high_resolution_clock::now();
 
@@ -127,14 +237,9 @@ static int run(Args args) {
         }
     }
 
-    auto end = std::chrono::high_resolution_clock::now();
-    auto duration =
-        std::chrono::duration_cast<std::chrono::microseconds>(end - start);
-    duration.count();
-    f64 speed =
-        (f64)total / (f64)duration.count() * 1024.0 * 1024.0 / 1'000'000;
-    fprintf(stdout, "Speed: %.2f MB/s\n", speed);
+    print_result(total, start, &trace);
 
+    trace_deinit(&trace);
     memory_arena_deinit(&arena);
 
     return 0;